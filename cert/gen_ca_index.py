@@ -0,0 +1,85 @@
+#!/usr/bin/env python3
+"""Converts a PEM CA bundle to modules/src/tls_ca_index.c: every root as DER in one array,
+plus an index sorted by raw subject name so the TLS CA callback can look up the issuer of a
+certificate with a binary search and parse only that root.
+
+Usage (from root): python3 cert/gen_ca_index.py [cert/cacert.pem] [modules/src/tls_ca_index.c]
+"""
+
+import base64
+import re
+import sys
+
+PEM_RE = re.compile(rb"-----BEGIN CERTIFICATE-----(.+?)-----END CERTIFICATE-----", re.S)
+
+
+def read_tlv(buf, pos):
+    """Returns (tag, content start, end) of the DER element at pos"""
+    tag    = buf[pos]
+    length = buf[pos + 1]
+    header = 2
+    if length & 0x80:
+        count  = length & 0x7F
+        length = int.from_bytes(buf[pos + 2:pos + 2 + count], "big")
+        header += count
+    return tag, pos + header, pos + header + length
+
+
+def subject_of(der):
+    """Offset and length of the subject Name, tag and length included like mbedtls subject_raw"""
+    _, cert, _ = read_tlv(der, 0)
+    _, pos, _  = read_tlv(der, cert)  # tbsCertificate
+    if der[pos] == 0xA0:              # [0] version
+        pos = read_tlv(der, pos)[2]
+    for _ in range(4):                # serialNumber, signature, issuer, validity
+        pos = read_tlv(der, pos)[2]
+    tag, _, end = read_tlv(der, pos)
+    if tag != 0x30:
+        raise ValueError("subject is not a SEQUENCE")
+    return pos, end - pos
+
+
+def main():
+    src = sys.argv[1] if len(sys.argv) > 1 else "cert/cacert.pem"
+    dst = sys.argv[2] if len(sys.argv) > 2 else "modules/src/tls_ca_index.c"
+
+    with open(src, "rb") as f:
+        pem = f.read()
+
+    certs = []
+    for block in PEM_RE.findall(pem):
+        der = base64.b64decode(b"".join(block.split()))
+        subject, subject_len = subject_of(der)
+        certs.append((der[subject:subject + subject_len], der, subject))
+
+    # Same order as the C side compares in: length first, then bytes
+    certs.sort(key=lambda c: (len(c[0]), c[0]))
+
+    blob    = bytearray()
+    entries = []
+    for name, der, subject in certs:
+        entries.append((len(blob), len(der), len(blob) + subject, len(name)))
+        blob += der
+
+    out = []
+    out.append("/* Generated by cert/gen_ca_index.py from %s, do not edit */\n" % src)
+    out.append("#include <maestromodules/tls_ca_index.h>\n\n")
+    out.append("const unsigned char tls_ca_der[] = {\n")
+    for i in range(0, len(blob), 16):
+        out.append("    " + ", ".join("0x%02x" % b for b in blob[i:i + 16]) + ",\n")
+    out.append("};\n")
+    out.append("const size_t tls_ca_der_len = %d;\n\n" % len(blob))
+    out.append("const TLS_CA_Entry tls_ca_index[] = {\n")
+    for entry in entries:
+        out.append("    {%d, %d, %d, %d},\n" % entry)
+    out.append("};\n")
+    out.append("const size_t tls_ca_index_count = %d;\n" % len(entries))
+
+    with open(dst, "w") as f:
+        f.write("".join(out))
+
+    print("%s: %d roots, %d DER bytes" % (dst, len(entries), len(blob)))
+
+
+if __name__ == "__main__":
+    main()
@@ -1,6 +1,6 @@
 #include <maestromodules/http_client.h>
 #include <maestromodules/scheduler.h>
-#include <maestromodules/tls_ca_bundle.h>
+#include <maestromodules/tls_ca_index.h>
 #include <maestromodules/tls_global_ca.h>
 #include <maestromodules/tls_client.h>
 #include <maestromodules/transport.h>
@@ -191,7 +191,8 @@ static int run_nonblocking(const char* url, int timeout_ms, const char* out_path
       break;
     }
 
-    scheduler_work(now);
+    // Runs due tasks and sleeps once until the next deadline
+    scheduler_run_once(100);
   }
 
   // If callback didn't steal, free dummy (usually stays NULL in your implementation).
@@ -0,0 +1,74 @@
+#ifndef __CONNECTION_POOL_H__
+#define __CONNECTION_POOL_H__
+
+/* ******************************************************************* */
+/* ************************* CONNECTION POOL ************************* */
+/* ******************************************************************* */
+
+/* Keeps idle HTTP/1.1 keep-alive Transports keyed by scheme, host and port
+ * (and blocking mode, the socket flags differ) so repeated requests to the
+ * same host skip DNS, the TCP connect and the TLS handshake.
+ *
+ * Opt-in: until connection_pool_init has been called every acquire opens a
+ * fresh Transport and every release closes it, exactly like before.
+ * All functions are thread safe. */
+
+#include <maestromodules/transport.h>
+#include <maestroutils/error.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+#ifndef CONNECTION_POOL_MAX_PER_HOST
+#define CONNECTION_POOL_MAX_PER_HOST 8 // Open connections per key, idle and checked out
+#endif
+
+#ifndef CONNECTION_POOL_MAX_IDLE
+#define CONNECTION_POOL_MAX_IDLE 64 // Idle connections over all keys
+#endif
+
+#ifndef CONNECTION_POOL_IDLE_TIMEOUT_MS
+#define CONNECTION_POOL_IDLE_TIMEOUT_MS 30000
+#endif
+
+typedef struct
+{
+  int      max_per_host;    // <= 0 = CONNECTION_POOL_MAX_PER_HOST
+  int      max_idle;        // <= 0 = CONNECTION_POOL_MAX_IDLE
+  uint64_t idle_timeout_ms; // 0 = CONNECTION_POOL_IDLE_TIMEOUT_MS
+
+} Connection_Pool_Config;
+
+/** Enables pooling, NULL config = defaults. Calling it again updates the limits */
+int connection_pool_init(const Connection_Pool_Config* _Config);
+
+bool connection_pool_enabled();
+
+/** Hands out a healthy idle connection for the key, otherwise opens a new one.
+ * Returns:
+ *   SUCCESS          *_out is connected (reused or blocking connect finished)
+ *   ERR_IN_PROGRESS  *_out is a new non-blocking connection, finish with transport_finish_connect
+ *   ERR_BUSY         the key is at max_per_host, try again later
+ *   error codes from transport_init */
+int connection_pool_acquire(const char* _scheme, const char* _host, const char* _port,
+                            bool _blocking, int _timeout_ms, Transport** _out);
+
+/** true when the last acquire handed out this connection from the idle list */
+bool connection_pool_is_reused(const Transport* _Transport);
+
+/** Returns a connection from connection_pool_acquire. It is kept idle when _reusable is set
+ * and the pool has room, otherwise closed and freed. The fd must no longer be watched by
+ * a reactor. Only mark a connection reusable once its last response was read completely */
+void connection_pool_release(Transport* _Transport, bool _reusable);
+
+/** Closes idle connections older than the idle timeout, also done on every acquire/release */
+void connection_pool_prune();
+
+/** Number of idle connections kept for the key */
+int connection_pool_idle_count(const char* _scheme, const char* _host, const char* _port,
+                               bool _blocking);
+
+/** Closes all idle connections and disables pooling. Connections still checked out are
+ * closed when they are released */
+void connection_pool_dispose();
+
+#endif
@@ -0,0 +1,76 @@
+#ifndef __HTTP_CHUNKED_H__
+#define __HTTP_CHUNKED_H__
+
+/* ******************************************************************* */
+/* ********************* CHUNKED TRANSFER DECODER ******************** */
+/* ******************************************************************* */
+
+/* Incremental decoder for Transfer-Encoding: chunked. Bytes can be fed in
+ * pieces of any size, split anywhere. Chunk data is handed to a callback as
+ * pointers into the fed buffer, so the decoder itself never copies or
+ * allocates. Chunk extensions are skipped and trailers are read and dropped.
+ * Framing must use CRLF, a bare LF is rejected. */
+
+#include <maestroutils/error.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#ifndef HTTP_CHUNKED_MAX_LINE
+#define HTTP_CHUNKED_MAX_LINE 4096 // Chunk size line including extensions
+#endif
+
+#ifndef HTTP_CHUNKED_MAX_TRAILERS
+#define HTTP_CHUNKED_MAX_TRAILERS 8192 // All trailer lines together
+#endif
+
+typedef enum
+{
+  HTTP_CHUNKED_SIZE,        // Hex digits of the chunk size
+  HTTP_CHUNKED_EXTENSION,   // ;name=value after the size, skipped
+  HTTP_CHUNKED_SIZE_LF,     // \n ending the size line
+  HTTP_CHUNKED_DATA,        // chunk_remaining bytes of data
+  HTTP_CHUNKED_DATA_CR,     // \r\n after the data
+  HTTP_CHUNKED_DATA_LF,
+  HTTP_CHUNKED_TRAILER,     // Start of a trailer line, or of the final empty line
+  HTTP_CHUNKED_TRAILER_LINE,
+  HTTP_CHUNKED_TRAILER_LF,
+  HTTP_CHUNKED_END_LF,      // \n of the final empty line
+  HTTP_CHUNKED_DONE,
+  HTTP_CHUNKED_ERROR,
+
+} HTTP_Chunked_State;
+
+/* Gets decoded body bytes, _data points into the buffer given to http_chunked_feed.
+ * A negative return stops decoding and is returned by http_chunked_feed */
+typedef int (*http_chunked_on_data)(void* _context, const uint8_t* _data, size_t _len);
+
+typedef struct
+{
+  HTTP_Chunked_State state;
+
+  uint64_t chunk_remaining; // Data bytes left in the current chunk
+  uint64_t body_len;        // Decoded bytes so far
+  size_t   line_len;        // Bytes of the current size or trailer line
+  size_t   trailer_len;     // Trailer bytes so far
+  int      size_digits;
+
+} HTTP_Chunked;
+
+void http_chunked_init(HTTP_Chunked* _Decoder);
+
+/** Decodes as much of _data as possible. *_consumed gets the bytes used, which stops right after
+ * the final CRLF so anything behind it (a pipelined response) is left alone.
+ * Returns:
+ *   SUCCESS         all of _data was used or the body is complete, see http_chunked_done
+ *   ERR_BAD_FORMAT  malformed framing, the decoder stays in HTTP_CHUNKED_ERROR
+ *   a negative value returned by _on_data */
+int http_chunked_feed(HTTP_Chunked* _Decoder, const uint8_t* _data, size_t _len, size_t* _consumed,
+                      http_chunked_on_data _on_data, void* _context);
+
+static inline bool http_chunked_done(const HTTP_Chunked* _Decoder)
+{
+  return _Decoder->state == HTTP_CHUNKED_DONE;
+}
+
+#endif
@@ -4,6 +4,9 @@
 #ifndef HTTPClient_h
 #define HTTPClient_h
 
+#include <maestromodules/connection_pool.h>
+#include <maestromodules/http_chunked.h>
+#include <maestromodules/http_headers.h>
 #include <maestromodules/scheduler.h>
 #include <maestroutils/error.h>
 #include <maestromodules/http_parser.h>
@@ -11,6 +14,46 @@
 #include <stdbool.h>
 #include <stdint.h>
 
+#ifndef HTTP_CLIENT_IO_FALLBACK_MS
+#define HTTP_CLIENT_IO_FALLBACK_MS 1000 // Re-check a socket parked on the reactor at least this often
+#endif
+
+#ifndef HTTP_CLIENT_READ_CHUNK
+#define HTTP_CLIENT_READ_CHUNK 16384 // First read size, then adapts to how full reads come back
+#endif
+
+#ifndef HTTP_CLIENT_READ_MIN
+#define HTTP_CLIENT_READ_MIN 4096
+#endif
+
+#ifndef HTTP_CLIENT_READ_MAX
+#define HTTP_CLIENT_READ_MAX (4 << 20) // Upper bound even when SO_RCVBUF is larger
+#endif
+
+#ifndef HTTP_CLIENT_TICK_BUDGET
+#define HTTP_CLIENT_TICK_BUDGET (1 << 20) // Bytes one client may move per tick before yielding
+#endif
+
+#ifndef HTTP_CLIENT_SPLICE_CHUNK
+#define HTTP_CLIENT_SPLICE_CHUNK (1 << 20) // Pipe size and bytes moved per splice() in downloads
+#endif
+
+#ifndef HTTP_CLIENT_SEND_CHUNK
+#define HTTP_CLIENT_SEND_CHUNK 65536 // Body bytes read from a file or source per write
+#endif
+
+#ifndef HTTP_CLIENT_SEND_IOV
+#define HTTP_CLIENT_SEND_IOV 64 // Buffers handed to one gathered write
+#endif
+
+#ifndef HTTP_CLIENT_PIPELINE_MAX
+#define HTTP_CLIENT_PIPELINE_MAX 64 // Requests written back to back on one connection
+#endif
+
+#ifndef HTTP_CLIENT_POOL_RETRY_MS
+#define HTTP_CLIENT_POOL_RETRY_MS 10 // Retry interval while the host is at its connection cap
+#endif
+
 typedef enum
 {
   HTTP_CLIENT_INITIALIZING,
@@ -31,6 +74,49 @@ typedef enum
 
 typedef void (*http_client_on_success)(void* _context, char** _response);
 
+/* Gets the response body piece by piece as it arrives. Return 0 to keep going, anything else
+ * aborts the request with ERR_ABORTED */
+typedef int (*http_client_on_body_chunk)(void* _context, const uint8_t* _data, size_t _len);
+
+/* Ends a streamed request, _result is SUCCESS or the error that stopped it */
+typedef void (*http_client_on_done)(void* _context, int _result);
+
+/* Bytes the destination holds so far, counting a resumed prefix. _total is -1 when the response
+ * has no Content-Length */
+typedef void (*http_client_on_progress)(void* _context, uint64_t _received, int64_t _total);
+
+typedef struct
+{
+  bool                    resume;      // Keep what the fd already holds and Range-request the rest
+  http_client_on_progress on_progress; // Optional
+
+} HTTP_Download_Options;
+
+/* Produces the next part of a request body into _buf, at most _len bytes. Returns the bytes
+ * written, 0 at the end of the body, or a negative value to abort the request with ERR_ABORTED */
+typedef ssize_t (*http_client_body_source)(void* _context, uint8_t* _buf, size_t _len);
+
+/* Request body that is never copied into the request. The slices are written straight from
+ * caller memory, followed by either the rest of the file fd from its current offset or what
+ * source produces. All of it is caller-owned and must stay valid until the request is done.
+ * length is the whole body, -1 to let the client find it: the slices plus the rest of fd, or
+ * Transfer-Encoding: chunked when there is a source */
+typedef struct
+{
+  const struct iovec*     slices;
+  int                     slice_count;
+  int                     fd;             // -1 for none
+  http_client_body_source source;         // Optional, not together with fd
+  void*                   source_context;
+  int64_t                 length;
+  const char*             content_type;   // NULL for application/octet-stream
+
+} HTTP_Request_Body;
+
+/* Called once per pipelined request in order. *_response is NULL when the connection failed
+ * before that response arrived, the request can be retried */
+typedef void (*http_client_on_pipeline_response)(void* _context, int _index, char** _response);
+
 typedef struct
 {
   uint8_t* addr;
@@ -52,7 +138,6 @@ typedef struct
   uint64_t next_retry_at;
 
   size_t bytes_sent;
-  size_t decoded_body_len;
 
   Scheduler_Task*        task;
   const char*            URL;
@@ -63,37 +148,138 @@ typedef struct
   char**                 response_out;
   uint8_t*               request_buffer;
   uint8_t*               response_buffer;
-  uint8_t*               decoded_body; // Might be too small
-  http_data*             recv_buf;
   http_data*             blocking_out;
 
-  http_data resp_buf;
-  Transport transport;
+  Byte_Buffer       recv_buf;        // Response bytes read but not parsed yet
+  Byte_Buffer       decoded_body;    // Chunked body with the framing removed
+  HTTP_Chunked      chunked_decoder; // Position in a chunked body
+  HTTP_Header_Table headers;         // Headers of the response being read
+  Transport*        transport;       // From connection_pool_acquire, NULL when not connected
 
   int    request_length;
   int    bytes_received;
   int    retries;
-  int    content_length;
+  size_t content_length;
   int    chunked;
-  size_t chunk_remaining;
   int    timeout_ms;
 
   HTTPClientState state;
   HTTPMethod      method;
 
   bool blocking_mode;
-  /******************************************************* ADD BUFFER AND BUFFER SIZE TO REPLACE TCP
-   * BUFFER AND SIZE FOR READING & WRITING *****************************************************/
+  bool io_watched;       // Transport fd is registered with the scheduler's reactor
+  bool transport_reused; // Connection came idle from the pool, may have gone stale
+  bool keep_alive;       // Response allows the connection to be pooled afterwards
+
+  char**                           pipeline_paths; // Request targets when pipelining, else NULL
+  int                              pipeline_count;
+  int                              pipeline_index; // Response currently being read
+  http_client_on_pipeline_response on_pipeline_response;
+
+  http_client_on_body_chunk on_body_chunk; // Streaming when this or body_fd is set
+  http_client_on_done       on_done;
+  int                       body_fd;       // Body is written here when >= 0 (HTTP_DOWNLOAD)
+  size_t                    body_received; // Body bytes streamed so far
+  int                       body_error;    // Why streaming stopped, 0 while it runs
+  uint64_t                  body_offset;   // Bytes body_fd already held when resuming
+  http_client_on_progress   on_progress;
+
+  int  splice_pipe[2]; // socket -> pipe -> body_fd for plain HTTP downloads
+  bool splice_open;
+  bool splice_off; // splice() is not supported for this fd pair, copy instead
+
+  size_t read_size;  // Next read request, between HTTP_CLIENT_READ_MIN and read_max
+  size_t read_max;   // From SO_RCVBUF, 0 until the first full read on this connection
+  size_t tick_bytes; // Read or written during the current scheduler tick
+
+  HTTP_Request_Body send_body;     // length 0 when the request has no body
+  struct iovec      send_iov[HTTP_CLIENT_SEND_IOV]; // Queued request bytes, sent from send_iov_pos
+  int               send_iov_pos;
+  int               send_iov_count;
+  int               send_slice;      // Next body slice to queue
+  off_t             send_file_start; // Offset of send_body.fd when the body starts
+  off_t             send_file_off;
+  uint64_t          send_left;       // Body bytes not queued yet, unused when chunked
+  bool              send_chunked;
+  bool              send_source_done;
+  Byte_Buffer       send_stage;         // File or source bytes on their way out
+  char              send_chunk_line[24]; // Size line of the queued chunk
 } HTTP_Client;
 
 /*Blocking API calls*/
 /*_out is allocated in this client but needs to be free'd by caller*/
 int http_blocking_get(const char* _url, http_data* _out, int _timeout_ms);
 int http_blocking_post(const char* _url, const http_data* in, http_data* out, int _timeout_ms);
+
+/* Sends _Body with _method without copying it, the response lands in _out like a POST */
+int http_blocking_send(const char* _url, HTTPMethod _method, const HTTP_Request_Body* _Body,
+                       http_data* _out, int _timeout_ms);
+
+/* GET that hands the body to _on_body_chunk as it arrives instead of collecting it */
+int http_blocking_stream(const char* _url, http_client_on_body_chunk _on_body_chunk,
+                         void* _context, int _timeout_ms);
+
+/* HTTP_DOWNLOAD, a GET whose body is written to _fd as it arrives. _Options may be NULL,
+ * _context goes to on_progress */
+int http_blocking_download(const char* _url, int _fd, const HTTP_Download_Options* _Options,
+                           void* _context, int _timeout_ms);
 /**/
 
-int  http_client_initiate(HTTP_Client* _Client, const char* _URL, HTTPMethod _method,
-                          http_client_on_success _on_success, void* _context, char** _response_out);
+/** Runs the request on the least-loaded scheduler shard when scheduler_shards_start has been
+ * called, otherwise on Global_Scheduler. On a shard _on_success fires on the shard's thread */
+int http_client_initiate(HTTP_Client* _Client, const char* _URL, HTTPMethod _method,
+                         http_client_on_success _on_success, void* _context, char** _response_out);
+
+/** Same as http_client_initiate but on a given scheduler */
+int http_client_initiate_on(HTTP_Client* _Client, Scheduler* _Sched, const char* _URL,
+                            HTTPMethod _method, http_client_on_success _on_success, void* _context,
+                            char** _response_out);
+
+/** Like http_client_initiate with a request body. Header block and body go out with gathered
+ * writes, files are sent with sendfile() on plain HTTP. The descriptor is copied, what it points
+ * to is not */
+int http_client_send(HTTP_Client* _Client, const char* _URL, HTTPMethod _method,
+                     const HTTP_Request_Body* _Body, http_client_on_success _on_success,
+                     void* _context, char** _response_out);
+
+int http_client_send_on(HTTP_Client* _Client, Scheduler* _Sched, const char* _URL,
+                        HTTPMethod _method, const HTTP_Request_Body* _Body,
+                        http_client_on_success _on_success, void* _context, char** _response_out);
+
+/** Writes GETs for all _URLs back to back on one connection and reads the responses in FIFO
+ * order. The URLs must share scheme, host and port and should be idempotent. Like
+ * http_client_initiate the client runs on a shard when shards are started */
+int http_client_pipeline(HTTP_Client* _Client, const char** _URLs, int _count,
+                         http_client_on_pipeline_response _on_response, void* _context);
+
+int http_client_pipeline_on(HTTP_Client* _Client, Scheduler* _Sched, const char** _URLs,
+                            int _count, http_client_on_pipeline_response _on_response,
+                            void* _context);
+
+/** Streaming GET, the body never sits in memory as a whole. _on_done fires exactly once when the
+ * request has started, also on failure. Runs on a shard like http_client_initiate */
+int http_client_stream(HTTP_Client* _Client, const char* _URL,
+                       http_client_on_body_chunk _on_body_chunk, http_client_on_done _on_done,
+                       void* _context);
+
+int http_client_stream_on(HTTP_Client* _Client, Scheduler* _Sched, const char* _URL,
+                          http_client_on_body_chunk _on_body_chunk, http_client_on_done _on_done,
+                          void* _context);
+
+/** HTTP_DOWNLOAD: streams the body of a GET to _fd, which is not closed. Plain HTTP bodies with
+ * a Content-Length are moved with splice() and never enter user space. _fd must not be opened
+ * with O_APPEND for that (it falls back to copying). With _Options->resume the request asks for
+ * the bytes after the current end of _fd. A 206 appends, a 416 means _fd is already complete and
+ * a 200 (Range ignored) starts the file over. Any other status of 300 and up but 304 leaves _fd
+ * untouched and ends in _on_done with ERR_IO, streams fail the same way */
+int http_client_download(HTTP_Client* _Client, const char* _URL, int _fd,
+                         const HTTP_Download_Options* _Options, http_client_on_done _on_done,
+                         void* _context);
+
+int http_client_download_on(HTTP_Client* _Client, Scheduler* _Sched, const char* _URL, int _fd,
+                            const HTTP_Download_Options* _Options, http_client_on_done _on_done,
+                            void* _context);
+
 void http_client_dispose(HTTP_Client* _Client);
 
 #endif // HTTPClient_h
@@ -0,0 +1,85 @@
+#ifndef __HTTP_HEADERS_H__
+#define __HTTP_HEADERS_H__
+
+/* ******************************************************************* */
+/* *************************** HEADER TABLE ************************** */
+/* ******************************************************************* */
+
+/* A parsed header block in a single allocation: a flat array of entries followed by a copy of
+ * the block, with every name and value NUL-terminated in place. The headers the client acts on
+ * are recognized while parsing, so looking one of them up is an array index. Names compare
+ * case-insensitively. A zeroed table is an empty one */
+
+#include <maestroutils/error.h>
+#include <stddef.h>
+#include <stdint.h>
+
+typedef enum
+{
+  HTTP_HEADER_CONTENT_LENGTH,
+  HTTP_HEADER_TRANSFER_ENCODING,
+  HTTP_HEADER_CONTENT_TYPE,
+  HTTP_HEADER_ETAG,
+  HTTP_HEADER_CONNECTION,
+  HTTP_HEADER_LOCATION,
+  HTTP_HEADER_KNOWN_COUNT,
+
+  HTTP_HEADER_OTHER = HTTP_HEADER_KNOWN_COUNT,
+
+} HTTP_Header_Id;
+
+typedef struct
+{
+  uint32_t       name;  // Offsets into the arena
+  uint32_t       value;
+  uint32_t       name_len;
+  uint32_t       value_len;
+  HTTP_Header_Id id;
+
+} HTTP_Header;
+
+typedef struct
+{
+  HTTP_Header* entries; // The allocation, the arena follows the array
+  char*        arena;
+  int          count;
+  int          known[HTTP_HEADER_KNOWN_COUNT]; // First entry with that name + 1, 0 when absent
+
+} HTTP_Header_Table;
+
+/** Parses "Name: value\r\n" lines up to the empty line or the end of _buf, replacing what the
+ * table held. A last line without CRLF is ignored.
+ * Returns:
+ *   SUCCESS
+ *   ERR_BAD_FORMAT  a line without a colon or with a name that isn't a token, the table is
+ *                   left empty
+ *   ERR_NO_MEMORY */
+int http_header_table_parse(HTTP_Header_Table* _Table, const char* _buf, size_t _buf_len);
+
+/** Which known header _name is, HTTP_HEADER_OTHER for any other */
+HTTP_Header_Id http_header_id(const char* _name, size_t _len);
+
+/** Value of the first header called _name, NULL when there is none */
+const char* http_header_table_find(const HTTP_Header_Table* _Table, const char* _name);
+
+void http_header_table_clear(HTTP_Header_Table* _Table);
+
+/** Value of the first known header _id, NULL when the response has none */
+static inline const char* http_header_table_get(const HTTP_Header_Table* _Table,
+                                                HTTP_Header_Id _id)
+{
+  int index = _Table->known[_id];
+  return index ? _Table->arena + _Table->entries[index - 1].value : NULL;
+}
+
+static inline const char* http_header_table_name(const HTTP_Header_Table* _Table, int _index)
+{
+  return _Table->arena + _Table->entries[_index].name;
+}
+
+static inline const char* http_header_table_value(const HTTP_Header_Table* _Table, int _index)
+{
+  return _Table->arena + _Table->entries[_index].value;
+}
+
+#endif
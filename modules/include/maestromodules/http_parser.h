@@ -5,6 +5,7 @@
 /* ************************** HTTP PARSING *************************** */
 /* ******************************************************************* */
 
+#include "http_headers.h"
 #include "linked_list.h"
 #include <maestroutils/HTTPStatusCodes.h>
 #include <maestroutils/error.h>
@@ -79,6 +80,8 @@ int         http_parser_first_line(const char* _line, size_t _line_len, HTTP_Req
                                    Linked_List** _params_out);
 int         http_parser_find_line_end(const uint8_t* _buf, size_t _buf_len);
 int         http_parser_find_headers_end(const uint8_t* _buf, size_t _buf_len);
+/* List based header API, kept for existing callers. New code parses into an HTTP_Header_Table
+ * with http_header_table_parse, which does one allocation per block instead of five per header */
 int         http_parser_headers(const char* _buf, size_t _buf_len, Linked_List** _headers_out);
 void        http_parser_dispose_linked_list(Linked_List* _list);
 int  http_parser_get_header_value(Linked_List* _headers, char* _name, const char** _out_value);
@@ -0,0 +1,41 @@
+#ifndef __HTTP_SCAN_H__
+#define __HTTP_SCAN_H__
+
+/* ******************************************************************* */
+/* ************************** HTTP SCANNING ************************** */
+/* ******************************************************************* */
+
+/* Byte scanning kernels for the HTTP parser: CRLF and header-end search, token validation and
+ * ASCII lowercasing. On x86 the widest of AVX2, SSE2 and plain C that the CPU supports is picked
+ * the first time a kernel runs. Define HTTP_SCAN_SCALAR to build without the vector kernels */
+
+#include <stddef.h>
+#include <stdint.h>
+
+typedef enum
+{
+  HTTP_SCAN_LEVEL_SCALAR,
+  HTTP_SCAN_LEVEL_SSE2,
+  HTTP_SCAN_LEVEL_AVX2,
+
+} HTTP_Scan_Level;
+
+/** Offset of the first "\r\n" in _buf, _len when there is none */
+size_t http_scan_crlf(const uint8_t* _buf, size_t _len);
+
+/** Offset of the first "\r\n\r\n" in _buf, _len when there is none */
+size_t http_scan_headers_end(const uint8_t* _buf, size_t _len);
+
+/** Length of the run of token characters (RFC 9110 tchar) _buf starts with */
+size_t http_scan_token(const uint8_t* _buf, size_t _len);
+
+/** ASCII lowercase copy of _src to _dst, which may be _src itself */
+void http_scan_lower(uint8_t* _dst, const uint8_t* _src, size_t _len);
+
+HTTP_Scan_Level http_scan_level(void);
+
+/** Switches kernels, meant for benchmarks and tests. A level the CPU can't run falls back to
+ * the best one it can. Returns the level now in use */
+HTTP_Scan_Level http_scan_set_level(HTTP_Scan_Level _level);
+
+#endif
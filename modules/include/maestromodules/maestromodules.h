@@ -1,11 +1,19 @@
 #pragma once
 
+#include <maestromodules/connection_pool.h>
 #include <maestromodules/curl.h>
+#include <maestromodules/http_chunked.h>
 #include <maestromodules/http_client.h>
+#include <maestromodules/http_headers.h>
 #include <maestromodules/http_parser.h>
+#include <maestromodules/http_scan.h>
 #include <maestromodules/linked_list.h>
+#include <maestromodules/reactor.h>
+#include <maestromodules/scheduler.h>
 #include <maestromodules/tcp_client.h>
 #include <maestromodules/tcp_client.h>
-#include <maestromodules/tls_ca_bundle.h>
+#include <maestromodules/tls_ca_index.h>
 #include <maestromodules/tls_global_ca.h>
+#include <maestromodules/tls_session_cache.h>
+#include <maestromodules/tls_verify_cache.h>
 #include <maestromodules/tls_client.h>
@@ -0,0 +1,60 @@
+#ifndef __REACTOR_H__
+#define __REACTOR_H__
+
+/* ******************************************************************* */
+/* ***************************** REACTOR ***************************** */
+/* ******************************************************************* */
+
+/* Readiness notification for non-blocking sockets (epoll on Linux).
+ * Each fd is registered once together with an owner pointer and then armed
+ * one-shot for the direction the owner is waiting for. When the fd becomes
+ * ready the owner is handed to the on_ready callback and the fd is disarmed
+ * until it is armed again, so idle connections cost nothing. */
+
+#include <maestroutils/error.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+#ifndef REACTOR_MAX_EVENTS
+#define REACTOR_MAX_EVENTS 64 // Readiness events handled per reactor_wait call
+#endif
+
+typedef enum
+{
+  REACTOR_READABLE = 1 << 0,
+  REACTOR_WRITABLE = 1 << 1,
+
+} ReactorInterest;
+
+/* Called for every ready fd, _owner is what the fd was registered with */
+typedef void (*reactor_on_ready)(void* _context, void* _owner, uint32_t _interest);
+
+typedef struct
+{
+  int  epoll_fd;
+  int  wake_fd; // eventfd used by reactor_wakeup
+  bool ready;
+
+} Reactor;
+
+int reactor_init(Reactor* _Reactor);
+
+/** Adds _fd to the reactor, disarmed. _owner must outlive the registration */
+int reactor_register(Reactor* _Reactor, int _fd, void* _owner);
+
+/** Arms a registered fd for one notification in the given ReactorInterest direction(s) */
+int reactor_arm(Reactor* _Reactor, int _fd, void* _owner, uint32_t _interest);
+
+/** Removes _fd, must be called before the fd is closed or handed to someone else */
+void reactor_unregister(Reactor* _Reactor, int _fd);
+
+/** Waits at most _timeout_ms (< 0 = forever) and dispatches ready fds to _on_ready.
+ * Returns number of events handled or a negative ErrorCode */
+int reactor_wait(Reactor* _Reactor, int _timeout_ms, reactor_on_ready _on_ready, void* _context);
+
+/** Interrupts a blocking reactor_wait, safe to call from any thread */
+void reactor_wakeup(Reactor* _Reactor);
+
+void reactor_dispose(Reactor* _Reactor);
+
+#endif
@@ -4,17 +4,26 @@
 #ifndef _scheduler_h_
 #define _scheduler_h_
 
+#include <pthread.h>
+#include <stdbool.h>
 #include <stdint.h>
 #include <string.h>
 
+#include <maestromodules/reactor.h>
 #include <maestroutils/error.h>
 #include <maestroutils/time_utils.h>
 
 #ifndef SCHEDULER_MAX_TASKS
-#define SCHEDULER_MAX_TASKS 10000
+#define SCHEDULER_MAX_TASKS 10000 // Capacity of Global_Scheduler and the default for shards
 #endif
 
-#define MIN_LOOP_MS 1 // Defines how many ms a scheduler task-loop needs to take at a minimum
+#ifndef SCHEDULER_MAX_SHARDS
+#define SCHEDULER_MAX_SHARDS 64
+#endif
+
+#define MIN_LOOP_MS 1 // Suggested poll interval for tasks that have no better deadline to wait for
+
+typedef struct Scheduler Scheduler;
 
 typedef struct
 {
@@ -22,22 +31,136 @@ typedef struct
   /*replace callback with work function from other module?*/
   void (*callback)(void* _context, uint64_t _montime);
 
+  uint64_t   next_due;     // Monotonic ms when the task is due to run again
+  int        heap_index;   // Position in the due-heap, -1 while running or free
+  int        active_index; // Position in the dense active set, -1 when free
+  Scheduler* scheduler;    // Owning scheduler
+
 } Scheduler_Task;
 
-typedef struct
+/** Tasks live in a fixed slab so the pointers handed out stay valid.
+ * Live tasks are also kept in a dense active set (O(1) count/remove) and
+ * in a min-heap keyed by next_due, so a tick only touches due tasks.
+ *
+ * Every scheduler owns its tasks and reactor. The structures are guarded by
+ * a mutex so tasks can be added from any thread, callbacks always run on the
+ * thread driving the scheduler without the lock held */
+struct Scheduler
 {
-  Scheduler_Task tasks[SCHEDULER_MAX_TASKS];
+  Scheduler_Task* tasks;
 
-} Scheduler;
+  Scheduler_Task** active; // Dense set of live tasks
+  Scheduler_Task** heap;   // Min-heap on next_due
+  Scheduler_Task** ready;  // Due tasks popped for the current tick
+  int*             free_slots;
+
+  int capacity;
+  int active_count;
+  int heap_count;
+  int free_count;
+
+  Reactor reactor; // Idle wait, wakes tasks whose sockets become ready
+
+  pthread_mutex_t lock;
+  pthread_t       thread;    // Loop thread when started with scheduler_run, for joining
+  pthread_t       loop_self; // Recorded by the loop thread itself, valid once loop_known
+  bool            loop_known;
+  bool            running; // Loop thread is alive or being started, guarded by lock
+  bool            stop;    // Asks the loop thread to exit, guarded by lock
+  bool            initialized;
+};
 
 extern Scheduler Global_Scheduler;
 
+/* ---------------------- Global scheduler ---------------------- */
+
+/* The process-wide default, driven by the caller with scheduler_work/run_once */
+
 int scheduler_init();
 Scheduler_Task* scheduler_create_task(void* _context,
                                       void (*_callback)(void* _context, uint64_t _montime));
-void scheduler_destroy_task(Scheduler_Task* _Task);
 void scheduler_work(uint64_t _montime);
-int scheduler_get_task_count();
+
+/** Monotonic ms of the earliest queued task, UINT64_MAX when there is nothing queued */
+uint64_t scheduler_next_due();
+
+/** Blocks until the earliest task is due, a watched fd becomes ready or
+ * scheduler_wakeup is called. _max_wait_ms < 0 means no upper bound.
+ * Returns number of events handled or a negative ErrorCode */
+int scheduler_wait(uint64_t _montime, int _max_wait_ms);
+
+/** Interrupts a blocking scheduler_wait, safe to call from any thread */
+void scheduler_wakeup();
+
+/** One loop pass: runs all due tasks, then sleeps once until there is more to do */
+int scheduler_run_once(int _max_wait_ms);
+
+int  scheduler_get_task_count();
 void scheduler_dispose();
 
+/* ---------------------- Scheduler instances ---------------------- */
+
+/** Allocates a scheduler with room for _capacity tasks (<= 0 = SCHEDULER_MAX_TASKS) */
+Scheduler* scheduler_create(int _capacity);
+
+/** Starts a thread that loops scheduler_run_once_on until scheduler_stop */
+int scheduler_run(Scheduler* _Sched);
+
+/** Stops and joins the loop thread, tasks are kept. With concurrent calls one of them joins,
+ * the others return without waiting */
+void scheduler_stop(Scheduler* _Sched);
+
+/** Stops the scheduler, destroys its remaining tasks and frees it */
+void scheduler_destroy(Scheduler* _Sched);
+
+/** Safe to call from any thread, wakes the loop thread so the task runs right away */
+Scheduler_Task* scheduler_create_task_on(Scheduler* _Sched, void* _context,
+                                         void (*_callback)(void* _context, uint64_t _montime));
+
+/** Like scheduler_create_task_on but the task never runs until scheduler_task_set_due arms it,
+ * so the caller can store the handle before another thread gets to the callback */
+Scheduler_Task* scheduler_create_task_parked_on(Scheduler* _Sched, void* _context,
+                                                void (*_callback)(void* _context,
+                                                                  uint64_t _montime));
+
+void     scheduler_work_on(Scheduler* _Sched, uint64_t _montime);
+uint64_t scheduler_next_due_on(Scheduler* _Sched);
+int      scheduler_wait_on(Scheduler* _Sched, uint64_t _montime, int _max_wait_ms);
+void     scheduler_wakeup_on(Scheduler* _Sched);
+int      scheduler_run_once_on(Scheduler* _Sched, int _max_wait_ms);
+int      scheduler_get_task_count_on(Scheduler* _Sched);
+
+/* ---------------------- Tasks (any scheduler) ---------------------- */
+
+/** Should be called from the owning scheduler's thread (typically from the task itself) */
+void scheduler_destroy_task(Scheduler_Task* _Task);
+
+/** Sets when the task should run next. A task that never calls this runs every tick.
+ * Safe to call from inside the task's own callback */
+void scheduler_task_set_due(Scheduler_Task* _Task, uint64_t _due);
+
+/** Registers a socket owned by the task with the scheduler's reactor */
+int scheduler_task_watch_fd(Scheduler_Task* _Task, int _fd);
+
+/** Parks the task until _fd is ready in the ReactorInterest direction(s) or
+ * _timeout_at passes, whichever comes first. The fd must be watched */
+int scheduler_task_wait_fd(Scheduler_Task* _Task, int _fd, uint32_t _interest,
+                           uint64_t _timeout_at);
+
+/** Must be called before the fd is closed or the task destroyed */
+void scheduler_task_unwatch_fd(Scheduler_Task* _Task, int _fd);
+
+/* ---------------------- Shards ---------------------- */
+
+/** Starts _count schedulers (<= 0 = one per online CPU), each on its own thread */
+int scheduler_shards_start(int _count);
+
+/** Least-loaded running shard, NULL when shards are not started */
+Scheduler* scheduler_shards_pick();
+
+int scheduler_shards_count();
+
+/** Stops all shard threads and destroys the shards with their remaining tasks */
+void scheduler_shards_stop();
+
 #endif
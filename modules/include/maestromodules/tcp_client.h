@@ -19,6 +19,7 @@
 #include <string.h>
 #include <sys/socket.h>
 #include <sys/types.h>
+#include <sys/uio.h>
 #include <unistd.h>
 
 typedef enum
@@ -66,6 +67,11 @@ ssize_t tcp_client_realloc_data(TCP_Data* _Data, void* _input, size_t _size);
 
 int tcp_client_write(TCP_Client* _Client, size_t _length);
 int tcp_client_write_simple(TCP_Client* _Client, const uint8_t* _buf, int _len);
+/** Sends _count buffers in one call, like tcp_client_write_simple on them back to back */
+ssize_t tcp_client_writev(TCP_Client* _Client, const struct iovec* _iov, int _count);
+/** Sends up to _count bytes of _fd starting at *_offset straight from the page cache and
+ * advances *_offset. The file offset of _fd is not used or changed */
+ssize_t tcp_client_sendfile(TCP_Client* _Client, int _fd, off_t* _offset, size_t _count);
 int tcp_client_connect_step(TCP_Client* _Client); // For nonblocking tls
 int tcp_client_finish_connect(int _fd);
 
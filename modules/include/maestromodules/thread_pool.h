@@ -1,27 +1,141 @@
 #ifndef __THREAD_POOL_H__
 #define __THREAD_POOL_H__
 
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
 /* ======================== STRUCTS ======================== */
 
+/* Handle for joining a single task, see tp_future_create */
+typedef struct TP_Future TP_Future;
+
+/* Order in which queued tasks are taken, zero-initialized tasks are NORMAL */
+typedef enum {
+  TP_PRIORITY_NORMAL = 0,
+  TP_PRIORITY_HIGH,
+  TP_PRIORITY_LOW,
+  TP_PRIORITY_COUNT
+
+} TP_Priority;
+
 typedef struct {
-  void (*thread_func)(void*); 
+  void (*thread_func)(void*);
   void* thread_arg;
-  void (*callback_func)(void*); 
+  void (*callback_func)(void*);
   void* callback_arg;
+  TP_Future* future; // Optional, completed after callback_func has run
+
+  TP_Priority priority;
+  uint64_t    deadline; // Monotonic ms, 0 = none. Earliest deadline runs before any priority
 
 } TP_Task;
 
 typedef struct Thread_Pool Thread_Pool;
 
+#define TP_DEFAULT_DEQUE_CAPACITY 1024
+#define TP_DEFAULT_QUEUE_CAPACITY 1024
+#define TP_DEFAULT_STARVATION_LIMIT 16
+
+/* What tp_task_add does when the shared queue is full */
+typedef enum {
+  TP_BACKPRESSURE_GROW = 0, // Double the queue (default, unbounded like before)
+  TP_BACKPRESSURE_BLOCK,    // Wait for a worker to free a slot (workers grow instead)
+  TP_BACKPRESSURE_FAIL,     // Return ERR_BUSY
+
+} TP_Backpressure;
+
+typedef struct {
+  int  max_threads;    // <= 0 uses the tp_init minimum
+
+  /* Every worker gets its own lock-free deque. Tasks added from inside a
+   * worker go to that worker's deque, idle workers steal from the others.
+   * Tasks from outside the pool (and deque overflow) use the shared queue */
+  bool work_stealing;
+  int  deque_capacity; // Per worker, rounded up to a power of two (0 = default)
+
+  /* Tasks are copied into a ring buffer, no allocation per task */
+  int             queue_capacity; // Initial slots (0 = default)
+  TP_Backpressure backpressure;
+
+  /* Times a waiting lower class may be passed over before it gets the next
+   * worker anyway (0 = default) */
+  int starvation_limit;
+
+  /* Placement, all optional */
+  const char** cpu_sets;      // Per worker cpulist ("0-3,8"), reused round-robin
+  int          cpu_set_count;
+  bool         numa_bind;     // Run workers on numa_node's CPUs and prefer its memory
+  int          numa_node;
+  size_t       stack_size;    // 0 = system default
+  const char*  name_prefix;   // Workers are named "<prefix>-<index>", up to 8 chars (NULL = "tp")
+
+  bool size_from_online_cpus; // max_threads <= 0 uses the online (or numa_node) CPU count
+
+} TP_Config;
+
+/* Loop body for tp_parallel_for, handles indices [_begin, _end) */
+typedef void (*tp_range_fn)(long _begin, long _end, void* _context);
+
+/* Accumulates indices [_begin, _end) into _partial (same type as the reduce result) */
+typedef void (*tp_reduce_fn)(long _begin, long _end, void* _partial, void* _context);
+
+/* Merges a finished _partial into _result, calls are serialized */
+typedef void (*tp_combine_fn)(void* _result, const void* _partial, void* _context);
+
 /* ======================= INTERFACE ======================= */
 
 /* Initializes a thread pool with given amount of threads */
 Thread_Pool* tp_init(int _max_threads);
 
-/* Adds a task to the thread pool queue to be executed when a 
- * thread becomes available */
+/* Initializes a thread pool from a config, NULL config = tp_init defaults */
+Thread_Pool* tp_init_ex(const TP_Config* _Config);
+
+/* Adds a task to the thread pool queue to be executed when a
+ * thread becomes available. The task is copied, _Task can be reused.
+ * Returns 0, ERR_BUSY (TP_BACKPRESSURE_FAIL and queue full) or < 0 on error */
 int tp_task_add(Thread_Pool* _Pool, TP_Task* _Task);
 
+/* Adds _count tasks under one lock with a single wakeup.
+ * Returns 0 when all were queued, ERR_BUSY (TP_BACKPRESSURE_FAIL) when none were,
+ * < 0 on other errors (tasks before the failing one stay queued) */
+int tp_task_add_batch(Thread_Pool* _Pool, TP_Task* _Tasks, int _count);
+
+/* Creates an unfinished future owned by the caller. Set it as TP_Task.future,
+ * the pool keeps its own reference until the task has run */
+TP_Future* tp_future_create();
+
+/* true once the task (and its callback) has finished */
+bool tp_future_poll(TP_Future* _Future);
+
+/* Blocks until the task has finished, _result_out (optional) gets what the
+ * task passed to tp_task_set_result, NULL if nothing */
+int tp_future_wait(TP_Future* _Future, void** _result_out);
+
+/* Drops the caller's reference, safe before the task has finished */
+void tp_future_release(TP_Future* _Future);
+
+/* Called from inside thread_func, stores the result in the running task's future */
+void tp_task_set_result(void* _result);
+
+/* Runs _fn over [_begin, _end) split into chunks of at least _grain indices
+ * (<= 0 = 1). Chunks start large and shrink as the range runs out. The calling
+ * thread works too, so this is safe to call from inside a pool task.
+ * Returns when every index has been processed */
+int tp_parallel_for(Thread_Pool* _Pool, long _begin, long _end, long _grain, tp_range_fn _fn,
+                    void* _context);
+
+/* Like tp_parallel_for but every participant reduces into its own partial.
+ * *_result (_size bytes) must hold the identity value on entry, each partial
+ * starts as a copy of it and is merged back with _combine. Combine order is
+ * unspecified */
+int tp_parallel_reduce(Thread_Pool* _Pool, long _begin, long _end, long _grain, void* _result,
+                       size_t _size, tp_reduce_fn _fn, tp_combine_fn _combine, void* _context);
+
+/* Tasks of _priority waiting in the shared queue, deadline tasks count under their
+ * priority. Tasks on work-stealing deques are not included. -1 on bad arguments */
+int tp_get_queue_depth(Thread_Pool* _Pool, TP_Priority _priority);
+
 /** Helper for caller to wait for all active tasks to finish
  * for example to let them catch up before disposing */
 void tp_wait(Thread_Pool* _Pool);
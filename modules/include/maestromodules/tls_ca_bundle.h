@@ -1,5 +0,0 @@
-#pragma once
-#include <stddef.h>
-
-extern const unsigned char g_ca_bundle_pem[];
-extern const size_t        g_ca_bundle_pem_len;
@@ -0,0 +1,30 @@
+#ifndef __TLS_CA_INDEX_H__
+#define __TLS_CA_INDEX_H__
+
+/* ******************************************************************* */
+/* ************************** TLS CA INDEX *************************** */
+/* ******************************************************************* */
+
+/* The compiled-in root CAs as DER, generated from cert/cacert.pem by cert/gen_ca_index.py
+ * (cmake --build <dir> --target tls_ca_index, or make ca-index). The index is sorted by
+ * subject length, then subject bytes */
+
+#include <stddef.h>
+#include <stdint.h>
+
+typedef struct
+{
+  uint32_t der; // Offsets into tls_ca_der
+  uint32_t der_len;
+  uint32_t subject; // Raw subject Name, tag and length included
+  uint32_t subject_len;
+
+} TLS_CA_Entry;
+
+extern const unsigned char tls_ca_der[];
+extern const size_t        tls_ca_der_len;
+
+extern const TLS_CA_Entry tls_ca_index[];
+extern const size_t       tls_ca_index_count;
+
+#endif
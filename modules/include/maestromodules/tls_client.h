@@ -9,6 +9,9 @@
 #include <mbedtls/entropy.h>
 #include <mbedtls/ctr_drbg.h>
 #include <maestromodules/tcp_client.h>
+#include <maestromodules/tls_session_cache.h>
+#include <pthread.h>
+#include <stdbool.h>
 
 // Jag har använt samma states som i tcp_client.h, men vi kan självklart ändra om det inte makes
 // sense
@@ -44,34 +47,92 @@ typedef struct
   tls_bio_send_fn send;
   tls_bio_recv_fn recv;
 } TLS_BIO;
+
+#define TLS_CLIENT_MAX_CHAIN 8 // Longer peer chains are verified every time, never cached
+
+#ifndef TLS_CLIENT_RECORD_SIZE
+#define TLS_CLIENT_RECORD_SIZE 16384 // Plaintext per record, small writes are gathered up to this
+#endif
+
+/* Everything connections have in common, set up once and only read afterwards: the client
+ * config (mode, verification rules, RNG, CA chain) and the RNG behind it. Any number of
+ * TLS_Clients on any threads can share one, the DRBG is behind a lock */
 typedef struct
 {
-  // Active TLS session (holds handshake state, negotiated keys, record layer)
-  mbedtls_ssl_context ssl;
-
-  // Per-connection TLS config (mode, verification rules, RNG, CA chain)
   mbedtls_ssl_config conf;
+  mbedtls_ssl_config conf_deferred; // Same without chain verification, for the verify cache
 
-  //  OS/hardware entropy provider used to seed this specific connection's DRBG
+  //  OS/hardware entropy provider used to seed the DRBG
   mbedtls_entropy_context entropy;
 
   //  Cryptographically secure deterministic RNG used by TLS (key material, nonces)
   mbedtls_ctr_drbg_context ctr_drbg;
+  pthread_mutex_t          drbg_lock;
+
+  size_t record_size; // Plaintext per outgoing record, see tls_context_set_record_size
+
+} TLS_Context;
+
+typedef struct
+{
+  // Active TLS session (holds handshake state, negotiated keys, record layer)
+  mbedtls_ssl_context ssl;
+
+  const TLS_Context* context; // Shared config, not owned
 
   int            handshake_done;
   TCP_Client*    tcp;  //  TCP socket used by TLS
   const char*    host; //  Target hostname (used for SNI and certificate hostname verification)
   TLSClientState state;
   TLS_BIO        bio;
+  bool           want_write; // Last EAGAIN was mbedtls waiting to send, not to receive
+
+  char session_host[TLS_SESSION_CACHE_HOST_MAX]; // Hostname copy, empty = too long to cache
+  bool session_offered; // A cached session was handed to this handshake
+  bool ticket_pending;  // Ticket received during the handshake, saved once it completes
+  bool verify_deferred; // Chain verified by tls_client after the handshake (verify cache)
+
+  // Plaintext waiting to fill a record, allocated on first write
+  uint8_t* out_buf;
+  size_t   out_len;
+  size_t   out_cap;     // Record size for this connection
+  size_t   out_sending; // Head of out_buf mbedtls is still flushing, retried with this length
 
 } TLS_Client;
 
 int tls_client_handshake_step(TLS_Client* c); // 0=done, ERR_IN_PROGRESS=needs more, <0=fatal
 
 
+/** Sets up a context with the global CA (global_tls_ca_init must have succeeded). It has to
+ * outlive every TLS_Client using it, and be disposed before the global CA */
+int  tls_context_init(TLS_Context* _Context);
+void tls_context_dispose(TLS_Context* _Context);
+
+/** Caps outgoing records at _size bytes of plaintext (0 = TLS_CLIENT_RECORD_SIZE). At 4096 or
+ * less the max_fragment_length extension asks the server to keep its records that small too.
+ * Call it before any TLS_Client uses the context */
+int tls_context_set_record_size(TLS_Context* _Context, size_t _size);
+
+/** The context tls_client_init uses, created on first use. NULL when it can't be set up */
+TLS_Context* tls_context_default();
+void         tls_context_default_dispose();
+
+/** tls_client_init sets up the connection against tls_context_default() */
 int  tls_client_init(TLS_Client* c, const char* hostname, const TLS_BIO* bio);
-int  tls_client_read(TLS_Client* c, uint8_t* buf, size_t len); // <0 sets errno like TCP
-int  tls_client_write(TLS_Client* c, const uint8_t* buf, size_t len);
+int  tls_client_init_context(TLS_Client* c, const TLS_Context* context, const char* hostname,
+                             const TLS_BIO* bio);
+/** Reads whatever plaintext mbedtls already holds, up to len, before going to the socket again.
+ * <0 sets errno like TCP */
+int tls_client_read(TLS_Client* c, uint8_t* buf, size_t len);
+
+/** Takes up to len bytes into the record being filled and sends each record once it's full.
+ * Returns the bytes taken, -1 with errno EAGAIN when none could be. The tail that doesn't fill
+ * a record stays buffered until tls_client_flush */
+int tls_client_write(TLS_Client* c, const uint8_t* buf, size_t len);
+
+/** Sends everything tls_client_write buffered. 0 when done, -1 with errno EAGAIN or EIO */
+int tls_client_flush(TLS_Client* c);
+
 void tls_client_dispose(TLS_Client* c);
 
 
@@ -2,6 +2,16 @@
 
 #include <mbedtls/x509_crt.h>
 
-int               global_tls_ca_init(void);
+/* The compiled-in root CAs (tls_ca_index.h). Verification goes through global_tls_ca_cb,
+ * which parses only the roots a chain names as its issuer */
+
+int global_tls_ca_init(void);
+int global_tls_ca_ready(void);
+
+/** mbedtls_ssl_conf_ca_cb callback: the roots whose subject is _child's issuer */
+int global_tls_ca_cb(void* _ctx, mbedtls_x509_crt const* _child, mbedtls_x509_crt** _candidates);
+
+/** Every root parsed into one chain, done on first call. Only for code that needs the chain
+ * itself, TLS_Client doesn't */
 mbedtls_x509_crt* global_tls_ca_get(void);
 void              global_tls_ca_dispose(void);
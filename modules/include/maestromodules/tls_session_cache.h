@@ -0,0 +1,45 @@
+#ifndef __TLS_SESSION_CACHE_H__
+#define __TLS_SESSION_CACHE_H__
+
+/* ******************************************************************* */
+/* ************************ TLS SESSION CACHE ************************ */
+/* ******************************************************************* */
+
+/* Process-wide store of TLS sessions keyed by hostname, so the next connection to a host can
+ * resume (session ID or ticket in TLS 1.2, ticket/PSK in TLS 1.3) instead of doing a full
+ * handshake. TLS_Client fills and uses it on its own, nothing needs to be called to enable it.
+ * Sessions are kept serialized, a load hands out a fresh copy.
+ * All functions are thread safe. */
+
+#include <maestroutils/error.h>
+#include <mbedtls/ssl.h>
+#include <stdint.h>
+
+#ifndef TLS_SESSION_CACHE_MAX
+#define TLS_SESSION_CACHE_MAX 64 // Hosts, the least recently used is dropped beyond this
+#endif
+
+#ifndef TLS_SESSION_CACHE_TTL_MS
+#define TLS_SESSION_CACHE_TTL_MS 3600000 // Upper bound, servers usually expire tickets sooner
+#endif
+
+#define TLS_SESSION_CACHE_HOST_MAX 256 // Fits any DNS name
+
+/** Saves a copy of _Session for _host, replacing what was kept for it */
+int tls_session_cache_store(const char* _host, const mbedtls_ssl_session* _Session);
+
+/** Copies the session kept for _host into _Session, which must be initialized. Free it with
+ * mbedtls_ssl_session_free.
+ * Returns:
+ *   SUCCESS
+ *   ERR_NOT_FOUND  nothing kept for _host, or it expired */
+int tls_session_cache_load(const char* _host, mbedtls_ssl_session* _Session);
+
+/** Forgets _host, used when resuming its session failed */
+void tls_session_cache_remove(const char* _host);
+
+int tls_session_cache_count();
+
+void tls_session_cache_dispose();
+
+#endif
@@ -0,0 +1,58 @@
+#ifndef __TLS_VERIFY_CACHE_H__
+#define __TLS_VERIFY_CACHE_H__
+
+/* ******************************************************************* */
+/* ************************ TLS VERIFY CACHE ************************* */
+/* ******************************************************************* */
+
+/* Remembers certificate chains that passed verification, keyed by the SHA-256 of the leaf and
+ * of the whole chain. A TLS_Client that gets a chain it has seen before skips the signature
+ * checks and only matches the hostname against the leaf. An entry lives until the TTL runs
+ * out or the first certificate in the chain expires, whichever comes first.
+ *
+ * Opt-in: until tls_verify_cache_init has been called every handshake verifies the chain in
+ * full, exactly like before. All functions are thread safe. */
+
+#include <maestroutils/error.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <time.h>
+
+#ifndef TLS_VERIFY_CACHE_MAX
+#define TLS_VERIFY_CACHE_MAX 64 // Chains, the one expiring first is dropped beyond this
+#endif
+
+#ifndef TLS_VERIFY_CACHE_TTL_MS
+#define TLS_VERIFY_CACHE_TTL_MS 600000
+#endif
+
+#define TLS_VERIFY_CACHE_HASH_LEN 32
+
+typedef struct
+{
+  uint64_t ttl_ms; // 0 = TLS_VERIFY_CACHE_TTL_MS
+
+} TLS_Verify_Cache_Config;
+
+/** Enables the cache, NULL config = defaults. Calling it again updates the TTL. Only
+ * connections set up afterwards use it */
+int tls_verify_cache_init(const TLS_Verify_Cache_Config* _Config);
+
+bool tls_verify_cache_enabled();
+
+uint64_t tls_verify_cache_ttl_ms();
+
+/** true when the chain is cached and hasn't expired at _now (wall clock) */
+bool tls_verify_cache_lookup(const uint8_t _leaf[TLS_VERIFY_CACHE_HASH_LEN],
+                             const uint8_t _chain[TLS_VERIFY_CACHE_HASH_LEN], time_t _now);
+
+/** Records a verified chain valid until _expires (wall clock) */
+int tls_verify_cache_store(const uint8_t _leaf[TLS_VERIFY_CACHE_HASH_LEN],
+                           const uint8_t _chain[TLS_VERIFY_CACHE_HASH_LEN], time_t _expires);
+
+int tls_verify_cache_count();
+
+/** Forgets every chain and disables the cache */
+void tls_verify_cache_dispose();
+
+#endif
@@ -4,10 +4,22 @@
 #define TRANSPORT_H
 #include <maestromodules/tcp_client.h>
 #include <maestromodules/tls_client.h>
+#include <maestroutils/byte_buffer.h>
 #include <stddef.h>
 #include <stdint.h>
 #include <stdbool.h>
+#include <sys/types.h>
+#include <sys/uio.h>
 
+/* What the last EAGAIN/ERR_IN_PROGRESS was waiting for, so the caller can
+ * sleep on the right socket direction (TLS may need to write while reading) */
+typedef enum
+{
+  TRANSPORT_WANT_NONE = 0,
+  TRANSPORT_WANT_READ,
+  TRANSPORT_WANT_WRITE,
+
+} TransportWant;
 
 typedef struct
 {
@@ -24,6 +36,8 @@ typedef struct
   bool       use_blocking;
   bool       tls_initiated;
 
+  TransportWant want;
+
 } Transport;
 
 /*
@@ -56,7 +70,13 @@ int transport_finish_connect(Transport* _Transport);
 int transport_read(Transport* _Transport, uint8_t* buf, size_t len);
 
 /*
- * Non-blocking write.
+ * Reads up to _want bytes straight into the free tail of _Buffer, growing it when needed.
+ * Same return values as transport_read, ERR_NO_MEMORY if the buffer can't grow.
+ */
+int transport_read_buffer(Transport* _Transport, Byte_Buffer* _Buffer, size_t _want);
+
+/*
+ * Non-blocking write. TLS may keep the bytes back to fill a record, transport_flush sends them.
  * Returns:
  *   >0  bytes written
  *   0   nothing written
@@ -64,6 +84,32 @@ int transport_read(Transport* _Transport, uint8_t* buf, size_t len);
  */
 int transport_write(Transport* _Transport, const uint8_t* buf, size_t len);
 
+/*
+ * Non-blocking gathered write of _count buffers, in order.
+ * Plain TCP hands the list to the kernel in one call. TLS packs the buffers into full records
+ * and sends as many as the socket takes, the last partial record waits for transport_flush.
+ * Returns the same values as transport_write.
+ */
+ssize_t transport_writev(Transport* _Transport, const struct iovec* _iov, int _count);
+
+/*
+ * Sends what TLS is holding back from earlier writes, a no-op on plain TCP.
+ * Returns:
+ *   SUCCESS          nothing left buffered
+ *   ERR_IN_PROGRESS  the socket is full, wait for transport->want and call again
+ *   ERR_IO
+ */
+int transport_flush(Transport* _Transport);
+
+/*
+ * Sends up to _count bytes of _fd from *_offset without copying them, plain TCP only.
+ * Returns the same values as transport_write, ERR_INVALID_ARG on TLS.
+ */
+ssize_t transport_sendfile(Transport* _Transport, int _fd, off_t* _offset, size_t _count);
+
+/* Socket fd to watch for readiness, -1 when not connected */
+int transport_get_fd(Transport* _Transport);
+
 /*
  * Close and cleanup.
  */
@@ -0,0 +1,422 @@
+#define _POSIX_C_SOURCE 200809L
+#include <maestromodules/connection_pool.h>
+#include <maestroutils/time_utils.h>
+
+#include <errno.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <sys/socket.h>
+
+typedef struct Pool_Connection Pool_Connection;
+typedef struct Pool_Host       Pool_Host;
+
+/* Transport first, the Transport* handed out maps straight back to its entry.
+ * The key strings live here because Transport only keeps pointers to them */
+struct Pool_Connection
+{
+  Transport transport;
+
+  char scheme[6];
+  char host[128];
+  char port[6];
+  bool blocking;
+
+  bool             counted;    // Included in its host's open count
+  bool             reused;     // Handed out from the idle list by the last acquire
+  uint64_t         idle_since; // Monotonic ms
+  Pool_Connection* next;       // Idle list
+};
+
+struct Pool_Host
+{
+  char scheme[6];
+  char host[128];
+  char port[6];
+  bool blocking;
+
+  int              open; // Checked out + idle
+  int              idle_count;
+  Pool_Connection* idle; // Most recently used first
+  Pool_Host*       next;
+};
+
+static struct
+{
+  pthread_mutex_t lock;
+  Pool_Host*      hosts;
+
+  int      idle_total;
+  int      max_per_host;
+  int      max_idle;
+  uint64_t idle_timeout_ms;
+  bool     enabled;
+
+} Connection_Pool = {.lock = PTHREAD_MUTEX_INITIALIZER};
+
+static bool connection_pool_key_match(const char* _scheme, const char* _host, const char* _port,
+                                      bool _blocking, const char* _key_scheme,
+                                      const char* _key_host, const char* _key_port,
+                                      bool _key_blocking)
+{
+  return _blocking == _key_blocking && strcasecmp(_scheme, _key_scheme) == 0 &&
+         strcasecmp(_host, _key_host) == 0 && strcmp(_port, _key_port) == 0;
+}
+
+/* Caller holds the lock */
+static Pool_Host* connection_pool_find_host(const char* _scheme, const char* _host,
+                                            const char* _port, bool _blocking, bool _create)
+{
+  for (Pool_Host* Host = Connection_Pool.hosts; Host; Host = Host->next) {
+    if (connection_pool_key_match(_scheme, _host, _port, _blocking, Host->scheme, Host->host,
+                                  Host->port, Host->blocking)) {
+      return Host;
+    }
+  }
+
+  if (!_create) {
+    return NULL;
+  }
+
+  Pool_Host* Host = calloc(1, sizeof(Pool_Host));
+  if (!Host) {
+    perror("calloc");
+    return NULL;
+  }
+
+  snprintf(Host->scheme, sizeof(Host->scheme), "%s", _scheme);
+  snprintf(Host->host, sizeof(Host->host), "%s", _host);
+  snprintf(Host->port, sizeof(Host->port), "%s", _port);
+  Host->blocking = _blocking;
+
+  Host->next            = Connection_Pool.hosts;
+  Connection_Pool.hosts = Host;
+
+  return Host;
+}
+
+/* Caller holds the lock. Unlinks hosts with nothing open */
+static void connection_pool_drop_empty_hosts()
+{
+  Pool_Host** Link = &Connection_Pool.hosts;
+
+  while (*Link) {
+    Pool_Host* Host = *Link;
+    if (Host->open == 0 && Host->idle == NULL) {
+      *Link = Host->next;
+      free(Host);
+    } else {
+      Link = &Host->next;
+    }
+  }
+}
+
+/* Caller holds the lock. Moves expired idle connections to *_stale for closing after unlock */
+static void connection_pool_prune_locked(uint64_t _now, Pool_Connection** _stale)
+{
+  for (Pool_Host* Host = Connection_Pool.hosts; Host; Host = Host->next) {
+    Pool_Connection** Link = &Host->idle;
+
+    while (*Link) {
+      Pool_Connection* Conn = *Link;
+      if (_now - Conn->idle_since < Connection_Pool.idle_timeout_ms) {
+        Link = &Conn->next;
+        continue;
+      }
+
+      *Link      = Conn->next;
+      Conn->next = *_stale;
+      *_stale    = Conn;
+
+      Host->idle_count--;
+      Host->open--;
+      Connection_Pool.idle_total--;
+    }
+  }
+
+  connection_pool_drop_empty_hosts();
+}
+
+static void connection_pool_close(Pool_Connection* _Conn)
+{
+  transport_dispose(&_Conn->transport);
+  free(_Conn);
+}
+
+/* Gives back the slot reserved by an acquire that failed to open a connection */
+static void connection_pool_unreserve(const char* _scheme, const char* _host, const char* _port,
+                                      bool _blocking)
+{
+  pthread_mutex_lock(&Connection_Pool.lock);
+
+  Pool_Host* Host = connection_pool_find_host(_scheme, _host, _port, _blocking, false);
+  if (Host) {
+    Host->open--;
+    connection_pool_drop_empty_hosts();
+  }
+
+  pthread_mutex_unlock(&Connection_Pool.lock);
+}
+
+static void connection_pool_close_list(Pool_Connection* _List)
+{
+  while (_List) {
+    Pool_Connection* Next = _List->next;
+    connection_pool_close(_List);
+    _List = Next;
+  }
+}
+
+/* An idle keep-alive socket must have nothing to read. EOF means the server closed it,
+ * pending bytes are a TLS close_notify or garbage, either way it can't carry a request */
+static bool connection_pool_is_healthy(Pool_Connection* _Conn)
+{
+  int fd = transport_get_fd(&_Conn->transport);
+  if (fd < 0) {
+    return false;
+  }
+
+  char    probe;
+  ssize_t res = recv(fd, &probe, 1, MSG_PEEK | MSG_DONTWAIT);
+  if (res < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+    return true;
+  }
+
+  return false;
+}
+
+int connection_pool_init(const Connection_Pool_Config* _Config)
+{
+  Connection_Pool_Config Config = {0};
+  if (_Config) {
+    Config = *_Config;
+  }
+
+  pthread_mutex_lock(&Connection_Pool.lock);
+  Connection_Pool.max_per_host =
+      Config.max_per_host > 0 ? Config.max_per_host : CONNECTION_POOL_MAX_PER_HOST;
+  Connection_Pool.max_idle = Config.max_idle > 0 ? Config.max_idle : CONNECTION_POOL_MAX_IDLE;
+  Connection_Pool.idle_timeout_ms =
+      Config.idle_timeout_ms > 0 ? Config.idle_timeout_ms : CONNECTION_POOL_IDLE_TIMEOUT_MS;
+  Connection_Pool.enabled = true;
+  pthread_mutex_unlock(&Connection_Pool.lock);
+
+  return SUCCESS;
+}
+
+bool connection_pool_enabled()
+{
+  pthread_mutex_lock(&Connection_Pool.lock);
+  bool enabled = Connection_Pool.enabled;
+  pthread_mutex_unlock(&Connection_Pool.lock);
+
+  return enabled;
+}
+
+int connection_pool_acquire(const char* _scheme, const char* _host, const char* _port,
+                            bool _blocking, int _timeout_ms, Transport** _out)
+{
+  if (!_scheme || !_host || !_port || !_out) {
+    return ERR_INVALID_ARG;
+  }
+
+  *_out = NULL;
+
+  Pool_Connection Key = {0};
+  if (strlen(_scheme) >= sizeof(Key.scheme) || strlen(_host) >= sizeof(Key.host) ||
+      strlen(_port) >= sizeof(Key.port)) {
+    return ERR_INVALID_ARG;
+  }
+
+  Pool_Connection* Stale   = NULL;
+  Pool_Connection* Reused  = NULL;
+  bool             counted = false;
+
+  pthread_mutex_lock(&Connection_Pool.lock);
+
+  if (Connection_Pool.enabled) {
+    connection_pool_prune_locked(SystemMonotonicMS(), &Stale);
+
+    Pool_Host* Host = connection_pool_find_host(_scheme, _host, _port, _blocking, true);
+    if (!Host) {
+      pthread_mutex_unlock(&Connection_Pool.lock);
+      connection_pool_close_list(Stale);
+      return ERR_NO_MEMORY;
+    }
+
+    while (Host->idle && !Reused) {
+      Pool_Connection* Conn = Host->idle;
+      Host->idle            = Conn->next;
+      Conn->next            = NULL;
+      Host->idle_count--;
+      Connection_Pool.idle_total--;
+
+      if (connection_pool_is_healthy(Conn)) {
+        Reused = Conn;
+      } else {
+        Conn->next = Stale;
+        Stale      = Conn;
+        Host->open--;
+      }
+    }
+
+    if (!Reused) {
+      if (Host->open >= Connection_Pool.max_per_host) {
+        pthread_mutex_unlock(&Connection_Pool.lock);
+        connection_pool_close_list(Stale);
+        return ERR_BUSY;
+      }
+
+      // Reserve the slot now so concurrent acquires respect the cap
+      Host->open++;
+      counted = true;
+    }
+  }
+
+  pthread_mutex_unlock(&Connection_Pool.lock);
+  connection_pool_close_list(Stale);
+
+  if (Reused) {
+    Reused->reused               = true;
+    Reused->transport.timeout_ms = _timeout_ms;
+    Reused->transport.want       = TRANSPORT_WANT_NONE;
+    *_out                        = &Reused->transport;
+    return SUCCESS;
+  }
+
+  Pool_Connection* Conn = calloc(1, sizeof(Pool_Connection));
+  if (!Conn) {
+    perror("calloc");
+    if (counted) {
+      connection_pool_unreserve(_scheme, _host, _port, _blocking);
+    }
+    return ERR_NO_MEMORY;
+  }
+
+  snprintf(Conn->scheme, sizeof(Conn->scheme), "%s", _scheme);
+  snprintf(Conn->host, sizeof(Conn->host), "%s", _host);
+  snprintf(Conn->port, sizeof(Conn->port), "%s", _port);
+  Conn->blocking = _blocking;
+  Conn->counted  = counted;
+
+  int res = transport_init(&Conn->transport, Conn->host, Conn->port, Conn->scheme, _timeout_ms,
+                           _blocking);
+  if (res != SUCCESS && res != ERR_IN_PROGRESS) {
+    // Argument and scheme errors return before the socket exists, nothing to close
+    if (res != ERR_INVALID_ARG && res != ERR_BAD_FORMAT) {
+      transport_dispose(&Conn->transport);
+    }
+    if (counted) {
+      connection_pool_unreserve(_scheme, _host, _port, _blocking);
+    }
+    free(Conn);
+    return res;
+  }
+
+  *_out = &Conn->transport;
+  return res;
+}
+
+bool connection_pool_is_reused(const Transport* _Transport)
+{
+  return _Transport && ((const Pool_Connection*)_Transport)->reused;
+}
+
+void connection_pool_release(Transport* _Transport, bool _reusable)
+{
+  Pool_Connection* Conn  = (Pool_Connection*)_Transport;
+  Pool_Connection* Stale = NULL;
+  bool             kept  = false;
+
+  pthread_mutex_lock(&Connection_Pool.lock);
+
+  if (Conn && Conn->counted) {
+    Pool_Host* Host = connection_pool_find_host(Conn->scheme, Conn->host, Conn->port,
+                                                Conn->blocking, false);
+
+    if (Host && _reusable && Connection_Pool.enabled &&
+        Connection_Pool.idle_total < Connection_Pool.max_idle) {
+      Conn->idle_since = SystemMonotonicMS();
+      Conn->next       = Host->idle;
+      Host->idle       = Conn;
+      Host->idle_count++;
+      Connection_Pool.idle_total++;
+      kept = true;
+    } else if (Host) {
+      Host->open--;
+      // Also after dispose, when prune below doesn't run
+      if (Host->open == 0) {
+        connection_pool_drop_empty_hosts();
+      }
+    }
+  }
+
+  if (Connection_Pool.enabled) {
+    connection_pool_prune_locked(SystemMonotonicMS(), &Stale);
+  }
+
+  pthread_mutex_unlock(&Connection_Pool.lock);
+
+  if (Conn && !kept) {
+    connection_pool_close(Conn);
+  }
+  connection_pool_close_list(Stale);
+}
+
+void connection_pool_prune()
+{
+  Pool_Connection* Stale = NULL;
+
+  pthread_mutex_lock(&Connection_Pool.lock);
+  if (Connection_Pool.enabled) {
+    connection_pool_prune_locked(SystemMonotonicMS(), &Stale);
+  }
+  pthread_mutex_unlock(&Connection_Pool.lock);
+
+  connection_pool_close_list(Stale);
+}
+
+int connection_pool_idle_count(const char* _scheme, const char* _host, const char* _port,
+                               bool _blocking)
+{
+  if (!_scheme || !_host || !_port) {
+    return 0;
+  }
+
+  pthread_mutex_lock(&Connection_Pool.lock);
+  Pool_Host* Host  = connection_pool_find_host(_scheme, _host, _port, _blocking, false);
+  int        count = Host ? Host->idle_count : 0;
+  pthread_mutex_unlock(&Connection_Pool.lock);
+
+  return count;
+}
+
+void connection_pool_dispose()
+{
+  Pool_Connection* Stale = NULL;
+
+  pthread_mutex_lock(&Connection_Pool.lock);
+
+  Connection_Pool.enabled = false;
+
+  for (Pool_Host* Host = Connection_Pool.hosts; Host; Host = Host->next) {
+    while (Host->idle) {
+      Pool_Connection* Conn = Host->idle;
+      Host->idle            = Conn->next;
+      Conn->next            = Stale;
+      Stale                 = Conn;
+      Host->open--;
+    }
+    Host->idle_count = 0;
+  }
+  Connection_Pool.idle_total = 0;
+
+  // Hosts with connections still checked out stay until those are released
+  connection_pool_drop_empty_hosts();
+
+  pthread_mutex_unlock(&Connection_Pool.lock);
+
+  connection_pool_close_list(Stale);
+}
@@ -0,0 +1,237 @@
+#include <maestromodules/http_chunked.h>
+
+#include <string.h>
+
+static int http_chunked_hex(uint8_t _ch)
+{
+  if (_ch >= '0' && _ch <= '9') {
+    return _ch - '0';
+  }
+  if (_ch >= 'a' && _ch <= 'f') {
+    return _ch - 'a' + 10;
+  }
+  if (_ch >= 'A' && _ch <= 'F') {
+    return _ch - 'A' + 10;
+  }
+  return -1;
+}
+
+void http_chunked_init(HTTP_Chunked* _Decoder)
+{
+  if (!_Decoder) {
+    return;
+  }
+
+  memset(_Decoder, 0, sizeof(HTTP_Chunked));
+  _Decoder->state = HTTP_CHUNKED_SIZE;
+}
+
+/* Size line done, set up for the data or the trailers */
+static void http_chunked_begin_chunk(HTTP_Chunked* _Decoder)
+{
+  _Decoder->line_len = 0;
+  _Decoder->state    = _Decoder->chunk_remaining ? HTTP_CHUNKED_DATA : HTTP_CHUNKED_TRAILER;
+}
+
+int http_chunked_feed(HTTP_Chunked* _Decoder, const uint8_t* _data, size_t _len, size_t* _consumed,
+                      http_chunked_on_data _on_data, void* _context)
+{
+  if (_consumed) {
+    *_consumed = 0;
+  }
+
+  if (!_Decoder || (!_data && _len > 0)) {
+    return ERR_INVALID_ARG;
+  }
+
+  if (_Decoder->state == HTTP_CHUNKED_ERROR) {
+    return ERR_BAD_FORMAT;
+  }
+
+  size_t pos = 0;
+  int    res = SUCCESS;
+
+  while (pos < _len && _Decoder->state != HTTP_CHUNKED_DONE) {
+    uint8_t ch = _data[pos];
+
+    switch (_Decoder->state) {
+
+    case HTTP_CHUNKED_SIZE: {
+      int digit = http_chunked_hex(ch);
+      if (digit >= 0) {
+        // 16 hex digits fill a uint64_t, leading zeros included
+        if (_Decoder->chunk_remaining >> 60) {
+          res = ERR_BAD_FORMAT;
+          break;
+        }
+        _Decoder->chunk_remaining = (_Decoder->chunk_remaining << 4) | (uint64_t)digit;
+        _Decoder->size_digits++;
+      } else if (_Decoder->size_digits == 0) {
+        res = ERR_BAD_FORMAT;
+        break;
+      } else if (ch == ';' || ch == ' ' || ch == '\t') {
+        _Decoder->state = HTTP_CHUNKED_EXTENSION;
+      } else if (ch == '\r') {
+        _Decoder->state = HTTP_CHUNKED_SIZE_LF;
+      } else {
+        res = ERR_BAD_FORMAT;
+        break;
+      }
+
+      if (++_Decoder->line_len > HTTP_CHUNKED_MAX_LINE) {
+        res = ERR_BAD_FORMAT;
+        break;
+      }
+      pos++;
+      break;
+    }
+
+    case HTTP_CHUNKED_EXTENSION: {
+      // Skip to the end of the line in one go
+      const uint8_t* cr   = memchr(_data + pos, '\r', _len - pos);
+      size_t         span = cr ? (size_t)(cr - (_data + pos)) : _len - pos;
+
+      // Stop on the exact offending byte, a bare \n or the one making the line too long
+      const uint8_t* lf   = memchr(_data + pos, '\n', span);
+      size_t         bad  = lf ? (size_t)(lf - (_data + pos)) : SIZE_MAX;
+      size_t         room = HTTP_CHUNKED_MAX_LINE - _Decoder->line_len;
+      if (span + (cr ? 1 : 0) > room && room < bad) {
+        bad = room;
+      }
+      if (bad != SIZE_MAX) {
+        pos += bad;
+        res = ERR_BAD_FORMAT;
+        break;
+      }
+
+      _Decoder->line_len += span;
+      pos += span;
+      if (cr) {
+        _Decoder->line_len++;
+        _Decoder->state = HTTP_CHUNKED_SIZE_LF;
+        pos++;
+      }
+      break;
+    }
+
+    case HTTP_CHUNKED_SIZE_LF: {
+      if (ch != '\n') {
+        res = ERR_BAD_FORMAT;
+        break;
+      }
+      pos++;
+      http_chunked_begin_chunk(_Decoder);
+      break;
+    }
+
+    case HTTP_CHUNKED_DATA: {
+      size_t take = _len - pos;
+      if ((uint64_t)take > _Decoder->chunk_remaining) {
+        take = (size_t)_Decoder->chunk_remaining;
+      }
+
+      if (_on_data) {
+        int cb = _on_data(_context, _data + pos, take);
+        if (cb < 0) {
+          res = cb;
+          break;
+        }
+      }
+
+      pos += take;
+      _Decoder->chunk_remaining -= take;
+      _Decoder->body_len += take;
+
+      if (_Decoder->chunk_remaining == 0) {
+        _Decoder->state = HTTP_CHUNKED_DATA_CR;
+      }
+      break;
+    }
+
+    case HTTP_CHUNKED_DATA_CR: {
+      if (ch != '\r') {
+        res = ERR_BAD_FORMAT;
+        break;
+      }
+      pos++;
+      _Decoder->state = HTTP_CHUNKED_DATA_LF;
+      break;
+    }
+
+    case HTTP_CHUNKED_DATA_LF: {
+      if (ch != '\n') {
+        res = ERR_BAD_FORMAT;
+        break;
+      }
+      pos++;
+      _Decoder->size_digits = 0;
+      _Decoder->line_len    = 0;
+      _Decoder->state       = HTTP_CHUNKED_SIZE;
+      break;
+    }
+
+    case HTTP_CHUNKED_TRAILER: {
+      pos++;
+      if (ch == '\r') {
+        _Decoder->state = HTTP_CHUNKED_END_LF;
+        break;
+      }
+      if (ch == '\n' || ++_Decoder->trailer_len > HTTP_CHUNKED_MAX_TRAILERS) {
+        res = ERR_BAD_FORMAT;
+        break;
+      }
+      _Decoder->state = HTTP_CHUNKED_TRAILER_LINE;
+      break;
+    }
+
+    case HTTP_CHUNKED_TRAILER_LINE: {
+      pos++;
+      if (ch == '\r') {
+        _Decoder->state = HTTP_CHUNKED_TRAILER_LF;
+        break;
+      }
+      if (ch == '\n' || ++_Decoder->trailer_len > HTTP_CHUNKED_MAX_TRAILERS) {
+        res = ERR_BAD_FORMAT;
+      }
+      break;
+    }
+
+    case HTTP_CHUNKED_TRAILER_LF: {
+      if (ch != '\n') {
+        res = ERR_BAD_FORMAT;
+        break;
+      }
+      pos++;
+      _Decoder->state = HTTP_CHUNKED_TRAILER;
+      break;
+    }
+
+    case HTTP_CHUNKED_END_LF: {
+      if (ch != '\n') {
+        res = ERR_BAD_FORMAT;
+        break;
+      }
+      pos++;
+      _Decoder->state = HTTP_CHUNKED_DONE;
+      break;
+    }
+
+    default:
+      res = ERR_BAD_FORMAT;
+      break;
+    }
+
+    if (res != SUCCESS) {
+      if (res == ERR_BAD_FORMAT) {
+        _Decoder->state = HTTP_CHUNKED_ERROR;
+      }
+      break;
+    }
+  }
+
+  if (_consumed) {
+    *_consumed = pos;
+  }
+
+  return res;
+}
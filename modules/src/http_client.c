@@ -1,7 +1,13 @@
+#define _GNU_SOURCE // splice() and F_SETPIPE_SZ for downloads
 #include "error.h"
+#include <fcntl.h>
+#include <maestromodules/http_chunked.h>
 #include <maestromodules/http_client.h>
 #include <maestroutils/string_utils.h>
 #include <stddef.h>
+#include <strings.h>
+#include <sys/stat.h>
+#include <unistd.h>
 
 void            http_client_taskwork(void* _context, uint64_t _montime);
 HTTPClientState http_client_worktask_connecting(HTTP_Client* _Client);
@@ -14,21 +20,131 @@ HTTPClientState http_client_worktask_returning(HTTP_Client* _Client);
 HTTPClientState http_client_worktask_decipher_chonkiness(HTTP_Client* _Client);
 HTTPClientState http_client_worktask_read_body_chunked(HTTP_Client* _Client);
 HTTPClientState http_client_worktask_waiting_connect(HTTP_Client* _Client);
+static HTTPClientState http_client_parse_firstline(HTTP_Client* _Client);
 
 /*******************Blocking funcs*****************************/
-static int http_blocking_work(const char* _url, HTTPMethod _method, const http_data* _in_body,
-                              http_data* _out_body, int _timeout_ms);
+static int http_blocking_work(const char* _url, HTTPMethod _method,
+                              const HTTP_Request_Body* _in_body, http_data* _out_body,
+                              http_client_on_body_chunk _on_body_chunk, int _body_fd,
+                              const HTTP_Download_Options* _Options, void* _context,
+                              int _timeout_ms);
 void       http_client_destroy(HTTP_Client* c);
 
 /*************************************************************/
 
+/* Registers the (non-blocking) transport fd so the task can sleep on readiness */
+static void http_client_watch_io(HTTP_Client* _Client)
+{
+  if (_Client->blocking_mode || !_Client->task || _Client->io_watched) {
+    return;
+  }
+
+  int fd = transport_get_fd(_Client->transport);
+  if (fd >= 0 && scheduler_task_watch_fd(_Client->task, fd) == SUCCESS) {
+    _Client->io_watched = true;
+  }
+}
+
+/* Hands the connection back to the pool, kept alive only when _reusable. The reactor must
+ * let go of the fd first, the next user may run on another scheduler */
+static void http_client_release_transport(HTTP_Client* _Client, bool _reusable)
+{
+  if (!_Client->transport) {
+    return;
+  }
+
+  if (_Client->io_watched) {
+    scheduler_task_unwatch_fd(_Client->task, transport_get_fd(_Client->transport));
+    _Client->io_watched = false;
+  }
+
+  connection_pool_release(_Client->transport, _reusable);
+  _Client->transport = NULL;
+  _Client->read_max  = 0;
+}
+
+/* A pooled connection the server closed while it sat idle shows up as EOF or a reset before
+ * any response byte. Drop it and start over on another connection, unless the request
+ * was a POST the server might have acted on */
+static bool http_client_retry_stale(HTTP_Client* _Client)
+{
+  if (!_Client->transport_reused || _Client->method == HTTP_POST || _Client->send_body.source ||
+      byte_buffer_readable(&_Client->recv_buf) > 0 || _Client->pipeline_index > 0) {
+    return false;
+  }
+
+  http_client_release_transport(_Client, false);
+
+  free(_Client->request_buffer);
+  _Client->request_buffer   = NULL;
+  _Client->bytes_sent       = 0;
+  _Client->transport_reused = false;
+
+  return true;
+}
+
+/* HTTP/1.1 keeps the connection open unless the server says Connection: close */
+static bool http_client_response_keep_alive(HTTP_Client* _Client)
+{
+  if (!_Client->resp->version || strcmp(_Client->resp->version, "HTTP/1.1") != 0) {
+    return false;
+  }
+
+  const char* connection = http_header_table_get(&_Client->headers, HTTP_HEADER_CONNECTION);
+  if (!connection) {
+    return true;
+  }
+
+  for (const char* p = connection; p && *p; p++) {
+    if (strncasecmp(p, "close", 5) == 0) {
+      return false;
+    }
+  }
+
+  return true;
+}
+
+/* Socket not ready, park the task on the reactor in whatever direction the transport is
+ * blocked on. The fallback deadline only matters if a notification is lost. Without a
+ * reactor we come back after a short poll interval instead of spinning */
+static HTTPClientState http_client_wait_io(HTTP_Client* _Client, HTTPClientState _state)
+{
+  uint64_t      now  = SystemMonotonicMS();
+  TransportWant want = _Client->transport ? _Client->transport->want : TRANSPORT_WANT_NONE;
+
+  if (_Client->io_watched && want != TRANSPORT_WANT_NONE) {
+    uint32_t interest = want == TRANSPORT_WANT_WRITE ? REACTOR_WRITABLE : REACTOR_READABLE;
+    uint64_t timeout  = now + HTTP_CLIENT_IO_FALLBACK_MS;
+
+    if (scheduler_task_wait_fd(_Client->task, transport_get_fd(_Client->transport), interest,
+                               timeout) == SUCCESS) {
+      _Client->next_retry_at = timeout;
+      return _state;
+    }
+  }
+
+  _Client->next_retry_at = now + MIN_LOOP_MS;
+  return _state;
+}
+
 int http_client_initiate(HTTP_Client* _Client, const char* _URL, HTTPMethod _method,
                          http_client_on_success _on_success, void* _context, char** _response_out)
 {
-  (void)_method; // To be used with mbedtls
-  if (!_Client) {
-    return ERR_INVALID_ARG;
+  // Spread clients over the shards when they run, otherwise the caller drives Global_Scheduler
+  Scheduler* Sched = scheduler_shards_pick();
+  if (!Sched) {
+    Sched = &Global_Scheduler;
   }
+
+  return http_client_initiate_on(_Client, Sched, _URL, _method, _on_success, _context,
+                                 _response_out);
+}
+
+/* Resets the client for a new request on _URL, the task is created by the caller */
+static int http_client_setup(HTTP_Client* _Client, const char* _URL,
+                             http_client_on_success _on_success, void* _context,
+                             char** _response_out)
+{
   HTTP_Request* req = calloc(1, sizeof(HTTP_Request));
   if (!req) {
     return ERR_NO_MEMORY;
@@ -36,21 +152,14 @@ int http_client_initiate(HTTP_Client* _Client, const char* _URL, HTTPMethod _met
 
   HTTP_Response* resp = calloc(1, sizeof(HTTP_Response));
   if (!resp) {
+    free(req);
     return ERR_NO_MEMORY;
   }
 
-  _Client->task = scheduler_create_task(_Client, http_client_taskwork);
-  if (!_Client->task) {
-    free(resp);
-    free(req);
-    return ERR_BUSY;
-  }
   // printf("URL in init: %s\n", _URL);
 
   char* url_copy = strdup(_URL);
   if (!url_copy) {
-    scheduler_destroy_task(_Client->task);
-    _Client->task = NULL;
     free(req);
     free(resp);
     return ERR_NO_MEMORY;
@@ -61,6 +170,7 @@ int http_client_initiate(HTTP_Client* _Client, const char* _URL, HTTPMethod _met
   _Client->req            = req;
   _Client->URL            = url_copy;
   _Client->state          = HTTP_CLIENT_CONNECTING;
+  _Client->request_buffer = NULL;
   _Client->request_length = 0;
   _Client->bytes_sent     = 0;
   _Client->retries        = 0;
@@ -73,19 +183,333 @@ int http_client_initiate(HTTP_Client* _Client, const char* _URL, HTTPMethod _met
 
   // Check url for http/https
   _Client->chunked          = -1;
-  _Client->decoded_body     = NULL;
-  _Client->decoded_body_len = 0;
-  _Client->resp_buf.addr    = NULL;
-  _Client->resp_buf.size    = 0;
-  _Client->recv_buf         = &_Client->resp_buf;
+  Byte_Buffer empty_buffer  = {0};
+  _Client->recv_buf         = empty_buffer;
+  _Client->decoded_body     = empty_buffer;
   _Client->blocking_out     = NULL;
   _Client->blocking_mode    = 0;
+  _Client->io_watched       = false;
   _Client->content_length   = 0;
-  _Client->chunk_remaining  = 0;
   _Client->chunked          = -1;
+  _Client->task             = NULL;
+  _Client->transport        = NULL;
+  _Client->transport_reused = false;
+  _Client->keep_alive       = false;
+
+  HTTP_Header_Table no_headers = {0};
+  _Client->headers             = no_headers;
+
+  _Client->pipeline_paths       = NULL;
+  _Client->pipeline_count       = 0;
+  _Client->pipeline_index       = 0;
+  _Client->on_pipeline_response = NULL;
+
+  _Client->on_body_chunk = NULL;
+  _Client->on_done       = NULL;
+  _Client->body_fd       = -1;
+  _Client->body_received = 0;
+  _Client->body_error    = 0;
+  _Client->body_offset   = 0;
+  _Client->on_progress   = NULL;
+
+  _Client->splice_pipe[0] = -1;
+  _Client->splice_pipe[1] = -1;
+  _Client->splice_open    = false;
+  _Client->splice_off     = false;
+
+  _Client->read_size  = HTTP_CLIENT_READ_CHUNK;
+  _Client->read_max   = 0;
+  _Client->tick_bytes = 0;
+
+  HTTP_Request_Body no_body = {.fd = -1};
+  _Client->send_body        = no_body;
+  _Client->send_iov_pos     = 0;
+  _Client->send_iov_count   = 0;
+  _Client->send_stage       = empty_buffer;
+
+  return SUCCESS;
+}
+
+/* Takes over the body descriptor and works out the length when it was left at -1 */
+static int http_client_set_body(HTTP_Client* _Client, const HTTP_Request_Body* _Body)
+{
+  if (!_Body) {
+    return SUCCESS;
+  }
+
+  if (_Body->slice_count < 0 || (_Body->slice_count > 0 && !_Body->slices) ||
+      (_Body->fd >= 0 && _Body->source)) {
+    return ERR_INVALID_ARG;
+  }
+
+  HTTP_Request_Body body       = *_Body;
+  uint64_t          slices_len = 0;
+  for (int i = 0; i < body.slice_count; i++) {
+    if (!body.slices[i].iov_base && body.slices[i].iov_len > 0) {
+      return ERR_INVALID_ARG;
+    }
+    slices_len += body.slices[i].iov_len;
+  }
+
+  if (body.fd >= 0) {
+    off_t start = lseek(body.fd, 0, SEEK_CUR);
+    if (start < 0) {
+      perror("lseek");
+      return ERR_IO;
+    }
+    _Client->send_file_start = start;
+
+    if (body.length < 0) {
+      struct stat st;
+      if (fstat(body.fd, &st) != 0) {
+        perror("fstat");
+        return ERR_IO;
+      }
+      body.length = (int64_t)slices_len + (st.st_size > start ? st.st_size - start : 0);
+    }
+  } else if (!body.source && body.length < 0) {
+    body.length = (int64_t)slices_len;
+  }
+
+  // A known length has to cover the slices, and is all of them without a file or source
+  if (body.length >= 0 && ((uint64_t)body.length < slices_len ||
+                           (body.fd < 0 && !body.source && (uint64_t)body.length != slices_len))) {
+    return ERR_INVALID_ARG;
+  }
+
+  _Client->send_body = body;
+  return SUCCESS;
+}
+
+/* The task is created parked and only armed once _Client->task is set, a shard thread may
+ * run it (and dispose the client on failure) the moment it is due */
+static int http_client_start(HTTP_Client* _Client, Scheduler* _Sched)
+{
+  Scheduler_Task* Task = scheduler_create_task_parked_on(_Sched, _Client, http_client_taskwork);
+  if (!Task) {
+    http_client_dispose(_Client);
+    return ERR_BUSY;
+  }
+  _Client->task = Task;
+
+  scheduler_task_set_due(Task, 0);
+
+  return SUCCESS;
+}
+
+int http_client_initiate_on(HTTP_Client* _Client, Scheduler* _Sched, const char* _URL,
+                            HTTPMethod _method, http_client_on_success _on_success, void* _context,
+                            char** _response_out)
+{
+  (void)_method; // To be used with mbedtls
+  if (!_Client || !_Sched || !_URL) {
+    return ERR_INVALID_ARG;
+  }
+
+  int res = http_client_setup(_Client, _URL, _on_success, _context, _response_out);
+  if (res != SUCCESS) {
+    return res;
+  }
+
+  return http_client_start(_Client, _Sched);
+}
+
+int http_client_send(HTTP_Client* _Client, const char* _URL, HTTPMethod _method,
+                     const HTTP_Request_Body* _Body, http_client_on_success _on_success,
+                     void* _context, char** _response_out)
+{
+  Scheduler* Sched = scheduler_shards_pick();
+  if (!Sched) {
+    Sched = &Global_Scheduler;
+  }
+
+  return http_client_send_on(_Client, Sched, _URL, _method, _Body, _on_success, _context,
+                             _response_out);
+}
+
+int http_client_send_on(HTTP_Client* _Client, Scheduler* _Sched, const char* _URL,
+                        HTTPMethod _method, const HTTP_Request_Body* _Body,
+                        http_client_on_success _on_success, void* _context, char** _response_out)
+{
+  if (!_Client || !_Sched || !_URL || !_Body || !_on_success) {
+    return ERR_INVALID_ARG;
+  }
+
+  int res = http_client_setup(_Client, _URL, _on_success, _context, _response_out);
+  if (res != SUCCESS) {
+    return res;
+  }
+
+  _Client->method = _method;
+
+  res = http_client_set_body(_Client, _Body);
+  if (res != SUCCESS) {
+    http_client_dispose(_Client);
+    return res;
+  }
+
+  return http_client_start(_Client, _Sched);
+}
+
+int http_client_pipeline(HTTP_Client* _Client, const char** _URLs, int _count,
+                         http_client_on_pipeline_response _on_response, void* _context)
+{
+  Scheduler* Sched = scheduler_shards_pick();
+  if (!Sched) {
+    Sched = &Global_Scheduler;
+  }
+
+  return http_client_pipeline_on(_Client, Sched, _URLs, _count, _on_response, _context);
+}
+
+int http_client_pipeline_on(HTTP_Client* _Client, Scheduler* _Sched, const char** _URLs,
+                            int _count, http_client_on_pipeline_response _on_response,
+                            void* _context)
+{
+  if (!_Client || !_Sched || !_URLs || !_on_response || _count < 1 ||
+      _count > HTTP_CLIENT_PIPELINE_MAX) {
+    return ERR_INVALID_ARG;
+  }
+
+  // Every request has to go to the same connection
+  URL_Parts first = {0};
+  URL_Parts parts;
+  if (!_URLs[0] || http_parser_url(_URLs[0], (void*)&first) != SUCCESS) {
+    return ERR_BAD_FORMAT;
+  }
+
+  char** paths = calloc((size_t)_count, sizeof(char*));
+  if (!paths) {
+    return ERR_NO_MEMORY;
+  }
+
+  int res = SUCCESS;
+  for (int i = 0; i < _count && res == SUCCESS; i++) {
+    memset(&parts, 0, sizeof(parts));
+    if (!_URLs[i] || http_parser_url(_URLs[i], (void*)&parts) != SUCCESS ||
+        strcasecmp(parts.scheme, first.scheme) != 0 || strcasecmp(parts.host, first.host) != 0 ||
+        strcmp(parts.port, first.port) != 0) {
+      res = ERR_BAD_FORMAT;
+      break;
+    }
+
+    paths[i] = strdup(parts.path[0] ? parts.path : "/");
+    if (!paths[i]) {
+      res = ERR_NO_MEMORY;
+    }
+  }
+
+  if (res == SUCCESS) {
+    res = http_client_setup(_Client, _URLs[0], NULL, _context, NULL);
+  }
+
+  if (res != SUCCESS) {
+    for (int i = 0; i < _count; i++) {
+      free(paths[i]);
+    }
+    free(paths);
+    return res;
+  }
+
+  _Client->pipeline_paths       = paths;
+  _Client->pipeline_count       = _count;
+  _Client->on_pipeline_response = _on_response;
+
+  return http_client_start(_Client, _Sched);
+}
+
+int http_client_stream(HTTP_Client* _Client, const char* _URL,
+                       http_client_on_body_chunk _on_body_chunk, http_client_on_done _on_done,
+                       void* _context)
+{
+  Scheduler* Sched = scheduler_shards_pick();
+  if (!Sched) {
+    Sched = &Global_Scheduler;
+  }
+
+  return http_client_stream_on(_Client, Sched, _URL, _on_body_chunk, _on_done, _context);
+}
+
+/* Takes over the download options. Resuming keeps what the fd holds and appends after it */
+static int http_client_download_prepare(HTTP_Client* _Client, const HTTP_Download_Options* _Options)
+{
+  if (!_Options) {
+    return SUCCESS;
+  }
+
+  _Client->on_progress = _Options->on_progress;
+
+  if (_Options->resume) {
+    off_t end = lseek(_Client->body_fd, 0, SEEK_END);
+    if (end < 0) {
+      perror("lseek");
+      return ERR_IO;
+    }
+    _Client->body_offset = (uint64_t)end;
+  }
 
+  return SUCCESS;
+}
+
+/* Shared by the streaming entry points, at least one of _on_body_chunk and _fd is set */
+static int http_client_stream_start(HTTP_Client* _Client, Scheduler* _Sched, const char* _URL,
+                                    HTTPMethod _method, http_client_on_body_chunk _on_body_chunk,
+                                    int _fd, const HTTP_Download_Options* _Options,
+                                    http_client_on_done _on_done, void* _context)
+{
+  int res = http_client_setup(_Client, _URL, NULL, _context, NULL);
+  if (res != SUCCESS) {
+    return res;
+  }
 
-  return 0;
+  _Client->method        = _method;
+  _Client->on_body_chunk = _on_body_chunk;
+  _Client->body_fd       = _fd;
+  _Client->on_done       = _on_done;
+
+  res = http_client_download_prepare(_Client, _Options);
+  if (res != SUCCESS) {
+    http_client_dispose(_Client);
+    return res;
+  }
+
+  return http_client_start(_Client, _Sched);
+}
+
+int http_client_stream_on(HTTP_Client* _Client, Scheduler* _Sched, const char* _URL,
+                          http_client_on_body_chunk _on_body_chunk, http_client_on_done _on_done,
+                          void* _context)
+{
+  if (!_Client || !_Sched || !_URL || !_on_body_chunk) {
+    return ERR_INVALID_ARG;
+  }
+
+  return http_client_stream_start(_Client, _Sched, _URL, HTTP_GET, _on_body_chunk, -1, NULL,
+                                  _on_done, _context);
+}
+
+int http_client_download(HTTP_Client* _Client, const char* _URL, int _fd,
+                         const HTTP_Download_Options* _Options, http_client_on_done _on_done,
+                         void* _context)
+{
+  Scheduler* Sched = scheduler_shards_pick();
+  if (!Sched) {
+    Sched = &Global_Scheduler;
+  }
+
+  return http_client_download_on(_Client, Sched, _URL, _fd, _Options, _on_done, _context);
+}
+
+int http_client_download_on(HTTP_Client* _Client, Scheduler* _Sched, const char* _URL, int _fd,
+                            const HTTP_Download_Options* _Options, http_client_on_done _on_done,
+                            void* _context)
+{
+  if (!_Client || !_Sched || !_URL || _fd < 0) {
+    return ERR_INVALID_ARG;
+  }
+
+  return http_client_stream_start(_Client, _Sched, _URL, HTTP_DOWNLOAD, NULL, _fd, _Options,
+                                  _on_done, _context);
 }
 
 int http_blocking_get(const char* _url, http_data* _out, int _timeout_ms)
@@ -97,7 +521,7 @@ int http_blocking_get(const char* _url, http_data* _out, int _timeout_ms)
   _out->addr = NULL;
   _out->size = 0;
 
-  return http_blocking_work(_url, HTTP_GET, NULL, _out, _timeout_ms);
+  return http_blocking_work(_url, HTTP_GET, NULL, _out, NULL, -1, NULL, NULL, _timeout_ms);
 }
 
 int http_blocking_post(const char* _url, const http_data* _in, http_data* _out, int _timeout_ms)
@@ -111,17 +535,66 @@ int http_blocking_post(const char* _url, const http_data* _in, http_data* _out,
     _out->size = 0;
   }
 
-  return http_blocking_work(_url, HTTP_POST, _in, _out, _timeout_ms);
+  // Sent straight from _in, the body is not copied
+  struct iovec      slice = {.iov_base = _in->addr, .iov_len = (size_t)_in->size};
+  HTTP_Request_Body body  = {.slices = &slice, .slice_count = _in->addr ? 1 : 0, .fd = -1,
+                             .length = _in->addr ? _in->size : 0};
+
+  return http_blocking_work(_url, HTTP_POST, &body, _out, NULL, -1, NULL, NULL, _timeout_ms);
+}
+
+int http_blocking_send(const char* _url, HTTPMethod _method, const HTTP_Request_Body* _Body,
+                       http_data* _out, int _timeout_ms)
+{
+  if (!_url || !_Body) {
+    return ERR_INVALID_ARG;
+  }
+
+  if (_out) {
+    _out->addr = NULL;
+    _out->size = 0;
+  }
+
+  return http_blocking_work(_url, _method, _Body, _out, NULL, -1, NULL, NULL, _timeout_ms);
+}
+
+int http_blocking_stream(const char* _url, http_client_on_body_chunk _on_body_chunk,
+                         void* _context, int _timeout_ms)
+{
+  if (!_url || !_on_body_chunk) {
+    return ERR_INVALID_ARG;
+  }
+
+  return http_blocking_work(_url, HTTP_GET, NULL, NULL, _on_body_chunk, -1, NULL, _context,
+                            _timeout_ms);
+}
+
+int http_blocking_download(const char* _url, int _fd, const HTTP_Download_Options* _Options,
+                           void* _context, int _timeout_ms)
+{
+  if (!_url || _fd < 0) {
+    return ERR_INVALID_ARG;
+  }
+
+  return http_blocking_work(_url, HTTP_DOWNLOAD, NULL, NULL, NULL, _fd, _Options, _context,
+                            _timeout_ms);
 }
 
-static int http_blocking_work(const char* _url, HTTPMethod _method, const http_data* _in_body,
-                              http_data* _out_body, int _timeout_ms)
+static int http_blocking_work(const char* _url, HTTPMethod _method,
+                              const HTTP_Request_Body* _in_body, http_data* _out_body,
+                              http_client_on_body_chunk _on_body_chunk, int _body_fd,
+                              const HTTP_Download_Options* _Options, void* _context,
+                              int _timeout_ms)
 {
   HTTP_Client* c = calloc(1, sizeof(*c));
   if (!c) {
     return ERR_NO_MEMORY;
   }
 
+  c->splice_pipe[0] = -1;
+  c->splice_pipe[1] = -1;
+  c->send_body.fd   = -1;
+
   c->URL  = strdup(_url);
   c->req  = calloc(1, sizeof(HTTP_Request));
   c->resp = calloc(1, sizeof(HTTP_Response));
@@ -130,29 +603,28 @@ static int http_blocking_work(const char* _url, HTTPMethod _method, const http_d
     return ERR_NO_MEMORY;
   }
 
-  c->resp_buf.addr    = NULL;
-  c->resp_buf.size    = 0;
-  c->recv_buf         = &c->resp_buf;
-  c->decoded_body     = NULL;
-  c->decoded_body_len = 0;
-  c->content_length   = 0;
-  c->chunk_remaining  = 0;
-  c->chunked          = -1;
+  c->content_length  = 0;
+  c->chunked         = -1;
 
   c->blocking_mode = 1;
   c->blocking_out  = _out_body;
   c->timeout_ms    = _timeout_ms;
 
+  c->on_body_chunk = _on_body_chunk;
+  c->body_fd       = _body_fd;
+  c->context       = _context;
+
+  if (http_client_download_prepare(c, _Options) != SUCCESS) {
+    http_client_destroy(c);
+    return ERR_IO;
+  }
+
   c->method = _method;
 
-  if (_in_body && _in_body->addr && _in_body->size > 0) {
-    c->req->body = malloc(_in_body->size);
-    if (!c->req->body) {
-      http_client_destroy(c);
-      return ERR_NO_MEMORY;
-    }
-    memcpy(c->req->body, _in_body->addr, _in_body->size);
-    c->req->body_len = (size_t)_in_body->size;
+  int res = http_client_set_body(c, _in_body);
+  if (res != SUCCESS) {
+    http_client_destroy(c);
+    return res;
   }
 
   c->state = HTTP_CLIENT_CONNECTING;
@@ -228,9 +700,11 @@ static int http_blocking_work(const char* _url, HTTPMethod _method, const http_d
     }
 
     case HTTP_CLIENT_ERROR:
-    default:
+    default: {
+      int res = c->body_error ? c->body_error : ERR_IO;
       http_client_destroy(c);
-      return ERR_IO;
+      return res;
+    }
     }
   }
 }
@@ -244,18 +718,26 @@ HTTPClientState http_client_worktask_connecting(HTTP_Client* _Client)
   if (http_parser_url(_Client->URL, (void*)&_Client->url_parts) != SUCCESS) {
     return HTTP_CLIENT_ERROR;
   }
-  int result;
 
-  if (_Client->blocking_mode) {
-    result = transport_init(&_Client->transport, _Client->url_parts.host, _Client->url_parts.port,
-                            _Client->url_parts.scheme, _Client->timeout_ms, true);
-  } else {
-    result = transport_init(&_Client->transport, _Client->url_parts.host, _Client->url_parts.port,
-                            _Client->url_parts.scheme, _Client->timeout_ms, false);
+  int result = connection_pool_acquire(_Client->url_parts.scheme, _Client->url_parts.host,
+                                       _Client->url_parts.port, _Client->blocking_mode,
+                                       _Client->timeout_ms, &_Client->transport);
+
+  if (result == ERR_BUSY) {
+    // Host is at its connection cap, wait for another request to hand one back
+    if (_Client->blocking_mode) {
+      ms_sleep(HTTP_CLIENT_POOL_RETRY_MS);
+    } else {
+      _Client->next_retry_at = SystemMonotonicMS() + HTTP_CLIENT_POOL_RETRY_MS;
+    }
+    return HTTP_CLIENT_CONNECTING;
   }
 
+  _Client->transport_reused = result == SUCCESS && connection_pool_is_reused(_Client->transport);
+
   if (result == ERR_IN_PROGRESS) {
-    return HTTP_CLIENT_WAITING_CONNECT;
+    http_client_watch_io(_Client);
+    return http_client_wait_io(_Client, HTTP_CLIENT_WAITING_CONNECT);
   }
 
   if (result != SUCCESS) {
@@ -263,8 +745,7 @@ HTTPClientState http_client_worktask_connecting(HTTP_Client* _Client)
     return HTTP_CLIENT_ERROR;
   }
 
-  return HTTP_CLIENT_BUILDING_REQUEST;
-
+  http_client_watch_io(_Client);
 
   return HTTP_CLIENT_BUILDING_REQUEST;
 }
@@ -275,20 +756,232 @@ HTTPClientState http_client_worktask_waiting_connect(HTTP_Client* _Client)
     return HTTP_CLIENT_ERROR;
   }
 
-  int res = transport_finish_connect(&_Client->transport);
+  int res = transport_finish_connect(_Client->transport);
   if (res == SUCCESS) {
     _Client->retries = 0;
     return HTTP_CLIENT_BUILDING_REQUEST;
   }
 
   if (errno == EINPROGRESS || errno == EALREADY || errno == EAGAIN) {
-    _Client->next_retry_at = SystemMonotonicMS() + 50;
-    return HTTP_CLIENT_WAITING_CONNECT;
+    return http_client_wait_io(_Client, HTTP_CLIENT_WAITING_CONNECT);
   }
 
   return HTTP_CLIENT_ERROR;
 }
 
+/* Appends a buffer to the send queue, the caller makes sure there is room */
+static void http_client_send_push(HTTP_Client* _Client, const void* _data, size_t _len)
+{
+  struct iovec* Vec = &_Client->send_iov[_Client->send_iov_count++];
+  Vec->iov_base     = (void*)_data;
+  Vec->iov_len      = _len;
+}
+
+/* Body bytes still to be queued or sent with sendfile() */
+static bool http_client_send_pending(HTTP_Client* _Client)
+{
+  const HTTP_Request_Body* Body = &_Client->send_body;
+
+  return _Client->send_slice < Body->slice_count || (Body->fd >= 0 && _Client->send_left > 0) ||
+         (Body->source && !_Client->send_source_done);
+}
+
+/* Files go out with sendfile() on plain HTTP and are read into send_stage on TLS */
+static bool http_client_send_direct(HTTP_Client* _Client)
+{
+  return _Client->send_body.fd >= 0 && !_Client->transport->use_tls;
+}
+
+/* Reads the next part of the file or source into send_stage. Returns the bytes read */
+static ssize_t http_client_send_stage(HTTP_Client* _Client, bool* _last)
+{
+  const HTTP_Request_Body* Body = &_Client->send_body;
+
+  size_t want = HTTP_CLIENT_SEND_CHUNK;
+  if (!_Client->send_chunked && _Client->send_left < want) {
+    want = (size_t)_Client->send_left;
+  }
+
+  if (byte_buffer_writable(&_Client->send_stage) < want &&
+      byte_buffer_reserve(&_Client->send_stage, want) != SUCCESS) {
+    return ERR_NO_MEMORY;
+  }
+
+  uint8_t* dst = byte_buffer_write_ptr(&_Client->send_stage);
+  ssize_t  got;
+
+  if (Body->fd >= 0) {
+    got = pread(Body->fd, dst, want, _Client->send_file_off);
+    if (got < 0) {
+      if (errno == EINTR) {
+        return 0;
+      }
+      perror("pread");
+      return ERR_IO;
+    }
+    if (got == 0) {
+      printf("Request body file ended early\n");
+      return ERR_IO;
+    }
+    _Client->send_file_off += got;
+
+  } else {
+    got = want > 0 ? Body->source(Body->source_context, dst, want) : 0;
+    if (got < 0) {
+      return ERR_ABORTED;
+    }
+    if ((size_t)got > want) {
+      return ERR_INVALID_ARG;
+    }
+    if (got == 0) {
+      // A source that stops before the announced Content-Length would hang the server
+      if (!_Client->send_chunked && _Client->send_left > 0) {
+        printf("Request body source ended early\n");
+        return ERR_IO;
+      }
+      _Client->send_source_done = true;
+      *_last                    = true;
+    }
+  }
+
+  byte_buffer_commit(&_Client->send_stage, (size_t)got);
+  return got;
+}
+
+/* Queues the next body bytes behind whatever is queued: caller slices as they are, file or
+ * source bytes through send_stage. A chunked body frames each fill as one chunk */
+static int http_client_send_fill(HTTP_Client* _Client)
+{
+  const HTTP_Request_Body* Body = &_Client->send_body;
+
+  // Keep a slot for the chunk size line and one for the CRLF after the data
+  int room = HTTP_CLIENT_SEND_IOV - _Client->send_iov_count - (_Client->send_chunked ? 2 : 0);
+  if (room <= 0) {
+    return SUCCESS;
+  }
+
+  int    line_slot = _Client->send_chunked ? _Client->send_iov_count++ : -1;
+  size_t queued    = 0;
+  bool   last      = false;
+
+  if (_Client->send_slice < Body->slice_count) {
+    while (_Client->send_slice < Body->slice_count && room > 0) {
+      const struct iovec* Slice = &Body->slices[_Client->send_slice++];
+      if (Slice->iov_len == 0) {
+        continue;
+      }
+      http_client_send_push(_Client, Slice->iov_base, Slice->iov_len);
+      queued += Slice->iov_len;
+      room--;
+    }
+  } else if ((Body->fd >= 0 && _Client->send_left > 0 && !http_client_send_direct(_Client)) ||
+             (Body->source && !_Client->send_source_done)) {
+    ssize_t got = http_client_send_stage(_Client, &last);
+    if (got < 0) {
+      return (int)got;
+    }
+    if (got > 0) {
+      http_client_send_push(_Client, byte_buffer_read_ptr(&_Client->send_stage), (size_t)got);
+      queued = (size_t)got;
+      if (!_Client->send_chunked) {
+        _Client->send_left -= queued;
+      }
+    }
+  }
+
+  if (!_Client->send_chunked) {
+    return SUCCESS;
+  }
+
+  if (queued > 0) {
+    int len = snprintf(_Client->send_chunk_line, sizeof(_Client->send_chunk_line), "%zx\r\n",
+                       queued);
+    _Client->send_iov[line_slot].iov_base = _Client->send_chunk_line;
+    _Client->send_iov[line_slot].iov_len  = (size_t)len;
+    http_client_send_push(_Client, last ? "\r\n0\r\n\r\n" : "\r\n", last ? 7 : 2);
+  } else if (last) {
+    _Client->send_iov[line_slot].iov_base = "0\r\n\r\n";
+    _Client->send_iov[line_slot].iov_len  = 5;
+  } else {
+    _Client->send_iov_count--; // Nothing to frame
+  }
+
+  return SUCCESS;
+}
+
+/* Queues the header block in request_buffer and the first part of the body behind it, so small
+ * requests leave in a single write */
+static int http_client_send_begin(HTTP_Client* _Client)
+{
+  const HTTP_Request_Body* Body = &_Client->send_body;
+
+  _Client->send_iov_pos     = 0;
+  _Client->send_iov_count   = 0;
+  _Client->send_slice       = 0;
+  _Client->send_file_off    = _Client->send_file_start;
+  _Client->send_chunked     = Body->length < 0;
+  _Client->send_left        = Body->length > 0 ? (uint64_t)Body->length : 0;
+  _Client->send_source_done = false;
+  _Client->bytes_sent       = 0;
+  byte_buffer_clear(&_Client->send_stage);
+
+  // send_left counts the file or source part that follows the slices
+  for (int i = 0; i < Body->slice_count && !_Client->send_chunked; i++) {
+    _Client->send_left -= Body->slices[i].iov_len;
+  }
+
+  http_client_send_push(_Client, _Client->request_buffer, (size_t)_Client->request_length);
+
+  return http_client_send_fill(_Client);
+}
+
+/* All pipelined GETs in one buffer, sent back to back by the normal send state */
+static HTTPClientState http_client_build_pipeline(HTTP_Client* _Client, const char* _connection)
+{
+  size_t host_len = strlen(_Client->url_parts.host);
+  size_t max_len  = 1;
+
+  for (int i = 0; i < _Client->pipeline_count; i++) {
+    max_len += strlen(_Client->pipeline_paths[i]) + host_len + 128;
+  }
+
+  free(_Client->request_buffer);
+  _Client->request_buffer = malloc(max_len);
+  if (!_Client->request_buffer) {
+    return HTTP_CLIENT_ERROR;
+  }
+
+  size_t used = 0;
+  for (int i = 0; i < _Client->pipeline_count; i++) {
+    // Only the last request may ask the server to close
+    bool last = i == _Client->pipeline_count - 1;
+
+    int len = snprintf((char*)_Client->request_buffer + used, max_len - used,
+                       "GET %s HTTP/1.1\r\n"
+                       "Host: %s\r\n"
+                       "User-Agent: httpclient\r\n"
+                       "Connection: %s\r\n"
+                       "\r\n",
+                       _Client->pipeline_paths[i], _Client->url_parts.host,
+                       last ? _connection : "keep-alive");
+
+    if (len < 0 || (size_t)len >= max_len - used) {
+      free(_Client->request_buffer);
+      _Client->request_buffer = NULL;
+      return HTTP_CLIENT_ERROR;
+    }
+    used += (size_t)len;
+  }
+
+  _Client->request_length = (int)used;
+
+  if (http_client_send_begin(_Client) != SUCCESS) {
+    return HTTP_CLIENT_ERROR;
+  }
+
+  return HTTP_CLIENT_SENDING_REQUEST;
+}
+
 HTTPClientState http_client_worktask_build_request(HTTP_Client* _Client)
 {
   if (!_Client) {
@@ -307,11 +1000,20 @@ HTTPClientState http_client_worktask_build_request(HTTP_Client* _Client)
 
   const char* path = (_Client->url_parts.path[0] ? _Client->url_parts.path : "/");
 
-  size_t body_len = (_Client->req->body && _Client->req->body_len > 0) ? _Client->req->body_len : 0;
-  size_t extra_space = body_len > 0 ? 128 : 0;
+  // Only ask the server to keep the connection if something will reuse it
+  const char* connection = connection_pool_enabled() ? "keep-alive" : "close";
 
-  size_t max_len = strlen(_Client->url_parts.host) + strlen(path) + 256 + extra_space + body_len;
+  if (_Client->pipeline_paths) {
+    return http_client_build_pipeline(_Client, connection);
+  }
 
+  // Only the header block is built here, the body is sent from where it lies
+  const HTTP_Request_Body* Body = &_Client->send_body;
+  const char* content_type = Body->content_type ? Body->content_type : "application/octet-stream";
+
+  size_t max_len = strlen(_Client->url_parts.host) + strlen(path) + strlen(content_type) + 320;
+
+  free(_Client->request_buffer);
   _Client->request_buffer = malloc(max_len);
   if (!_Client->request_buffer) {
     return HTTP_CLIENT_ERROR;
@@ -319,48 +1021,90 @@ HTTPClientState http_client_worktask_build_request(HTTP_Client* _Client)
 
   int hdr_len;
 
-  if (body_len > 0 && (_Client->method == HTTP_POST || _Client->method == HTTP_PUT)) {
+  if (Body->length != 0) {
+    // Unknown length from a source goes out chunked
+    char framing[64];
+    if (Body->length < 0) {
+      snprintf(framing, sizeof(framing), "Transfer-Encoding: chunked\r\n");
+    } else {
+      snprintf(framing, sizeof(framing), "Content-Length: %llu\r\n",
+               (unsigned long long)Body->length);
+    }
+
     hdr_len = snprintf((char*)_Client->request_buffer, max_len,
                        "%s %s HTTP/1.1\r\n"
                        "Host: %s\r\n"
                        "User-Agent: httpclient\r\n"
-                       "Connection: close\r\n"
-                       "Content-Length: %zu\r\n"
-                       "Content-Type: application/octet-stream\r\n"
+                       "Connection: %s\r\n"
+                       "%s"
+                       "Content-Type: %s\r\n"
                        "\r\n",
-                       method_str, path, _Client->url_parts.host, body_len);
+                       method_str, path, _Client->url_parts.host, connection, framing,
+                       content_type);
   } else {
+    // A resumed download only asks for what the file is missing
+    char range[48] = "";
+    if (_Client->body_offset > 0) {
+      snprintf(range, sizeof(range), "Range: bytes=%llu-\r\n",
+               (unsigned long long)_Client->body_offset);
+    }
+
     hdr_len = snprintf((char*)_Client->request_buffer, max_len,
                        "%s %s HTTP/1.1\r\n"
                        "Host: %s\r\n"
                        "User-Agent: httpclient\r\n"
-                       "Connection: close\r\n"
+                       "Connection: %s\r\n"
+                       "%s"
                        "\r\n",
-                       method_str, path, _Client->url_parts.host);
+                       method_str, path, _Client->url_parts.host, connection, range);
   }
 
-  if (hdr_len < 0) {
+  if (hdr_len < 0 || (size_t)hdr_len >= max_len) {
     free(_Client->request_buffer);
     _Client->request_buffer = NULL;
     return HTTP_CLIENT_ERROR;
   }
 
-  size_t headers_len = (size_t)hdr_len;
+  _Client->request_length = hdr_len;
 
-  if (headers_len + body_len > max_len) {
-    free(_Client->request_buffer);
-    _Client->request_buffer = NULL;
+  int res = http_client_send_begin(_Client);
+  if (res != SUCCESS) {
+    _Client->body_error = res;
     return HTTP_CLIENT_ERROR;
   }
 
-  if (body_len > 0) {
-    memcpy(_Client->request_buffer + headers_len, _Client->req->body, body_len);
+  return HTTP_CLIENT_SENDING_REQUEST;
+}
+
+/* Drops _written bytes from the front of the send queue */
+static void http_client_send_advance(HTTP_Client* _Client, size_t _written)
+{
+  while (_written > 0 && _Client->send_iov_pos < _Client->send_iov_count) {
+    struct iovec* Vec = &_Client->send_iov[_Client->send_iov_pos];
+    if (_written < Vec->iov_len) {
+      Vec->iov_base = (uint8_t*)Vec->iov_base + _written;
+      Vec->iov_len -= _written;
+      return;
+    }
+    _written -= Vec->iov_len;
+    _Client->send_iov_pos++;
   }
+}
 
-  _Client->request_length = (int)(headers_len + body_len);
-  _Client->bytes_sent     = 0;
+/* The whole request is queued, push out the last partial TLS record before reading */
+static HTTPClientState http_client_send_flush(HTTP_Client* _Client)
+{
+  int res = transport_flush(_Client->transport);
+  if (res == ERR_IN_PROGRESS) {
+    return http_client_wait_io(_Client, HTTP_CLIENT_SENDING_REQUEST);
+  }
+  if (res != SUCCESS) {
+    printf("Failed to flush request\n");
+    return HTTP_CLIENT_ERROR;
+  }
 
-  return HTTP_CLIENT_SENDING_REQUEST;
+  _Client->retries = 0;
+  return HTTP_CLIENT_READING_FIRSTLINE;
 }
 
 HTTPClientState http_client_worktask_send_request(HTTP_Client* _Client)
@@ -374,46 +1118,219 @@ HTTPClientState http_client_worktask_send_request(HTTP_Client* _Client)
     fflush(stdout);
   }
 
-  size_t remaining = 0;
-  remaining        = _Client->request_length - _Client->bytes_sent;
+  // Queue drained, line up the next part of the body
+  if (_Client->send_iov_pos == _Client->send_iov_count) {
+    _Client->send_iov_pos   = 0;
+    _Client->send_iov_count = 0;
+    byte_buffer_clear(&_Client->send_stage);
+
+    int res = http_client_send_fill(_Client);
+    if (res != SUCCESS) {
+      _Client->body_error = res;
+      return HTTP_CLIENT_ERROR;
+    }
+  }
+
+  ssize_t written;
+
+  if (_Client->send_iov_pos < _Client->send_iov_count) {
+    written = transport_writev(_Client->transport, &_Client->send_iov[_Client->send_iov_pos],
+                               _Client->send_iov_count - _Client->send_iov_pos);
+    if (written > 0) {
+      http_client_send_advance(_Client, (size_t)written);
+    }
+
+  } else if (http_client_send_direct(_Client) && _Client->send_left > 0) {
+    size_t count = _Client->send_left > (uint64_t)(1 << 30) ? (size_t)1 << 30
+                                                            : (size_t)_Client->send_left;
+    written = transport_sendfile(_Client->transport, _Client->send_body.fd,
+                                 &_Client->send_file_off, count);
+    if (written == 0) {
+      printf("Request body file ended early\n");
+      _Client->body_error = ERR_IO;
+      return HTTP_CLIENT_ERROR;
+    }
+    if (written > 0) {
+      _Client->send_left -= (uint64_t)written;
+    }
+
+  } else if (http_client_send_pending(_Client)) {
+    // Interrupted read, nothing was queued. Let the server have what is buffered meanwhile
+    transport_flush(_Client->transport);
+    return HTTP_CLIENT_SENDING_REQUEST;
+
+  } else {
+    return http_client_send_flush(_Client);
+  }
+
+  if (written > 0) {
+    _Client->bytes_sent += (size_t)written;
+    _Client->tick_bytes += (size_t)written;
+
+    if (_Client->send_iov_pos == _Client->send_iov_count && !http_client_send_pending(_Client)) {
+      return http_client_send_flush(_Client);
+    }
+
+    // More to send, try again right away and park on EAGAIN
+    return HTTP_CLIENT_SENDING_REQUEST;
+
+  } else if (written == 0) {
+    _Client->retries++;
+    _Client->next_retry_at = SystemMonotonicMS() + 1000;
+
+    return HTTP_CLIENT_SENDING_REQUEST;
+
+  } else {
+    if (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR) {
+      return http_client_wait_io(_Client, HTTP_CLIENT_SENDING_REQUEST);
+    }
+    if ((errno == EPIPE || errno == ECONNRESET) && http_client_retry_stale(_Client)) {
+      return HTTP_CLIENT_CONNECTING;
+    }
+    if (_Client->retries < 3) {
+      _Client->retries++;
+      _Client->next_retry_at = SystemMonotonicMS() + 1000;
+      return HTTP_CLIENT_SENDING_REQUEST;
+    }
+    return HTTP_CLIENT_ERROR;
+  }
+
+  _Client->retries = 0;
+  return HTTP_CLIENT_READING_FIRSTLINE;
+}
+
+/* Largest read worth asking for, the socket receive buffer can't hand over more at once */
+static size_t http_client_read_max(HTTP_Client* _Client)
+{
+  if (_Client->read_max) {
+    return _Client->read_max;
+  }
+
+  int       rcvbuf = 0;
+  socklen_t len    = sizeof(rcvbuf);
+  int       fd     = transport_get_fd(_Client->transport);
+
+  size_t max = HTTP_CLIENT_READ_CHUNK;
+  if (fd >= 0 && getsockopt(fd, SOL_SOCKET, SO_RCVBUF, &rcvbuf, &len) == 0 &&
+      (size_t)rcvbuf > max) {
+    max = (size_t)rcvbuf;
+  }
+  if (max > HTTP_CLIENT_READ_MAX) {
+    max = HTTP_CLIENT_READ_MAX;
+  }
+
+  _Client->read_max = max;
+  return max;
+}
+
+/* Reads the next piece of the response straight into the free tail of recv_buf. The read size
+ * doubles while reads come back full and halves when they come back mostly empty */
+static int http_client_fill(HTTP_Client* _Client)
+{
+  if (!_Client->read_size) {
+    _Client->read_size = HTTP_CLIENT_READ_CHUNK;
+  }
+
+  int res = transport_read_buffer(_Client->transport, &_Client->recv_buf, _Client->read_size);
+  if (res <= 0) {
+    return res;
+  }
+
+  size_t got = (size_t)res;
+  _Client->tick_bytes += got;
+
+  if (got == _Client->read_size) {
+    size_t max         = http_client_read_max(_Client);
+    _Client->read_size = _Client->read_size * 2 > max ? max : _Client->read_size * 2;
+  } else if (got < _Client->read_size / 4 && _Client->read_size / 2 >= HTTP_CLIENT_READ_MIN) {
+    _Client->read_size /= 2;
+  }
+
+  return res;
+}
+
+static bool http_client_streaming(const HTTP_Client* _Client)
+{
+  return _Client->on_body_chunk || _Client->body_fd >= 0;
+}
+
+static void http_client_report_progress(HTTP_Client* _Client)
+{
+  if (!_Client->on_progress) {
+    return;
+  }
+
+  int64_t total = _Client->chunked == 0
+                      ? (int64_t)(_Client->body_offset + _Client->content_length)
+                      : -1;
+  _Client->on_progress(_Client->context, _Client->body_offset + _Client->body_received, total);
+}
 
+/* The server ignored the Range request and sends the whole body, the file starts over */
+static int http_client_restart_download(HTTP_Client* _Client)
+{
+  if (lseek(_Client->body_fd, 0, SEEK_SET) < 0 || ftruncate(_Client->body_fd, 0) != 0) {
+    perror("restart download");
+    _Client->body_error = ERR_IO;
+    return ERR_IO;
+  }
 
-  int written =
-      transport_write(&_Client->transport,
-                      (const uint8_t*)_Client->request_buffer + _Client->bytes_sent, remaining);
+  _Client->body_offset = 0;
+  return SUCCESS;
+}
 
-  if (written > 0) {
-    _Client->bytes_sent += written;
-    if (_Client->bytes_sent >= (size_t)_Client->request_length) {
+/* Hands decoded body bytes to the fd and/or callback when streaming, otherwise collects them */
+static int http_client_body_append(HTTP_Client* _Client, const uint8_t* _data, size_t _len)
+{
+  if (!http_client_streaming(_Client)) {
+    return byte_buffer_append(&_Client->decoded_body, _data, _len);
+  }
 
-      _Client->retries = 0;
-      return HTTP_CLIENT_READING_FIRSTLINE;
+  if (_Client->body_fd >= 0) {
+    size_t written = 0;
+    while (written < _len) {
+      ssize_t res = write(_Client->body_fd, _data + written, _len - written);
+      if (res < 0) {
+        if (errno == EINTR) {
+          continue;
+        }
+        perror("write body");
+        _Client->body_error = ERR_IO;
+        return ERR_IO;
+      }
+      written += (size_t)res;
     }
+  }
 
-    _Client->next_retry_at = SystemMonotonicMS() + 100;
-    return HTTP_CLIENT_SENDING_REQUEST;
+  if (_Client->on_body_chunk && _Client->on_body_chunk(_Client->context, _data, _len) != 0) {
+    _Client->body_error = ERR_ABORTED;
+    return ERR_ABORTED;
+  }
 
-  } else if (written == 0) {
-    _Client->retries++;
-    _Client->next_retry_at = SystemMonotonicMS() + 1000;
+  _Client->body_received += _len;
+  http_client_report_progress(_Client);
+  return SUCCESS;
+}
 
-    return HTTP_CLIENT_SENDING_REQUEST;
+/* Streams the body bytes sitting in recv_buf. A Content-Length body stops at its length, the
+ * rest belongs to whatever follows on the connection */
+static int http_client_stream_buffered(HTTP_Client* _Client)
+{
+  size_t take = byte_buffer_readable(&_Client->recv_buf);
 
-  } else {
-    if (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR) {
-      _Client->next_retry_at = SystemMonotonicMS() + 100;
-      return HTTP_CLIENT_SENDING_REQUEST;
-    }
-    if (_Client->retries < 3) {
-      _Client->retries++;
-      _Client->next_retry_at = SystemMonotonicMS() + 1000;
-      return HTTP_CLIENT_SENDING_REQUEST;
-    }
-    return HTTP_CLIENT_ERROR;
+  if (_Client->chunked == 0 && take > _Client->content_length - _Client->body_received) {
+    take = _Client->content_length - _Client->body_received;
   }
 
-  _Client->retries = 0;
-  return HTTP_CLIENT_READING_FIRSTLINE;
+  if (take == 0) {
+    return SUCCESS;
+  }
+
+  int res = http_client_body_append(_Client, byte_buffer_read_ptr(&_Client->recv_buf), take);
+  if (res == SUCCESS) {
+    byte_buffer_consume(&_Client->recv_buf, take);
+  }
+  return res;
 }
 
 HTTPClientState http_client_worktask_read_firstline(HTTP_Client* _Client)
@@ -422,39 +1339,51 @@ HTTPClientState http_client_worktask_read_firstline(HTTP_Client* _Client)
     return HTTP_CLIENT_ERROR;
   }
 
-  Transport* t = &_Client->transport;
+  Byte_Buffer* Recv = &_Client->recv_buf;
+
+  // A pipelined response may already be waiting behind the previous one
+  if (byte_buffer_readable(Recv) > 0 &&
+      http_parser_find_line_end(byte_buffer_read_ptr(Recv), byte_buffer_readable(Recv)) >= 0) {
+    return http_client_parse_firstline(_Client);
+  }
 
-  uint8_t read_buf[8096];
-  int     bytes_read = transport_read(t, read_buf, sizeof(read_buf) - 1);
+  int bytes_read = http_client_fill(_Client);
 
   if (bytes_read < 0) {
     if (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR) {
-      return HTTP_CLIENT_READING_FIRSTLINE;
+      return http_client_wait_io(_Client, HTTP_CLIENT_READING_FIRSTLINE);
+    }
+    if (errno == ECONNRESET && http_client_retry_stale(_Client)) {
+      return HTTP_CLIENT_CONNECTING;
     }
     perror("recv firstline");
     return HTTP_CLIENT_ERROR;
   }
 
   if (bytes_read == 0) {
+    if (http_client_retry_stale(_Client)) {
+      return HTTP_CLIENT_CONNECTING;
+    }
     printf("Connection closed by peer\n");
     return HTTP_CLIENT_ERROR;
   }
-  ssize_t bytes_stored =
-      buffer_append((void**)&_Client->recv_buf->addr, (size_t*)&_Client->recv_buf->size, read_buf,
-                    (size_t)bytes_read);
 
-  if (bytes_stored < 0) {
-    return HTTP_CLIENT_ERROR;
-  }
+  return http_client_parse_firstline(_Client);
+}
 
-  if (_Client->recv_buf->size == 0) {
+static HTTPClientState http_client_parse_firstline(HTTP_Client* _Client)
+{
+  Byte_Buffer* Recv     = &_Client->recv_buf;
+  size_t       readable = byte_buffer_readable(Recv);
+
+  if (readable == 0) {
     return HTTP_CLIENT_READING_FIRSTLINE;
   }
 
-  int line_end = http_parser_find_line_end(_Client->recv_buf->addr, _Client->recv_buf->size);
+  int line_end = http_parser_find_line_end(byte_buffer_read_ptr(Recv), readable);
   if (line_end < 0) {
     /*No \r\n found yet*/
-    if (_Client->recv_buf->size >= 1024) {
+    if (readable >= 1024) {
       /*Invalid request*/
       printf("Response too large..\n");
       return HTTP_CLIENT_ERROR;
@@ -471,24 +1400,14 @@ HTTPClientState http_client_worktask_read_firstline(HTTP_Client* _Client)
     return HTTP_CLIENT_ERROR;
   }
 
-  if (http_parser_response_firstline((const char*)_Client->recv_buf->addr, line_len,
+  if (http_parser_response_firstline((const char*)byte_buffer_read_ptr(Recv), line_len,
                                      _Client->resp) != SUCCESS) {
     /*Add internal error*/
     return HTTP_CLIENT_ERROR;
   }
-  /*We have handled first line + 2 for \r\n*/
-  ssize_t parsed = line_len + 2;
-
-  /*If there is data remaining after first line shift it to beggining of
-   * buffer*/
-  if (_Client->recv_buf->size > parsed) {
-
-    memmove(_Client->recv_buf->addr, _Client->recv_buf->addr + parsed,
-            _Client->recv_buf->size - parsed);
-  }
 
-  /*Remove first line by shrinking the buffer*/
-  _Client->recv_buf->size -= parsed;
+  /*We have handled first line + 2 for \r\n*/
+  byte_buffer_consume(Recv, line_len + 2);
 
   return HTTP_CLIENT_READING_HEADERS;
 }
@@ -499,87 +1418,104 @@ HTTPClientState http_client_worktask_read_headers(HTTP_Client* _Client)
     return HTTP_CLIENT_ERROR;
   }
 
-  if (_Client->recv_buf->size > 0) {
+  Byte_Buffer* Recv = &_Client->recv_buf;
+
+  if (byte_buffer_readable(Recv) > 0) {
     int headers_end =
-        http_parser_find_headers_end(_Client->recv_buf->addr, (size_t)_Client->recv_buf->size);
+        http_parser_find_headers_end(byte_buffer_read_ptr(Recv), byte_buffer_readable(Recv));
 
     if (headers_end >= 0) {
       size_t parsed_len = (size_t)headers_end + 4; // inkluderar \r\n\r\n
 
-      fflush(stdout);
+      if (http_header_table_parse(&_Client->headers, (const char*)byte_buffer_read_ptr(Recv),
+                                  parsed_len) != SUCCESS) {
+        return HTTP_CLIENT_ERROR;
+      }
+
+      // Whatever follows the headers is body already read
+      byte_buffer_consume(Recv, parsed_len);
+      _Client->retries    = 0;
+      _Client->keep_alive = http_client_response_keep_alive(_Client);
+
+      int status = _Client->resp->status_code;
 
-      if (http_parser_headers((const char*)_Client->recv_buf->addr, parsed_len,
-                              &_Client->req->headers) != SUCCESS) {
+      if (_Client->body_offset > 0 && status == HttpStatus_RangeNotSatisfiable) {
+        // Nothing past the end of the file, it already holds the whole resource
+        _Client->keep_alive = false;
+        return HTTP_CLIENT_RETURNING;
+      }
+
+      // An error page is not the body that was asked for, the fd keeps what it had
+      if (http_client_streaming(_Client) && status >= 300 && status != HttpStatus_NotModified) {
+        printf("Request failed with status %d\n", status);
+        _Client->keep_alive = false;
+        _Client->body_error = ERR_IO;
         return HTTP_CLIENT_ERROR;
       }
 
-      size_t body_already_read = 0;
-      if ((size_t)_Client->recv_buf->size > parsed_len) {
-        body_already_read = (size_t)_Client->recv_buf->size - parsed_len;
-        memmove(_Client->recv_buf->addr, _Client->recv_buf->addr + parsed_len, body_already_read);
+      if (_Client->body_offset > 0 && status == HttpStatus_OK) {
+        if (http_client_restart_download(_Client) != SUCCESS) {
+          return HTTP_CLIENT_ERROR;
+        }
+      }
+
+      // Never a body, whatever the framing headers say (RFC 9112 6.3)
+      if (HttpStatus_isInformational(status) || status == HttpStatus_NoContent ||
+          status == HttpStatus_NotModified) {
+        _Client->chunked        = 0;
+        _Client->content_length = 0;
+        return HTTP_CLIENT_RETURNING;
       }
-      _Client->recv_buf->size = (ssize_t)body_already_read;
-      _Client->retries        = 0;
 
-      const char* transfer_encoding_string = NULL;
-      if (http_parser_get_header_value(_Client->req->headers, "Transfer-Encoding",
-                                       &transfer_encoding_string) == SUCCESS &&
-          transfer_encoding_string && strstr(transfer_encoding_string, "chunked")) {
+      const char* transfer_encoding_string =
+          http_header_table_get(&_Client->headers, HTTP_HEADER_TRANSFER_ENCODING);
+      if (transfer_encoding_string && strstr(transfer_encoding_string, "chunked")) {
+        _Client->chunked = 1;
         return HTTP_CLIENT_DECIPHER_CHONKINESS;
       }
 
-      const char* content_length_string = NULL;
-      if (http_parser_get_header_value(_Client->req->headers, "Content-Length",
-                                       &content_length_string) == SUCCESS &&
-          content_length_string) {
-        int cl = 0;
-        parse_string_to_int(content_length_string, &cl);
+      const char* content_length_string =
+          http_header_table_get(&_Client->headers, HTTP_HEADER_CONTENT_LENGTH);
+      if (content_length_string) {
+        // 64 bit, downloads may well be larger than an int
+        char*              end = NULL;
+        unsigned long long cl  = strtoull(content_length_string, &end, 10);
+        if (end == content_length_string || content_length_string[0] == '-') {
+          cl = 0;
+        }
+        _Client->chunked = 0;
         if (cl > 0) {
-          _Client->content_length = cl;
+          _Client->content_length = (size_t)cl;
 
-          if ((size_t)_Client->recv_buf->size >= (size_t)cl) {
+          if (!http_client_streaming(_Client) && byte_buffer_readable(Recv) >= cl) {
             return HTTP_CLIENT_RETURNING;
           }
           return HTTP_CLIENT_READING_BODY;
         }
+        return HTTP_CLIENT_RETURNING;
       }
 
-      return HTTP_CLIENT_RETURNING;
+      // No framing, the body (if any) runs until the server closes the connection
+      _Client->keep_alive = false;
+      return http_client_streaming(_Client) ? HTTP_CLIENT_READING_BODY : HTTP_CLIENT_RETURNING;
     }
   }
 
-  uint8_t read_buf[1024];
-  int     bytes_read = transport_read(&_Client->transport, read_buf, sizeof(read_buf) - 1);
+  int bytes_read = http_client_fill(_Client);
 
   if (bytes_read < 0) {
     if (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR) {
-      return HTTP_CLIENT_READING_HEADERS;
+      return http_client_wait_io(_Client, HTTP_CLIENT_READING_HEADERS);
     }
     perror("recv headers");
     return HTTP_CLIENT_ERROR;
   }
 
   if (bytes_read == 0) {
-    int headers_end =
-        http_parser_find_headers_end(_Client->recv_buf->addr, (size_t)_Client->recv_buf->size);
-    if (headers_end >= 0) {
-      return http_client_worktask_read_headers(_Client);
-    }
-
     printf("Connection closed while reading headers\r\n");
     return HTTP_CLIENT_ERROR;
   }
 
-  // NUL-terminera read_buf (säkert eftersom vi läser sizeof-1)
-  read_buf[bytes_read] = '\0';
-
-  ssize_t bytes_stored =
-      buffer_append((void**)&_Client->recv_buf->addr, (size_t*)&_Client->recv_buf->size, read_buf,
-                    (size_t)bytes_read);
-  if (bytes_stored < 0) {
-    return HTTP_CLIENT_ERROR;
-  }
-
   return HTTP_CLIENT_READING_HEADERS;
 }
 
@@ -589,230 +1525,207 @@ HTTPClientState http_client_worktask_decipher_chonkiness(HTTP_Client* _Client)
     return HTTP_CLIENT_ERROR;
   }
 
+  // The decoder keeps its place across reads, framing is never shifted out of recv_buf
+  http_chunked_init(&_Client->chunked_decoder);
+
+  return HTTP_CLIENT_READING_BODY_CHUNKED;
+}
 
-  int line_end = http_parser_find_line_end(_Client->recv_buf->addr, _Client->recv_buf->size);
+static int http_client_chunked_data(void* _context, const uint8_t* _data, size_t _len)
+{
+  return http_client_body_append((HTTP_Client*)_context, _data, _len);
+}
 
-  if (line_end < 0) {
+HTTPClientState http_client_worktask_read_body_chunked(HTTP_Client* _Client)
+{
+  if (!_Client) {
+    return HTTP_CLIENT_ERROR;
+  }
 
-    // Read until we find end of the line
-    uint8_t read_buf[1024];
-    int additional_bytes_read = transport_read(&_Client->transport, read_buf, sizeof(read_buf) - 1);
+  Byte_Buffer* Recv = &_Client->recv_buf;
 
-    if (additional_bytes_read < 0) {
-      if (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR) {
-        // Read again
-        return HTTP_CLIENT_DECIPHER_CHONKINESS;
-      }
-      perror("recv chunk");
-      return HTTP_CLIENT_ERROR;
-    }
+  // Decode what has arrived, the data goes out as it is found
+  if (byte_buffer_readable(Recv) > 0) {
+    size_t consumed = 0;
+    int    res      = http_chunked_feed(&_Client->chunked_decoder, byte_buffer_read_ptr(Recv),
+                                        byte_buffer_readable(Recv), &consumed,
+                                        http_client_chunked_data, _Client);
+    byte_buffer_consume(Recv, consumed);
 
-    if (additional_bytes_read == 0) {
-      // Connection closed
+    if (res != SUCCESS) {
+      if (res == ERR_BAD_FORMAT) {
+        printf("Malformed chunked body\r\n");
+      }
       return HTTP_CLIENT_ERROR;
     }
 
-    if (buffer_append((void**)&_Client->recv_buf->addr, (size_t*)&_Client->recv_buf->size, read_buf,
-                      (size_t)additional_bytes_read) < 0) {
-      return HTTP_CLIENT_ERROR;
+    if (http_chunked_done(&_Client->chunked_decoder)) {
+      _Client->retries = 0;
+      return HTTP_CLIENT_RETURNING;
     }
-
-    return HTTP_CLIENT_DECIPHER_CHONKINESS;
   }
 
-  ssize_t consume_len = (ssize_t)line_end + 2;
-  size_t parse_len   = (size_t)line_end;
-
-  ssize_t chunk_size;
+  int bytes_read = http_client_fill(_Client);
 
-  for (size_t i = 0; i < (size_t)line_end; i++) {
-    uint8_t ch = _Client->recv_buf->addr[i];
-    if (ch == ';' || ch == ' ' || ch == '\t') {
-      parse_len = i;
-      break;
+  if (bytes_read < 0) {
+    if (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR) {
+      // Keep reading
+      return http_client_wait_io(_Client, HTTP_CLIENT_READING_BODY_CHUNKED);
     }
-  }
-
-  if (parse_len <= 0) {
+    perror("recv chunk-data");
     return HTTP_CLIENT_ERROR;
   }
 
-  char line[48];
-  memcpy(line, _Client->recv_buf->addr, parse_len);
-  line[parse_len] = '\0';
-
-  char*              endptr = NULL;
-  unsigned long long val    = strtoull(line, &endptr, 16);
-
-  if (endptr == line) {
+  if (bytes_read == 0) {
+    // Connection closed
     return HTTP_CLIENT_ERROR;
   }
 
-  chunk_size = (ssize_t)val;
-
-  if (_Client->recv_buf->size > consume_len) {
-    memmove(_Client->recv_buf->addr, _Client->recv_buf->addr + consume_len,
-            _Client->recv_buf->size - consume_len);
-  }
-
-  _Client->recv_buf->size -= consume_len;
-
-  // printf("%.*s\n", (int)TCP_C->data.size, (char *)TCP_C->data.addr);
-
-  // Find trailing \r\n\r\n
-  if (chunk_size == 0) {
-    // No trailers just singe \r\n
-    if (_Client->recv_buf->size >= 2 && _Client->recv_buf->addr[0] == '\r' &&
-        _Client->recv_buf->addr[1] == '\n') {
-
-      if (_Client->recv_buf->size > 2) {
+  return HTTP_CLIENT_READING_BODY_CHUNKED;
+}
 
-        memmove(_Client->recv_buf->addr, _Client->recv_buf->addr + 2, _Client->recv_buf->size - 2);
-      }
+/* Plain HTTP Content-Length body going only to an fd, once recv_buf has been flushed */
+static bool http_client_can_splice(const HTTP_Client* _Client)
+{
+  return _Client->body_fd >= 0 && !_Client->on_body_chunk && !_Client->splice_off &&
+         _Client->chunked == 0 && _Client->transport && !_Client->transport->use_tls &&
+         byte_buffer_readable(&_Client->recv_buf) == 0;
+}
 
-      _Client->recv_buf->size -= 2;
-      return HTTP_CLIENT_RETURNING;
-    }
+/* Copies what already sits in the pipe through user space, when body_fd refuses splice() */
+static int http_client_splice_copy(HTTP_Client* _Client, size_t _len)
+{
+  uint8_t buf[16384];
 
-    // There are trailers
-    int traling_end =
-        http_parser_find_headers_end(_Client->recv_buf->addr, _Client->recv_buf->size);
-    if (traling_end >= 0) {
-      ssize_t trailers_consume = (ssize_t)traling_end + 4;
-      if (_Client->recv_buf->size > trailers_consume) {
-        memmove(_Client->recv_buf->addr, _Client->recv_buf->addr + trailers_consume,
-                _Client->recv_buf->size - trailers_consume);
-      }
-      _Client->recv_buf->size -= trailers_consume;
-      return HTTP_CLIENT_RETURNING;
+  while (_len > 0) {
+    ssize_t res = read(_Client->splice_pipe[0], buf, _len < sizeof(buf) ? _len : sizeof(buf));
+    if (res < 0 && errno == EINTR) {
+      continue;
     }
-
-    // Incomplete trailers
-    // Read again
-    uint8_t read_buf[1024];
-
-    int bytes_read = transport_read(&_Client->transport, read_buf, sizeof(read_buf) - 1);
-
-    if (bytes_read < 0) {
-      if (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR) {
-        return HTTP_CLIENT_DECIPHER_CHONKINESS;
-      }
-      perror("recv trailers");
-      return HTTP_CLIENT_ERROR;
+    if (res <= 0) {
+      perror("read pipe");
+      _Client->body_error = ERR_IO;
+      return ERR_IO;
     }
 
-    if (bytes_read == 0) {
-      // Connection closed
-      return HTTP_CLIENT_ERROR;
+    int append = http_client_body_append(_Client, buf, (size_t)res);
+    if (append != SUCCESS) {
+      return append;
     }
+    _len -= (size_t)res;
+  }
 
+  return SUCCESS;
+}
 
-    if (buffer_append((void**)&_Client->recv_buf->addr, (size_t*)&_Client->recv_buf->size, read_buf,
-                      (size_t)bytes_read) < 0) {
-      return HTTP_CLIENT_ERROR;
+/* Moves the body socket -> pipe -> body_fd without copying it into user space. The pipe is
+ * emptied every round so only the socket side can block */
+static HTTPClientState http_client_splice_body(HTTP_Client* _Client)
+{
+  if (!_Client->splice_open) {
+    if (pipe2(_Client->splice_pipe, O_CLOEXEC) != 0) {
+      _Client->splice_off = true;
+      return HTTP_CLIENT_READING_BODY;
     }
+    _Client->splice_open = true;
+    fcntl(_Client->splice_pipe[1], F_SETPIPE_SZ, HTTP_CLIENT_SPLICE_CHUNK); // Best effort
+  }
 
-    return HTTP_CLIENT_DECIPHER_CHONKINESS;
+  size_t want = _Client->content_length - _Client->body_received;
+  if (want > HTTP_CLIENT_SPLICE_CHUNK) {
+    want = HTTP_CLIENT_SPLICE_CHUNK;
   }
 
-  _Client->chunk_remaining = (int)chunk_size;
-  return HTTP_CLIENT_READING_BODY_CHUNKED;
-}
+  ssize_t moved = splice(transport_get_fd(_Client->transport), NULL, _Client->splice_pipe[1], NULL,
+                         want, SPLICE_F_MOVE | SPLICE_F_NONBLOCK);
 
-HTTPClientState http_client_worktask_read_body_chunked(HTTP_Client* _Client)
-{
-  if (!_Client) {
+  if (moved < 0) {
+    if (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR) {
+      _Client->transport->want = TRANSPORT_WANT_READ;
+      return http_client_wait_io(_Client, HTTP_CLIENT_READING_BODY);
+    }
+    if (errno == EINVAL || errno == ENOSYS) {
+      _Client->splice_off = true;
+      return HTTP_CLIENT_READING_BODY;
+    }
+    perror("splice body");
     return HTTP_CLIENT_ERROR;
   }
 
+  if (moved == 0) {
+    printf("Connection closed before full body was recieved\r\n");
+    return HTTP_CLIENT_ERROR;
+  }
 
-  // Do we need more data?
-  if (_Client->recv_buf->size < (ssize_t)_Client->chunk_remaining) {
-    uint8_t read_buf[1024];
-    int     bytes_read = transport_read(&_Client->transport, read_buf, sizeof(read_buf) - 1);
-
-    if (bytes_read < 0) {
-      if (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR) {
-        // Keep reading
-        return HTTP_CLIENT_READING_BODY_CHUNKED;
+  size_t left = (size_t)moved;
+  while (left > 0) {
+    ssize_t out = splice(_Client->splice_pipe[0], NULL, _Client->body_fd, NULL, left, SPLICE_F_MOVE);
+    if (out < 0 && errno == EINTR) {
+      continue;
+    }
+    if (out < 0 && errno == EINVAL) {
+      // O_APPEND or a file system without splice support
+      _Client->splice_off = true;
+      if (http_client_splice_copy(_Client, left) != SUCCESS) {
+        return HTTP_CLIENT_ERROR;
       }
-      perror("recv chunk-data");
-      return HTTP_CLIENT_ERROR;
+      break;
     }
-
-    if (bytes_read == 0) {
-      // Connection closed
+    if (out <= 0) {
+      perror("splice file");
+      _Client->body_error = ERR_IO;
       return HTTP_CLIENT_ERROR;
     }
+    left -= (size_t)out;
+    _Client->body_received += (size_t)out;
+  }
+  _Client->tick_bytes += (size_t)moved;
 
-    // If we have read more data
-
-    if (buffer_append((void**)&_Client->recv_buf->addr, (size_t*)&_Client->recv_buf->size, read_buf,
-                      (size_t)bytes_read) < 0) {
-      return HTTP_CLIENT_ERROR;
-    }
+  http_client_report_progress(_Client);
 
-    return HTTP_CLIENT_READING_BODY_CHUNKED;
+  if (_Client->body_received >= _Client->content_length) {
+    _Client->retries = 0;
+    return HTTP_CLIENT_RETURNING;
   }
+  return HTTP_CLIENT_READING_BODY;
+}
 
-  size_t old_len = _Client->decoded_body_len;
-  size_t add_len = (size_t)_Client->chunk_remaining;
-  size_t new_len = old_len + add_len;
-
-  uint8_t* newbuf = realloc(_Client->decoded_body, new_len + 1);
-  if (newbuf == NULL) {
+/* Streamed counterpart of read_body, only the part not handed out yet is buffered. An unframed
+ * body ends when the server closes the connection */
+static HTTPClientState http_client_stream_body(HTTP_Client* _Client)
+{
+  if (http_client_stream_buffered(_Client) != SUCCESS) {
     return HTTP_CLIENT_ERROR;
   }
-  _Client->decoded_body = newbuf;
 
-  memcpy(_Client->decoded_body + old_len, _Client->recv_buf->addr, add_len);
-  _Client->decoded_body_len      = new_len;
-  _Client->decoded_body[new_len] = '\0';
-
-  // Move read data out of tcpbuffer
-  if (_Client->recv_buf->size > (ssize_t)_Client->chunk_remaining) {
-    memmove(_Client->recv_buf->addr, _Client->recv_buf->addr + _Client->chunk_remaining,
-            _Client->recv_buf->size - _Client->chunk_remaining);
+  if (_Client->chunked == 0 && _Client->body_received >= _Client->content_length) {
+    _Client->retries = 0;
+    return HTTP_CLIENT_RETURNING;
   }
 
-  _Client->recv_buf->size -= _Client->chunk_remaining;
-  _Client->chunk_remaining = 0;
-
-  if (_Client->recv_buf->size < 2) {
-    // NO CRLF (End of line) found
-    uint8_t read_buf[1024];
-    int     bytes_read = transport_read(&_Client->transport, read_buf, sizeof(read_buf));
-
-    if (bytes_read < 0) {
-      if (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR) {
-        return HTTP_CLIENT_READING_BODY_CHUNKED;
-      }
-      perror("chunck recv");
-      return HTTP_CLIENT_ERROR;
-    }
+  if (http_client_can_splice(_Client)) {
+    return http_client_splice_body(_Client);
+  }
 
-    if (bytes_read == 0) {
-      // Connection closed
-      return HTTP_CLIENT_ERROR;
-    }
+  int bytes_read = http_client_fill(_Client);
 
-    if (buffer_append((void**)&_Client->recv_buf->addr, (size_t*)&_Client->recv_buf->size, read_buf,
-                      (size_t)bytes_read) < 0) {
-      return HTTP_CLIENT_ERROR;
+  if (bytes_read < 0) {
+    if (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR) {
+      return http_client_wait_io(_Client, HTTP_CLIENT_READING_BODY);
     }
-
-    return HTTP_CLIENT_READING_BODY_CHUNKED;
+    perror("recv body");
+    return HTTP_CLIENT_ERROR;
   }
 
-  if (_Client->recv_buf->addr[0] != '\r' || _Client->recv_buf->addr[1] != '\n') {
+  if (bytes_read == 0) {
+    if (_Client->chunked == -1) {
+      return HTTP_CLIENT_RETURNING;
+    }
+    printf("Connection closed before full body was recieved\r\n");
     return HTTP_CLIENT_ERROR;
   }
 
-  // Consume the CRLF (end of line)
-  memmove(_Client->recv_buf->addr, _Client->recv_buf->addr + 2, _Client->recv_buf->size - 2);
-  _Client->recv_buf->size -= 2;
-
-  return HTTP_CLIENT_DECIPHER_CHONKINESS;
+  return HTTP_CLIENT_READING_BODY;
 }
 
 HTTPClientState http_client_worktask_read_body(HTTP_Client* _Client)
@@ -821,38 +1734,28 @@ HTTPClientState http_client_worktask_read_body(HTTP_Client* _Client)
     return HTTP_CLIENT_ERROR;
   }
 
-  unsigned int READ_BUF_SIZE = 1024;
-
-  uint8_t read_buf[READ_BUF_SIZE];
+  if (http_client_streaming(_Client)) {
+    return http_client_stream_body(_Client);
+  }
 
-  int bytes_read = transport_read(&_Client->transport, read_buf, READ_BUF_SIZE - 1);
-  // printf("Buf: %s\n", tcp_buf);
+  int bytes_read = http_client_fill(_Client);
 
   if (bytes_read < 0) {
     if (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR) {
-      return HTTP_CLIENT_READING_BODY;
+      return http_client_wait_io(_Client, HTTP_CLIENT_READING_BODY);
     }
     perror("recv body");
     return HTTP_CLIENT_ERROR;
   }
 
-  if (bytes_read == 0 && _Client->recv_buf->size < (ssize_t)_Client->content_length) {
+  size_t readable = byte_buffer_readable(&_Client->recv_buf);
+
+  if (bytes_read == 0 && readable < _Client->content_length) {
     printf("Connection closed before full body was recieved\r\n");
     return HTTP_CLIENT_ERROR;
   }
 
-  if (bytes_read > 0) {
-    read_buf[bytes_read] = '\0';
-    ssize_t bytes_stored =
-        buffer_append((void**)&_Client->recv_buf->addr, (size_t*)&_Client->recv_buf->size, read_buf,
-                      (size_t)bytes_read);
-
-    if (bytes_stored < 0) {
-      return HTTP_CLIENT_ERROR;
-    }
-  }
-
-  if (_Client->recv_buf->size < (ssize_t)_Client->content_length) {
+  if (readable < _Client->content_length) {
     /*Keep reading body on next work call*/
     return HTTP_CLIENT_READING_BODY;
   }
@@ -861,83 +1764,180 @@ HTTPClientState http_client_worktask_read_body(HTTP_Client* _Client)
   return HTTP_CLIENT_RETURNING;
 }
 
-HTTPClientState http_client_worktask_returning(HTTP_Client* _Client)
+/* Drops the parsed response so the next pipelined one can be read into the same client */
+static void http_client_reset_response(HTTP_Client* _Client)
 {
-  if (!_Client || !_Client->recv_buf) {
-    return HTTP_CLIENT_ERROR;
+  http_parser_dispose(NULL, _Client->resp);
+  http_header_table_clear(&_Client->headers);
+
+  byte_buffer_clear(&_Client->decoded_body);
+  _Client->content_length  = 0;
+  _Client->chunked         = -1;
+  _Client->keep_alive      = false;
+}
+
+/* Takes the finished body out of the client as a NUL-terminated malloc'd string. When the body
+ * is all that is buffered the buffer itself is handed over, otherwise only the body is copied
+ * and bytes past it (the next pipelined response) stay in recv_buf */
+static char* http_client_take_body(HTTP_Client* _Client, size_t* _len_out)
+{
+  if (_Client->chunked == 1) {
+    return (char*)byte_buffer_detach(&_Client->decoded_body, _len_out);
   }
 
-  uint8_t* src     = NULL;
-  size_t   src_len = 0;
+  Byte_Buffer* Recv     = &_Client->recv_buf;
+  size_t       readable = byte_buffer_readable(Recv);
 
-  if (_Client->decoded_body != NULL && _Client->decoded_body_len > 0) {
-    src     = _Client->decoded_body;
-    src_len = _Client->decoded_body_len;
-  } else {
-    src     = (uint8_t*)_Client->recv_buf->addr;
-    src_len = (size_t)_Client->recv_buf->size;
+  // Unframed body runs to EOF, nothing can follow it on this connection
+  if (_Client->chunked == -1 || readable <= _Client->content_length) {
+    return (char*)byte_buffer_detach(Recv, _len_out);
   }
 
-  if (_Client->blocking_mode) {
-    if (!_Client->blocking_out) {
-      return HTTP_CLIENT_ERROR;
-    }
+  size_t len  = _Client->content_length;
+  char*  body = malloc(len + 1);
+  if (!body) {
+    return NULL;
+  }
 
-    if (_Client->blocking_out->addr) {
-      free(_Client->blocking_out->addr);
-      _Client->blocking_out->addr = NULL;
-      _Client->blocking_out->size = 0;
-    }
+  memcpy(body, byte_buffer_read_ptr(Recv), len);
+  body[len] = '\0';
+  byte_buffer_consume(Recv, len);
 
-    uint8_t* buf = malloc(src_len + 1);
-    if (!buf) {
-      return HTTP_CLIENT_ERROR;
-    }
+  *_len_out = len;
+  return body;
+}
+
+/* Hands response pipeline_index to the caller and moves on to the next one */
+static HTTPClientState http_client_pipeline_deliver(HTTP_Client* _Client, char* _response)
+{
+  int  index = _Client->pipeline_index++;
+  bool last  = _Client->pipeline_index == _Client->pipeline_count;
+
+  if (last) {
+    http_client_release_transport(_Client, _Client->keep_alive &&
+                                               byte_buffer_readable(&_Client->recv_buf) == 0);
+  }
+
+  _Client->on_pipeline_response(_Client->context, index, &_response);
+
+  if (last) {
+    return HTTP_CLIENT_DISPOSING;
+  }
+
+  // The server is closing, whatever is still queued will not be answered
+  if (!_Client->keep_alive) {
+    return HTTP_CLIENT_ERROR;
+  }
+
+  http_client_reset_response(_Client);
+  return HTTP_CLIENT_READING_FIRSTLINE;
+}
+
+/* Tells the caller which pipelined requests never got a response */
+static void http_client_pipeline_fail(HTTP_Client* _Client)
+{
+  if (!_Client->pipeline_paths) {
+    return;
+  }
+
+  while (_Client->pipeline_index < _Client->pipeline_count) {
+    char* response_out = NULL;
+    _Client->on_pipeline_response(_Client->context, _Client->pipeline_index++, &response_out);
+  }
+}
+
+HTTPClientState http_client_worktask_returning(HTTP_Client* _Client)
+{
+  if (!_Client) {
+    return HTTP_CLIENT_ERROR;
+  }
 
-    if (src_len) {
-      memcpy(buf, src, src_len);
+  if (http_client_streaming(_Client)) {
+    // The body went out as it arrived, only the connection is left to hand back
+    http_client_release_transport(_Client, _Client->keep_alive &&
+                                               byte_buffer_readable(&_Client->recv_buf) == 0);
+    if (_Client->on_done) {
+      _Client->on_done(_Client->context, SUCCESS);
     }
-    buf[src_len]                = '\0';
-    _Client->blocking_out->addr = buf;
-    _Client->blocking_out->size = (ssize_t)src_len;
     return HTTP_CLIENT_DISPOSING;
   }
 
-  if (!_Client->on_success) {
+  if (!_Client->pipeline_paths &&
+      (_Client->blocking_mode ? !_Client->blocking_out : !_Client->on_success)) {
     return HTTP_CLIENT_ERROR;
   }
 
-  char* response_out = malloc(src_len + 1);
+  size_t response_len = 0;
+  char*  response_out = http_client_take_body(_Client, &response_len);
   if (!response_out) {
     return HTTP_CLIENT_ERROR;
   }
 
-  if (src_len) {
-    memcpy(response_out, src, src_len);
+  if (_Client->pipeline_paths) {
+    return http_client_pipeline_deliver(_Client, response_out);
+  }
+
+  /* The whole response has been read. Reuse needs the stream to end exactly at the body,
+   * anything past it would be read as the start of the next response */
+  http_client_release_transport(_Client, _Client->keep_alive &&
+                                             byte_buffer_readable(&_Client->recv_buf) == 0);
+
+  if (_Client->blocking_mode) {
+    free(_Client->blocking_out->addr);
+    _Client->blocking_out->addr = (uint8_t*)response_out;
+    _Client->blocking_out->size = (ssize_t)response_len;
+    return HTTP_CLIENT_DISPOSING;
   }
 
-  response_out[src_len] = '\0';
   _Client->on_success(_Client->context, &response_out);
 
   return HTTP_CLIENT_DISPOSING;
 }
 
+static bool http_client_is_reading(HTTPClientState _state)
+{
+  return _state == HTTP_CLIENT_READING_FIRSTLINE || _state == HTTP_CLIENT_READING_HEADERS ||
+         _state == HTTP_CLIENT_DECIPHER_CHONKINESS || _state == HTTP_CLIENT_READING_BODY_CHUNKED ||
+         _state == HTTP_CLIENT_READING_BODY;
+}
+
+static void http_client_step(HTTP_Client* client);
+
 void http_client_taskwork(void* _context, uint64_t _montime)
 {
   if (!_context) {
     return;
   }
 
-
-  (void)_montime;
   HTTP_Client* client = (HTTP_Client*)_context;
 
-  static HTTPClientState last = -1;
-  if (client->state != last) {
-    last = client->state;
+  // Run again next tick unless the state parks us on the reactor or a retry delay
+  client->next_retry_at = _montime;
+  client->tick_bytes    = 0;
+
+  /* Keep sending and reading until the socket is full or runs dry (the state parks us), a
+   * step makes no progress or the tick budget is spent, then let the other tasks run */
+  HTTPClientState prev_state;
+  size_t          prev_bytes;
+  do {
+    prev_state = client->state;
+    prev_bytes = client->tick_bytes;
+    http_client_step(client);
+  } while ((http_client_is_reading(client->state) ||
+            client->state == HTTP_CLIENT_SENDING_REQUEST) &&
+           client->next_retry_at == _montime &&
+           client->tick_bytes < HTTP_CLIENT_TICK_BUDGET &&
+           (client->tick_bytes > prev_bytes || client->state != prev_state));
+
+  /* Let the scheduler park us until the next retry instead of polling every tick.
+   * The task is gone if the client disposed itself above */
+  if (client->task) {
+    scheduler_task_set_due(client->task, client->next_retry_at);
   }
-  uint64_t now = SystemMonotonicMS();
+}
 
+static void http_client_step(HTTP_Client* client)
+{
   switch (client->state) {
 
   case HTTP_CLIENT_INITIALIZING: {
@@ -945,11 +1945,8 @@ void http_client_taskwork(void* _context, uint64_t _montime)
     break;
   }
   case HTTP_CLIENT_CONNECTING: {
-    if (now >= client->next_retry_at) {
-      // printf("HTTP_CLIENT_CONNECTING\n");
-      client->state = http_client_worktask_connecting(client);
-      break;
-    }
+    // printf("HTTP_CLIENT_CONNECTING\n");
+    client->state = http_client_worktask_connecting(client);
     break;
   }
   case HTTP_CLIENT_WAITING_CONNECT: {
@@ -964,26 +1961,17 @@ void http_client_taskwork(void* _context, uint64_t _montime)
   }
   case HTTP_CLIENT_SENDING_REQUEST: {
     // printf("HTTP_CLIENT_SENDING_REQUEST\n");
-    if (now >= client->next_retry_at) {
-      client->state = http_client_worktask_send_request(client);
-      break;
-    }
+    client->state = http_client_worktask_send_request(client);
     break;
   }
   case HTTP_CLIENT_READING_FIRSTLINE: {
     // printf("HTTP_CLIENT_READING_FIRSTLINE\n");
-    if (now >= client->next_retry_at) {
-      client->state = http_client_worktask_read_firstline(client);
-      break;
-    }
+    client->state = http_client_worktask_read_firstline(client);
     break;
   }
   case HTTP_CLIENT_READING_HEADERS: {
     // printf("HTTP_CLIENT_READING_HEADERS\n");
-    if (now >= client->next_retry_at) {
-      client->state = http_client_worktask_read_headers(client);
-      break;
-    }
+    client->state = http_client_worktask_read_headers(client);
     break;
   }
   case HTTP_CLIENT_DECIPHER_CHONKINESS: {
@@ -999,10 +1987,7 @@ void http_client_taskwork(void* _context, uint64_t _montime)
 
   case HTTP_CLIENT_READING_BODY: {
     // printf("HTTP_CLIENT_READING_BODY\n");
-    if (now >= client->next_retry_at) {
-      client->state = http_client_worktask_read_body(client);
-      break;
-    }
+    client->state = http_client_worktask_read_body(client);
     break;
   }
   case HTTP_CLIENT_RETURNING: {
@@ -1012,6 +1997,10 @@ void http_client_taskwork(void* _context, uint64_t _montime)
   }
   case HTTP_CLIENT_ERROR: {
     printf("HTTP_CLIENT_ERROR\n");
+    http_client_pipeline_fail(client);
+    if (client->on_done) {
+      client->on_done(client->context, client->body_error ? client->body_error : ERR_IO);
+    }
     client->state = HTTP_CLIENT_DISPOSING;
     break;
   }
@@ -1033,15 +2022,15 @@ void http_client_dispose(HTTP_Client* _Client)
     return;
   }
 
+  // Unwatches before the fd is closed, a connection still held here is mid-response
+  http_client_release_transport(_Client, false);
+
   // Stop task if any (safe even if NULL)
   if (_Client->task) {
     scheduler_destroy_task(_Client->task);
     _Client->task = NULL;
   }
 
-  // Transport cleanup
-  transport_dispose(&_Client->transport);
-
   // URL
   if (_Client->URL) {
     free((void*)_Client->URL);
@@ -1069,18 +2058,27 @@ void http_client_dispose(HTTP_Client* _Client)
     _Client->request_buffer = NULL;
   }
 
-  // Chunk decoded body
-  if (_Client->decoded_body) {
-    free(_Client->decoded_body);
-    _Client->decoded_body     = NULL;
-    _Client->decoded_body_len = 0;
-  }
-
-  // Internal recv buffer storage (resp_buf)
-  if (_Client->resp_buf.addr) {
-    free(_Client->resp_buf.addr);
-    _Client->resp_buf.addr = NULL;
-    _Client->resp_buf.size = 0;
+  // Pipelined request targets
+  if (_Client->pipeline_paths) {
+    for (int i = 0; i < _Client->pipeline_count; i++) {
+      free(_Client->pipeline_paths[i]);
+    }
+    free(_Client->pipeline_paths);
+    _Client->pipeline_paths = NULL;
+    _Client->pipeline_count = 0;
+  }
+
+  // Chunk decoded body and unparsed response bytes
+  byte_buffer_dispose(&_Client->decoded_body);
+  byte_buffer_dispose(&_Client->recv_buf);
+  byte_buffer_dispose(&_Client->send_stage);
+  http_header_table_clear(&_Client->headers);
+
+  // Download splice pipe
+  if (_Client->splice_open) {
+    close(_Client->splice_pipe[0]);
+    close(_Client->splice_pipe[1]);
+    _Client->splice_open = false;
   }
 }
 
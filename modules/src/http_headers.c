@@ -0,0 +1,182 @@
+#include <maestromodules/http_headers.h>
+#include <maestromodules/http_scan.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+
+/* Known names only need the length and one compare of the lowercased name */
+HTTP_Header_Id http_header_id(const char* _name, size_t _len)
+{
+  static const char* const known[HTTP_HEADER_KNOWN_COUNT] = {
+      [HTTP_HEADER_CONTENT_LENGTH]    = "content-length",
+      [HTTP_HEADER_TRANSFER_ENCODING] = "transfer-encoding",
+      [HTTP_HEADER_CONTENT_TYPE]      = "content-type",
+      [HTTP_HEADER_ETAG]              = "etag",
+      [HTTP_HEADER_CONNECTION]        = "connection",
+      [HTTP_HEADER_LOCATION]          = "location",
+  };
+
+  HTTP_Header_Id id;
+  switch (_len) {
+  case 4:
+    id = HTTP_HEADER_ETAG;
+    break;
+  case 8:
+    id = HTTP_HEADER_LOCATION;
+    break;
+  case 10:
+    id = HTTP_HEADER_CONNECTION;
+    break;
+  case 12:
+    id = HTTP_HEADER_CONTENT_TYPE;
+    break;
+  case 14:
+    id = HTTP_HEADER_CONTENT_LENGTH;
+    break;
+  case 17:
+    id = HTTP_HEADER_TRANSFER_ENCODING;
+    break;
+  default:
+    return HTTP_HEADER_OTHER;
+  }
+
+  if (!_name) {
+    return HTTP_HEADER_OTHER;
+  }
+
+  uint8_t lower[17];
+  http_scan_lower(lower, (const uint8_t*)_name, _len);
+
+  return memcmp(lower, known[id], _len) == 0 ? id : HTTP_HEADER_OTHER;
+}
+
+static int http_header_is_space(char _ch)
+{
+  return _ch == ' ' || _ch == '\t' || _ch == '\r' || _ch == '\n';
+}
+
+/* Position of the next CRLF at or after _pos, or _len when there is none */
+static size_t http_header_line_end(const char* _buf, size_t _len, size_t _pos)
+{
+  return _pos + http_scan_crlf((const uint8_t*)_buf + _pos, _len - _pos);
+}
+
+int http_header_table_parse(HTTP_Header_Table* _Table, const char* _buf, size_t _buf_len)
+{
+  if (!_Table || (!_buf && _buf_len > 0) || _buf_len >= UINT32_MAX) {
+    return ERR_INVALID_ARG;
+  }
+
+  http_header_table_clear(_Table);
+
+  // Every header ends in \n, so this bounds the entries
+  size_t lines = 0;
+  for (const char* p = _buf; p && (p = memchr(p, '\n', (size_t)(_buf + _buf_len - p))); p++) {
+    lines++;
+  }
+
+  size_t array_size = lines * sizeof(HTTP_Header);
+  char*  block      = malloc(array_size + _buf_len + 1);
+  if (!block) {
+    perror("malloc");
+    return ERR_NO_MEMORY;
+  }
+
+  HTTP_Header* entries = (HTTP_Header*)block;
+  char*        arena   = block + array_size;
+  if (_buf_len > 0) {
+    memcpy(arena, _buf, _buf_len);
+  }
+  arena[_buf_len] = '\0';
+
+  _Table->entries = entries;
+  _Table->arena   = arena;
+
+  size_t start = 0;
+  while (start < _buf_len) {
+    size_t line_end = http_header_line_end(arena, _buf_len, start);
+    if (line_end == _buf_len || line_end == start) {
+      break; // Unterminated last line, or the empty line ending the block
+    }
+
+    char* colon = memchr(arena + start, ':', line_end - start);
+    if (!colon) {
+      http_header_table_clear(_Table);
+      return ERR_BAD_FORMAT;
+    }
+
+    size_t name_end = (size_t)(colon - arena);
+    while (name_end > start && http_header_is_space(arena[name_end - 1])) {
+      name_end--;
+    }
+
+    // Names are tokens, anything else would let a broken line pass as a header
+    size_t name_len = name_end - start;
+    if (name_len == 0 || http_scan_token((const uint8_t*)arena + start, name_len) != name_len) {
+      http_header_table_clear(_Table);
+      return ERR_BAD_FORMAT;
+    }
+
+    size_t value = (size_t)(colon - arena) + 1;
+    while (value < line_end && (arena[value] == ' ' || arena[value] == '\t')) {
+      value++;
+    }
+    size_t value_end = line_end;
+    while (value_end > value && http_header_is_space(arena[value_end - 1])) {
+      value_end--;
+    }
+
+    arena[name_end]  = '\0';
+    arena[value_end] = '\0';
+
+    HTTP_Header* Header = &entries[_Table->count];
+    Header->name        = (uint32_t)start;
+    Header->name_len    = (uint32_t)name_len;
+    Header->value       = (uint32_t)value;
+    Header->value_len   = (uint32_t)(value_end - value);
+    Header->id          = http_header_id(arena + start, Header->name_len);
+
+    _Table->count++;
+    if (Header->id != HTTP_HEADER_OTHER && _Table->known[Header->id] == 0) {
+      _Table->known[Header->id] = _Table->count;
+    }
+
+    start = line_end + 2;
+  }
+
+  return SUCCESS;
+}
+
+const char* http_header_table_find(const HTTP_Header_Table* _Table, const char* _name)
+{
+  if (!_Table || !_name) {
+    return NULL;
+  }
+
+  size_t         len = strlen(_name);
+  HTTP_Header_Id id  = http_header_id(_name, len);
+  if (id != HTTP_HEADER_OTHER) {
+    return http_header_table_get(_Table, id);
+  }
+
+  for (int i = 0; i < _Table->count; i++) {
+    const HTTP_Header* Header = &_Table->entries[i];
+    if (Header->name_len == len && strcasecmp(_Table->arena + Header->name, _name) == 0) {
+      return _Table->arena + Header->value;
+    }
+  }
+
+  return NULL;
+}
+
+void http_header_table_clear(HTTP_Header_Table* _Table)
+{
+  if (!_Table) {
+    return;
+  }
+
+  free(_Table->entries);
+  memset(_Table, 0, sizeof(HTTP_Header_Table));
+}
@@ -1,6 +1,7 @@
 #include <maestromodules/http_client.h>
 #include <maestromodules/linked_list.h>
 #include <maestromodules/http_parser.h>
+#include <maestromodules/http_scan.h>
 #include <stdio.h>
 
 void http_parser_dispose(HTTP_Request* _Req, HTTP_Response* _Resp);
@@ -201,6 +202,7 @@ int http_parser_response_firstline(const char* _line, size_t _line_len, HTTP_Res
     http_parser_dispose(NULL, _Resp);
     return ERR_BAD_FORMAT;
   }
+  _Resp->status_code = (HttpStatus_Code)status_int;
 
   if (line_copy != NULL)
     free(line_copy);
@@ -209,31 +211,22 @@ int http_parser_response_firstline(const char* _line, size_t _line_len, HTTP_Res
 
 int http_parser_find_line_end(const uint8_t* _buf, size_t _buf_len)
 {
-  if (_buf_len < 2) {
+  if (!_buf || _buf_len < 2) {
     return -1;
   }
 
-  size_t i;
-  for (i = 0; i + 1 < _buf_len; i++) {
-    if (_buf[i] == '\r' && _buf[i + 1] == '\n') {
-      return (int)i;
-    }
-  }
-  return -1;
+  size_t pos = http_scan_crlf(_buf, _buf_len);
+  return pos < _buf_len ? (int)pos : -1;
 }
 
 int http_parser_find_headers_end(const uint8_t* _buf, size_t _buf_len)
 {
-  if (_buf_len < 4) {
+  if (!_buf || _buf_len < 4) {
     return -1;
   }
-  size_t i;
-  for (i = 0; i + 3 < _buf_len; i++) {
-    if (_buf[i] == '\r' && _buf[i + 1] == '\n' && _buf[i + 2] == '\r' && _buf[i + 3] == '\n') {
-      return (int)i;
-    }
-  }
-  return -1;
+
+  size_t pos = http_scan_headers_end(_buf, _buf_len);
+  return pos < _buf_len ? (int)pos : -1;
 }
 
 int http_parser_headers(const char* _buf, size_t _buf_len, Linked_List** _headers_out)
@@ -242,110 +235,48 @@ int http_parser_headers(const char* _buf, size_t _buf_len, Linked_List** _header
     return ERR_INVALID_ARG;
   }
 
+  // Compatibility shim over HTTP_Header_Table, every header becomes its own list item
+  HTTP_Header_Table Table = {0};
+  int               res   = http_header_table_parse(&Table, _buf, _buf_len);
+  if (res != SUCCESS) {
+    *_headers_out = NULL;
+    return res;
+  }
+
   *_headers_out = linked_list_create();
   if (!*(_headers_out)) {
+    http_header_table_clear(&Table);
     return ERR_NO_MEMORY;
   }
 
-  size_t start = 0;
-  while (start < _buf_len) {
-
-    int    line_end = -1;
-    size_t i;
-
-    for (i = start; i + 1 < _buf_len; i++) {
-      if (_buf[i] == '\r' && _buf[i + 1] == '\n') {
-        line_end = (int)i;
-        break;
-      }
-    }
-
-    if (line_end < 0)
-      break;
-
-    size_t line_len = (size_t)line_end - start;
-
-    if (line_len == 0) {
-      start = line_end + 2;
-      break;
-    }
-
-    char* line = (char*)malloc(line_len + 1);
-    if (!line) {
-      perror("malloc");
-      http_parser_dispose_linked_list(*_headers_out);
-      *_headers_out = NULL;
-      return ERR_NO_MEMORY;
-    }
-
-    memcpy(line, _buf + start, line_len);
-    line[line_len] = '\0';
-
-    char* colon = strchr(line, ':');
-    if (!colon) {
-      if (line != NULL)
-        free(line);
-      http_parser_dispose_linked_list(*_headers_out);
-      *_headers_out = NULL;
-      return ERR_BAD_FORMAT;
-    }
-
-    *colon      = '\0';
-    char* key   = line;
-    char* value = colon + 1;
-
-    /*Ignore leading whitespace or tabs by moving pointer forward*/
-    while (*value == ' ' || *value == '\t') {
-      value++;
-    }
-
-    /*Remove trailing whitespace from key*/
-    /*end is '\0' so we want to look for the char before it*/
-    char* end = key + (strlen(key));
-    while (end > key && (end[-1] == ' ' || end[-1] == '\t' || end[-1] == '\r' || end[-1] == '\n')) {
-
-      *--end = '\0';
-    }
-
-    /*Same thing for value, remove whitespace or unwanted chars*/
-    end = value + strlen(value);
-    while (end > value &&
-           (end[-1] == ' ' || end[-1] == '\t' || end[-1] == '\r' || end[-1] == '\n')) {
-      *--end = '\0';
-    }
-
+  for (int i = 0; i < Table.count; i++) {
     HTTP_Key_Value* header = (HTTP_Key_Value*)malloc(sizeof(HTTP_Key_Value));
     if (!header) {
       perror("malloc");
-      if (line != NULL)
-        free(line);
+      http_header_table_clear(&Table);
       http_parser_dispose_linked_list(*_headers_out);
       *_headers_out = NULL;
       return ERR_NO_MEMORY;
     }
 
-    header->key   = strdup(key);
-    header->value = strdup(value);
+    header->key   = strdup(http_header_table_name(&Table, i));
+    header->value = strdup(http_header_table_value(&Table, i));
 
     if (!header->key || !header->value) {
       perror("strdup");
       free(header->key);
       free(header->value);
       free(header);
-      if (line != NULL)
-        free(line);
+      http_header_table_clear(&Table);
       http_parser_dispose_linked_list(*_headers_out);
       *_headers_out = NULL;
       return ERR_NO_MEMORY;
     }
 
     linked_list_item_add(*(_headers_out), NULL, header);
-
-    if (line != NULL)
-      free(line);
-    start = line_end + 2;
   }
 
+  http_header_table_clear(&Table);
   return SUCCESS;
 }
 
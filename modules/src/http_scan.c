@@ -0,0 +1,340 @@
+#include <maestromodules/http_scan.h>
+
+#include <string.h>
+
+#if !defined(HTTP_SCAN_SCALAR) && defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define HTTP_SCAN_X86 1
+#include <immintrin.h>
+#endif
+
+typedef struct
+{
+  HTTP_Scan_Level level;
+
+  size_t (*crlf)(const uint8_t* _buf, size_t _len);
+  size_t (*headers_end)(const uint8_t* _buf, size_t _len);
+  size_t (*token)(const uint8_t* _buf, size_t _len);
+  void (*lower)(uint8_t* _dst, const uint8_t* _src, size_t _len);
+
+} HTTP_Scan_Kernels;
+
+/* RFC 9110 tchar: "!#$%&'*+-.^_`|~", digits and letters */
+static const uint8_t http_scan_tchar[256] = {
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, // 0x00
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, // 0x10
+    0, 1, 0, 1, 1, 1, 1, 1, 0, 0, 1, 1, 0, 1, 1, 0, // 0x20  !"#$%&'()*+,-./
+    1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 0, 0, 0, 0, 0, 0, // 0x30 0-9 :;<=>?
+    0, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, // 0x40 @A-O
+    1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 0, 0, 0, 1, 1, // 0x50 P-Z [\]^_
+    1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, // 0x60 `a-o
+    1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 0, 1, 0, 1, 0, // 0x70 p-z {|}~ DEL
+};
+
+/* ---------------------------- Scalar ---------------------------- */
+
+static size_t http_scan_crlf_scalar(const uint8_t* _buf, size_t _len)
+{
+  size_t pos = 0;
+  while (pos + 1 < _len) {
+    const uint8_t* cr = memchr(_buf + pos, '\r', _len - pos - 1);
+    if (!cr) {
+      break;
+    }
+    pos = (size_t)(cr - _buf);
+    if (_buf[pos + 1] == '\n') {
+      return pos;
+    }
+    pos++;
+  }
+  return _len;
+}
+
+static size_t http_scan_headers_end_scalar(const uint8_t* _buf, size_t _len)
+{
+  size_t pos = 0;
+  while (pos + 3 < _len) {
+    size_t line = http_scan_crlf_scalar(_buf + pos, _len - pos - 2);
+    if (line == _len - pos - 2) {
+      break;
+    }
+    pos += line;
+    if (_buf[pos + 2] == '\r' && _buf[pos + 3] == '\n') {
+      return pos;
+    }
+    pos += 2;
+  }
+  return _len;
+}
+
+static size_t http_scan_token_scalar(const uint8_t* _buf, size_t _len)
+{
+  size_t i = 0;
+  while (i < _len && http_scan_tchar[_buf[i]]) {
+    i++;
+  }
+  return i;
+}
+
+static void http_scan_lower_scalar(uint8_t* _dst, const uint8_t* _src, size_t _len)
+{
+  for (size_t i = 0; i < _len; i++) {
+    uint8_t ch = _src[i];
+    _dst[i]    = (ch >= 'A' && ch <= 'Z') ? (uint8_t)(ch | 0x20) : ch;
+  }
+}
+
+static const HTTP_Scan_Kernels http_scan_scalar_kernels = {
+    HTTP_SCAN_LEVEL_SCALAR, http_scan_crlf_scalar, http_scan_headers_end_scalar,
+    http_scan_token_scalar, http_scan_lower_scalar};
+
+#ifdef HTTP_SCAN_X86
+
+/* Byte compares are signed, which is fine as long as the bounds are ASCII: bytes >= 0x80 come
+ * out negative and fall below every range */
+#define HTTP_SCAN_RANGE128(v, lo, hi)                                                              \
+  _mm_and_si128(_mm_cmpgt_epi8((v), _mm_set1_epi8((char)((lo) - 1))),                             \
+                _mm_cmplt_epi8((v), _mm_set1_epi8((char)((hi) + 1))))
+#define HTTP_SCAN_EQ128(v, ch) _mm_cmpeq_epi8((v), _mm_set1_epi8((char)(ch)))
+
+#define HTTP_SCAN_RANGE256(v, lo, hi)                                                              \
+  _mm256_and_si256(_mm256_cmpgt_epi8((v), _mm256_set1_epi8((char)((lo) - 1))),                    \
+                   _mm256_cmpgt_epi8(_mm256_set1_epi8((char)((hi) + 1)), (v)))
+#define HTTP_SCAN_EQ256(v, ch) _mm256_cmpeq_epi8((v), _mm256_set1_epi8((char)(ch)))
+
+/* ----------------------------- SSE2 ----------------------------- */
+
+__attribute__((target("sse2"))) static size_t http_scan_crlf_sse2(const uint8_t* _buf,
+                                                                   size_t         _len)
+{
+  size_t i = 0;
+
+  // Each step checks 16 positions, the \n of the last one is the 17th byte
+  for (; i + 17 <= _len; i += 16) {
+    __m128i cr = HTTP_SCAN_EQ128(_mm_loadu_si128((const __m128i*)(_buf + i)), '\r');
+    __m128i lf = HTTP_SCAN_EQ128(_mm_loadu_si128((const __m128i*)(_buf + i + 1)), '\n');
+
+    unsigned mask = (unsigned)_mm_movemask_epi8(_mm_and_si128(cr, lf));
+    if (mask) {
+      return i + (size_t)__builtin_ctz(mask);
+    }
+  }
+
+  return i + http_scan_crlf_scalar(_buf + i, _len - i);
+}
+
+__attribute__((target("sse2"))) static size_t http_scan_headers_end_sse2(const uint8_t* _buf,
+                                                                          size_t         _len)
+{
+  size_t i = 0;
+
+  for (; i + 19 <= _len; i += 16) {
+    __m128i a = HTTP_SCAN_EQ128(_mm_loadu_si128((const __m128i*)(_buf + i)), '\r');
+    __m128i b = HTTP_SCAN_EQ128(_mm_loadu_si128((const __m128i*)(_buf + i + 1)), '\n');
+    __m128i c = HTTP_SCAN_EQ128(_mm_loadu_si128((const __m128i*)(_buf + i + 2)), '\r');
+    __m128i d = HTTP_SCAN_EQ128(_mm_loadu_si128((const __m128i*)(_buf + i + 3)), '\n');
+
+    unsigned mask =
+        (unsigned)_mm_movemask_epi8(_mm_and_si128(_mm_and_si128(a, b), _mm_and_si128(c, d)));
+    if (mask) {
+      return i + (size_t)__builtin_ctz(mask);
+    }
+  }
+
+  return i + http_scan_headers_end_scalar(_buf + i, _len - i);
+}
+
+__attribute__((target("sse2"))) static size_t http_scan_token_sse2(const uint8_t* _buf,
+                                                                    size_t         _len)
+{
+  size_t i = 0;
+
+  for (; i + 16 <= _len; i += 16) {
+    __m128i v = _mm_loadu_si128((const __m128i*)(_buf + i));
+
+    // Outside ! to ~, or one of the separators "(),/:;<=>?@[\]{}
+    __m128i bad = _mm_or_si128(_mm_cmplt_epi8(v, _mm_set1_epi8(0x21)),
+                               _mm_cmpgt_epi8(v, _mm_set1_epi8(0x7E)));
+    bad         = _mm_or_si128(bad, HTTP_SCAN_RANGE128(v, '(', ')'));
+    bad         = _mm_or_si128(bad, HTTP_SCAN_RANGE128(v, ':', '@'));
+    bad         = _mm_or_si128(bad, HTTP_SCAN_RANGE128(v, '[', ']'));
+    bad         = _mm_or_si128(bad, _mm_or_si128(HTTP_SCAN_EQ128(v, '"'), HTTP_SCAN_EQ128(v, ',')));
+    bad         = _mm_or_si128(bad, _mm_or_si128(HTTP_SCAN_EQ128(v, '/'), HTTP_SCAN_EQ128(v, '{')));
+    bad         = _mm_or_si128(bad, HTTP_SCAN_EQ128(v, '}'));
+
+    unsigned mask = (unsigned)_mm_movemask_epi8(bad);
+    if (mask) {
+      return i + (size_t)__builtin_ctz(mask);
+    }
+  }
+
+  return i + http_scan_token_scalar(_buf + i, _len - i);
+}
+
+__attribute__((target("sse2"))) static void http_scan_lower_sse2(uint8_t* _dst, const uint8_t* _src,
+                                                                  size_t _len)
+{
+  size_t i = 0;
+
+  for (; i + 16 <= _len; i += 16) {
+    __m128i v     = _mm_loadu_si128((const __m128i*)(_src + i));
+    __m128i upper = HTTP_SCAN_RANGE128(v, 'A', 'Z');
+    _mm_storeu_si128((__m128i*)(_dst + i),
+                     _mm_or_si128(v, _mm_and_si128(upper, _mm_set1_epi8(0x20))));
+  }
+
+  http_scan_lower_scalar(_dst + i, _src + i, _len - i);
+}
+
+static const HTTP_Scan_Kernels http_scan_sse2_kernels = {
+    HTTP_SCAN_LEVEL_SSE2, http_scan_crlf_sse2, http_scan_headers_end_sse2, http_scan_token_sse2,
+    http_scan_lower_sse2};
+
+/* ----------------------------- AVX2 ----------------------------- */
+
+__attribute__((target("avx2"))) static size_t http_scan_crlf_avx2(const uint8_t* _buf,
+                                                                   size_t         _len)
+{
+  size_t i = 0;
+
+  for (; i + 33 <= _len; i += 32) {
+    __m256i cr = HTTP_SCAN_EQ256(_mm256_loadu_si256((const __m256i*)(_buf + i)), '\r');
+    __m256i lf = HTTP_SCAN_EQ256(_mm256_loadu_si256((const __m256i*)(_buf + i + 1)), '\n');
+
+    unsigned mask = (unsigned)_mm256_movemask_epi8(_mm256_and_si256(cr, lf));
+    if (mask) {
+      return i + (size_t)__builtin_ctz(mask);
+    }
+  }
+
+  return i + http_scan_crlf_sse2(_buf + i, _len - i);
+}
+
+__attribute__((target("avx2"))) static size_t http_scan_headers_end_avx2(const uint8_t* _buf,
+                                                                          size_t         _len)
+{
+  size_t i = 0;
+
+  for (; i + 35 <= _len; i += 32) {
+    __m256i a = HTTP_SCAN_EQ256(_mm256_loadu_si256((const __m256i*)(_buf + i)), '\r');
+    __m256i b = HTTP_SCAN_EQ256(_mm256_loadu_si256((const __m256i*)(_buf + i + 1)), '\n');
+    __m256i c = HTTP_SCAN_EQ256(_mm256_loadu_si256((const __m256i*)(_buf + i + 2)), '\r');
+    __m256i d = HTTP_SCAN_EQ256(_mm256_loadu_si256((const __m256i*)(_buf + i + 3)), '\n');
+
+    unsigned mask = (unsigned)_mm256_movemask_epi8(
+        _mm256_and_si256(_mm256_and_si256(a, b), _mm256_and_si256(c, d)));
+    if (mask) {
+      return i + (size_t)__builtin_ctz(mask);
+    }
+  }
+
+  return i + http_scan_headers_end_sse2(_buf + i, _len - i);
+}
+
+__attribute__((target("avx2"))) static size_t http_scan_token_avx2(const uint8_t* _buf,
+                                                                    size_t         _len)
+{
+  size_t i = 0;
+
+  for (; i + 32 <= _len; i += 32) {
+    __m256i v = _mm256_loadu_si256((const __m256i*)(_buf + i));
+
+    __m256i bad = _mm256_or_si256(_mm256_cmpgt_epi8(_mm256_set1_epi8(0x21), v),
+                                  _mm256_cmpgt_epi8(v, _mm256_set1_epi8(0x7E)));
+    bad = _mm256_or_si256(bad, HTTP_SCAN_RANGE256(v, '(', ')'));
+    bad = _mm256_or_si256(bad, HTTP_SCAN_RANGE256(v, ':', '@'));
+    bad = _mm256_or_si256(bad, HTTP_SCAN_RANGE256(v, '[', ']'));
+    bad = _mm256_or_si256(bad, _mm256_or_si256(HTTP_SCAN_EQ256(v, '"'), HTTP_SCAN_EQ256(v, ',')));
+    bad = _mm256_or_si256(bad, _mm256_or_si256(HTTP_SCAN_EQ256(v, '/'), HTTP_SCAN_EQ256(v, '{')));
+    bad = _mm256_or_si256(bad, HTTP_SCAN_EQ256(v, '}'));
+
+    unsigned mask = (unsigned)_mm256_movemask_epi8(bad);
+    if (mask) {
+      return i + (size_t)__builtin_ctz(mask);
+    }
+  }
+
+  return i + http_scan_token_sse2(_buf + i, _len - i);
+}
+
+__attribute__((target("avx2"))) static void http_scan_lower_avx2(uint8_t* _dst, const uint8_t* _src,
+                                                                  size_t _len)
+{
+  size_t i = 0;
+
+  for (; i + 32 <= _len; i += 32) {
+    __m256i v     = _mm256_loadu_si256((const __m256i*)(_src + i));
+    __m256i upper = HTTP_SCAN_RANGE256(v, 'A', 'Z');
+    _mm256_storeu_si256((__m256i*)(_dst + i),
+                        _mm256_or_si256(v, _mm256_and_si256(upper, _mm256_set1_epi8(0x20))));
+  }
+
+  http_scan_lower_sse2(_dst + i, _src + i, _len - i);
+}
+
+static const HTTP_Scan_Kernels http_scan_avx2_kernels = {
+    HTTP_SCAN_LEVEL_AVX2, http_scan_crlf_avx2, http_scan_headers_end_avx2, http_scan_token_avx2,
+    http_scan_lower_avx2};
+
+#endif // HTTP_SCAN_X86
+
+/* --------------------------- Dispatch --------------------------- */
+
+static const HTTP_Scan_Kernels* Http_Scan_Active = NULL;
+
+static const HTTP_Scan_Kernels* http_scan_kernels_for(HTTP_Scan_Level _level)
+{
+#ifdef HTTP_SCAN_X86
+  __builtin_cpu_init();
+  if (_level >= HTTP_SCAN_LEVEL_AVX2 && __builtin_cpu_supports("avx2")) {
+    return &http_scan_avx2_kernels;
+  }
+  if (_level >= HTTP_SCAN_LEVEL_SSE2 && __builtin_cpu_supports("sse2")) {
+    return &http_scan_sse2_kernels;
+  }
+#endif
+  (void)_level;
+  return &http_scan_scalar_kernels;
+}
+
+/* Resolved on first use. Threads racing here all store the same pointer */
+static inline const HTTP_Scan_Kernels* http_scan_kernels(void)
+{
+  const HTTP_Scan_Kernels* Kernels = __atomic_load_n(&Http_Scan_Active, __ATOMIC_ACQUIRE);
+  if (!Kernels) {
+    Kernels = http_scan_kernels_for(HTTP_SCAN_LEVEL_AVX2);
+    __atomic_store_n(&Http_Scan_Active, Kernels, __ATOMIC_RELEASE);
+  }
+  return Kernels;
+}
+
+size_t http_scan_crlf(const uint8_t* _buf, size_t _len)
+{
+  return http_scan_kernels()->crlf(_buf, _len);
+}
+
+size_t http_scan_headers_end(const uint8_t* _buf, size_t _len)
+{
+  return http_scan_kernels()->headers_end(_buf, _len);
+}
+
+size_t http_scan_token(const uint8_t* _buf, size_t _len)
+{
+  return http_scan_kernels()->token(_buf, _len);
+}
+
+void http_scan_lower(uint8_t* _dst, const uint8_t* _src, size_t _len)
+{
+  http_scan_kernels()->lower(_dst, _src, _len);
+}
+
+HTTP_Scan_Level http_scan_level(void)
+{
+  return http_scan_kernels()->level;
+}
+
+HTTP_Scan_Level http_scan_set_level(HTTP_Scan_Level _level)
+{
+  const HTTP_Scan_Kernels* Kernels = http_scan_kernels_for(_level);
+  __atomic_store_n(&Http_Scan_Active, Kernels, __ATOMIC_RELEASE);
+  return Kernels->level;
+}
@@ -0,0 +1,188 @@
+#define _POSIX_C_SOURCE 200809L
+#include <maestromodules/reactor.h>
+#include <maestroutils/time_utils.h>
+
+#include <errno.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+#if defined(__linux__)
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#endif
+
+int reactor_init(Reactor* _Reactor)
+{
+  if (!_Reactor)
+    return ERR_INVALID_ARG;
+
+  memset(_Reactor, 0, sizeof(Reactor));
+  _Reactor->epoll_fd = -1;
+  _Reactor->wake_fd  = -1;
+
+#if defined(__linux__)
+  _Reactor->epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+  if (_Reactor->epoll_fd < 0) {
+    perror("epoll_create1");
+    return ERR_IO;
+  }
+
+  _Reactor->ready = true;
+
+  _Reactor->wake_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+  if (_Reactor->wake_fd < 0) {
+    perror("eventfd");
+    reactor_dispose(_Reactor);
+    return ERR_IO;
+  }
+
+  /* data.ptr == NULL marks the wakeup fd */
+  struct epoll_event ev = {.events = EPOLLIN, .data.ptr = NULL};
+  if (epoll_ctl(_Reactor->epoll_fd, EPOLL_CTL_ADD, _Reactor->wake_fd, &ev) != 0) {
+    perror("epoll_ctl");
+    reactor_dispose(_Reactor);
+    return ERR_IO;
+  }
+
+  return SUCCESS;
+#else
+  return ERR_IO;
+#endif
+}
+
+int reactor_register(Reactor* _Reactor, int _fd, void* _owner)
+{
+  if (!_Reactor || _fd < 0 || !_owner)
+    return ERR_INVALID_ARG;
+
+  if (!_Reactor->ready)
+    return ERR_IO;
+
+#if defined(__linux__)
+  struct epoll_event ev = {.events = EPOLLONESHOT, .data.ptr = _owner};
+  if (epoll_ctl(_Reactor->epoll_fd, EPOLL_CTL_ADD, _fd, &ev) != 0) {
+    if (errno == EEXIST)
+      return epoll_ctl(_Reactor->epoll_fd, EPOLL_CTL_MOD, _fd, &ev) == 0 ? SUCCESS : ERR_IO;
+    perror("epoll_ctl add");
+    return ERR_IO;
+  }
+  return SUCCESS;
+#else
+  return ERR_IO;
+#endif
+}
+
+int reactor_arm(Reactor* _Reactor, int _fd, void* _owner, uint32_t _interest)
+{
+  if (!_Reactor || _fd < 0 || !_owner)
+    return ERR_INVALID_ARG;
+
+  if (!_Reactor->ready)
+    return ERR_IO;
+
+#if defined(__linux__)
+  struct epoll_event ev = {.events = EPOLLONESHOT, .data.ptr = _owner};
+  if (_interest & REACTOR_READABLE)
+    ev.events |= EPOLLIN | EPOLLRDHUP;
+  if (_interest & REACTOR_WRITABLE)
+    ev.events |= EPOLLOUT;
+
+  if (epoll_ctl(_Reactor->epoll_fd, EPOLL_CTL_MOD, _fd, &ev) != 0) {
+    perror("epoll_ctl mod");
+    return ERR_IO;
+  }
+  return SUCCESS;
+#else
+  (void)_interest;
+  return ERR_IO;
+#endif
+}
+
+void reactor_unregister(Reactor* _Reactor, int _fd)
+{
+  if (!_Reactor || !_Reactor->ready || _fd < 0)
+    return;
+
+#if defined(__linux__)
+  /* ENOENT/EBADF just means it was never registered or already closed */
+  epoll_ctl(_Reactor->epoll_fd, EPOLL_CTL_DEL, _fd, NULL);
+#endif
+}
+
+int reactor_wait(Reactor* _Reactor, int _timeout_ms, reactor_on_ready _on_ready, void* _context)
+{
+  if (!_Reactor)
+    return ERR_INVALID_ARG;
+
+#if defined(__linux__)
+  if (_Reactor->ready) {
+    struct epoll_event events[REACTOR_MAX_EVENTS];
+
+    int n = epoll_wait(_Reactor->epoll_fd, events, REACTOR_MAX_EVENTS, _timeout_ms);
+    if (n < 0) {
+      if (errno == EINTR)
+        return 0;
+      perror("epoll_wait");
+      return ERR_IO;
+    }
+
+    int i;
+    for (i = 0; i < n; i++) {
+      if (events[i].data.ptr == NULL) {
+        uint64_t drain;
+        while (read(_Reactor->wake_fd, &drain, sizeof(drain)) > 0)
+          ;
+        continue;
+      }
+
+      /* Errors and hangups are reported as ready both ways, the owner's next
+       * read/write will pick up the actual condition */
+      uint32_t interest = 0;
+      if (events[i].events & (EPOLLIN | EPOLLRDHUP | EPOLLHUP | EPOLLERR))
+        interest |= REACTOR_READABLE;
+      if (events[i].events & (EPOLLOUT | EPOLLHUP | EPOLLERR))
+        interest |= REACTOR_WRITABLE;
+
+      if (_on_ready)
+        _on_ready(_context, events[i].data.ptr, interest);
+    }
+
+    return n;
+  }
+#endif
+
+  /* No epoll available, plain sleep (bounded so wakeups are not missed for long) */
+  (void)_on_ready;
+  (void)_context;
+  if (_timeout_ms < 0 || _timeout_ms > 100)
+    _timeout_ms = 100;
+  ms_sleep((uint64_t)_timeout_ms);
+
+  return 0;
+}
+
+void reactor_wakeup(Reactor* _Reactor)
+{
+  if (!_Reactor || !_Reactor->ready)
+    return;
+
+  uint64_t one = 1;
+  if (write(_Reactor->wake_fd, &one, sizeof(one)) < 0 && errno != EAGAIN)
+    perror("reactor_wakeup");
+}
+
+void reactor_dispose(Reactor* _Reactor)
+{
+  if (!_Reactor || !_Reactor->ready)
+    return;
+
+  if (_Reactor->wake_fd >= 0)
+    close(_Reactor->wake_fd);
+  if (_Reactor->epoll_fd >= 0)
+    close(_Reactor->epoll_fd);
+
+  _Reactor->wake_fd  = -1;
+  _Reactor->epoll_fd = -1;
+  _Reactor->ready    = false;
+}
@@ -1,41 +1,393 @@
+#define _POSIX_C_SOURCE 200809L
 #include <maestromodules/scheduler.h>
 
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
 /* ----------------------- Global vars ----------------------- */
 
 Scheduler Global_Scheduler;
 /* const uint64_t min_loop_ms = MIN_LOOP_MS; // Defines how many ms a scheduler task-loop needs to
  * take at a minimum */
 
-/* ----------------------------------------------------------- */
+static Scheduler*      g_shards[SCHEDULER_MAX_SHARDS];
+static int             g_shard_count = 0;
+static unsigned int    g_shard_next  = 0; // Round-robin start so ties spread evenly
+static pthread_mutex_t g_shards_lock = PTHREAD_MUTEX_INITIALIZER;
 
-/*Check connections and change timeout depending on amount*/
+/* ----------------------- Internal -------------------------- */
 
-int scheduler_init()
+static void scheduler_heap_swap(Scheduler* _Sched, int _a, int _b)
 {
-  memset(&Global_Scheduler, 0, sizeof(Global_Scheduler));
+  Scheduler_Task* tmp = _Sched->heap[_a];
+  _Sched->heap[_a]    = _Sched->heap[_b];
+  _Sched->heap[_b]    = tmp;
+
+  _Sched->heap[_a]->heap_index = _a;
+  _Sched->heap[_b]->heap_index = _b;
+}
+
+static void scheduler_heap_sift_up(Scheduler* _Sched, int _i)
+{
+  while (_i > 0) {
+    int parent = (_i - 1) / 2;
+    if (_Sched->heap[parent]->next_due <= _Sched->heap[_i]->next_due)
+      break;
+    scheduler_heap_swap(_Sched, parent, _i);
+    _i = parent;
+  }
+}
+
+static void scheduler_heap_sift_down(Scheduler* _Sched, int _i)
+{
+  while (1) {
+    int left     = 2 * _i + 1;
+    int right    = left + 1;
+    int smallest = _i;
+
+    if (left < _Sched->heap_count &&
+        _Sched->heap[left]->next_due < _Sched->heap[smallest]->next_due)
+      smallest = left;
+    if (right < _Sched->heap_count &&
+        _Sched->heap[right]->next_due < _Sched->heap[smallest]->next_due)
+      smallest = right;
+
+    if (smallest == _i)
+      break;
+
+    scheduler_heap_swap(_Sched, _i, smallest);
+    _i = smallest;
+  }
+}
+
+static void scheduler_heap_push(Scheduler* _Sched, Scheduler_Task* _Task)
+{
+  int i             = _Sched->heap_count++;
+  _Sched->heap[i]   = _Task;
+  _Task->heap_index = i;
+  scheduler_heap_sift_up(_Sched, i);
+}
+
+static void scheduler_heap_remove(Scheduler* _Sched, Scheduler_Task* _Task)
+{
+  int i    = _Task->heap_index;
+  int last = --_Sched->heap_count;
+
+  _Task->heap_index = -1;
+  if (i == last)
+    return;
+
+  _Sched->heap[i]             = _Sched->heap[last];
+  _Sched->heap[i]->heap_index = i;
+
+  /* The moved task may belong either above or below its new position */
+  scheduler_heap_sift_up(_Sched, i);
+  scheduler_heap_sift_down(_Sched, _Sched->heap[i]->heap_index);
+}
+
+static Scheduler_Task* scheduler_heap_pop(Scheduler* _Sched)
+{
+  Scheduler_Task* top = _Sched->heap[0];
+  scheduler_heap_remove(_Sched, top);
+  return top;
+}
+
+/* Reactor callback, a watched socket is ready so its task is due right away */
+static void scheduler_on_fd_ready(void* _context, void* _owner, uint32_t _interest)
+{
+  (void)_context;
+  (void)_interest;
+  scheduler_task_set_due((Scheduler_Task*)_owner, 0);
+}
+
+/* Caller holds the lock. Another thread may be parked in reactor_wait with an
+ * older deadline, so kick it */
+static void scheduler_notify_locked(Scheduler* _Sched)
+{
+  if (_Sched->running && !(_Sched->loop_known && pthread_equal(pthread_self(), _Sched->loop_self)))
+    reactor_wakeup(&_Sched->reactor);
+}
+
+static void scheduler_free_storage(Scheduler* _Sched)
+{
+  free(_Sched->tasks);
+  free(_Sched->active);
+  free(_Sched->heap);
+  free(_Sched->ready);
+  free(_Sched->free_slots);
+
+  _Sched->tasks      = NULL;
+  _Sched->active     = NULL;
+  _Sched->heap       = NULL;
+  _Sched->ready      = NULL;
+  _Sched->free_slots = NULL;
+}
+
+/* Returns reactor_init's result, the scheduler is usable (with plain sleeps) even
+ * if the reactor could not be created */
+static int scheduler_setup(Scheduler* _Sched, int _capacity)
+{
+  memset(_Sched, 0, sizeof(Scheduler));
+
+  _Sched->tasks      = calloc((size_t)_capacity, sizeof(Scheduler_Task));
+  _Sched->active     = calloc((size_t)_capacity, sizeof(Scheduler_Task*));
+  _Sched->heap       = calloc((size_t)_capacity, sizeof(Scheduler_Task*));
+  _Sched->ready      = calloc((size_t)_capacity, sizeof(Scheduler_Task*));
+  _Sched->free_slots = calloc((size_t)_capacity, sizeof(int));
+
+  if (!_Sched->tasks || !_Sched->active || !_Sched->heap || !_Sched->ready ||
+      !_Sched->free_slots) {
+    perror("calloc");
+    scheduler_free_storage(_Sched);
+    return ERR_NO_MEMORY;
+  }
+
+  if (pthread_mutex_init(&_Sched->lock, NULL) != 0) {
+    perror("pthread_mutex_init");
+    scheduler_free_storage(_Sched);
+    return ERR_FATAL;
+  }
+
+  _Sched->capacity = _capacity;
 
   int i;
-  for (i = 0; i < SCHEDULER_MAX_TASKS; i++) {
-    Global_Scheduler.tasks[i].context = NULL;
-    Global_Scheduler.tasks[i].callback = NULL;
+  for (i = 0; i < _capacity; i++) {
+    _Sched->tasks[i].context      = NULL;
+    _Sched->tasks[i].callback     = NULL;
+    _Sched->tasks[i].heap_index   = -1;
+    _Sched->tasks[i].active_index = -1;
+    _Sched->tasks[i].scheduler    = _Sched;
+
+    /* Stack of free slots, lowest index on top */
+    _Sched->free_slots[i] = _capacity - 1 - i;
   }
+  _Sched->free_count  = _capacity;
+  _Sched->initialized = true;
+
+  return reactor_init(&_Sched->reactor);
+}
+
+static void scheduler_teardown(Scheduler* _Sched)
+{
+  if (!_Sched->initialized)
+    return;
+
+  scheduler_stop(_Sched);
 
-  return 0;
+  while (_Sched->active_count > 0)
+    scheduler_destroy_task(_Sched->active[_Sched->active_count - 1]);
+
+  reactor_dispose(&_Sched->reactor);
+  pthread_mutex_destroy(&_Sched->lock);
+  scheduler_free_storage(_Sched);
+
+  _Sched->initialized = false;
+}
+
+static void* scheduler_loop(void* _arg)
+{
+  Scheduler* Sched = (Scheduler*)_arg;
+
+  pthread_mutex_lock(&Sched->lock);
+  Sched->loop_self  = pthread_self();
+  Sched->loop_known = true;
+  pthread_mutex_unlock(&Sched->lock);
+
+  while (1) {
+    pthread_mutex_lock(&Sched->lock);
+    bool stop = Sched->stop;
+    pthread_mutex_unlock(&Sched->lock);
+
+    if (stop)
+      break;
+
+    /* Task changes from other threads and scheduler_stop wake the reactor */
+    scheduler_run_once_on(Sched, -1);
+  }
+
+  return NULL;
+}
+
+/* ----------------------------------------------------------- */
+
+/*Check connections and change timeout depending on amount*/
+
+int scheduler_init()
+{
+  scheduler_teardown(&Global_Scheduler);
+
+  return scheduler_setup(&Global_Scheduler, SCHEDULER_MAX_TASKS);
 }
 
 Scheduler_Task* scheduler_create_task(void* _context,
                                       void (*_callback)(void* _context, uint64_t _montime))
 {
-  int i;
-  for (i = 0; i < SCHEDULER_MAX_TASKS; i++) {
-    if (Global_Scheduler.tasks[i].context == NULL && Global_Scheduler.tasks[i].callback == NULL) {
-      Global_Scheduler.tasks[i].context = _context;
-      Global_Scheduler.tasks[i].callback = _callback;
-      return &Global_Scheduler.tasks[i];
-    }
+  return scheduler_create_task_on(&Global_Scheduler, _context, _callback);
+}
+
+void scheduler_work(uint64_t _montime)
+{
+  scheduler_work_on(&Global_Scheduler, _montime);
+}
+
+uint64_t scheduler_next_due()
+{
+  return scheduler_next_due_on(&Global_Scheduler);
+}
+
+int scheduler_wait(uint64_t _montime, int _max_wait_ms)
+{
+  return scheduler_wait_on(&Global_Scheduler, _montime, _max_wait_ms);
+}
+
+void scheduler_wakeup()
+{
+  scheduler_wakeup_on(&Global_Scheduler);
+}
+
+int scheduler_run_once(int _max_wait_ms)
+{
+  return scheduler_run_once_on(&Global_Scheduler, _max_wait_ms);
+}
+
+int scheduler_get_task_count()
+{
+  return scheduler_get_task_count_on(&Global_Scheduler);
+}
+
+void scheduler_dispose()
+{
+  scheduler_teardown(&Global_Scheduler);
+}
+
+/* ----------------------------------------------------------- */
+
+Scheduler* scheduler_create(int _capacity)
+{
+  if (_capacity <= 0)
+    _capacity = SCHEDULER_MAX_TASKS;
+
+  Scheduler* Sched = malloc(sizeof(Scheduler));
+  if (!Sched) {
+    perror("malloc");
+    return NULL;
   }
 
-  return NULL;
+  int res = scheduler_setup(Sched, _capacity);
+  if (res == ERR_NO_MEMORY || res == ERR_FATAL) {
+    free(Sched);
+    return NULL;
+  }
+
+  return Sched;
+}
+
+int scheduler_run(Scheduler* _Sched)
+{
+  if (!_Sched || !_Sched->initialized)
+    return ERR_INVALID_ARG;
+
+  /* Running before the thread exists, so tasks queued meanwhile wake it */
+  pthread_mutex_lock(&_Sched->lock);
+  if (_Sched->running) {
+    pthread_mutex_unlock(&_Sched->lock);
+    return ERR_BUSY;
+  }
+  _Sched->running    = true;
+  _Sched->loop_known = false;
+  _Sched->stop       = false;
+  pthread_mutex_unlock(&_Sched->lock);
+
+  if (pthread_create(&_Sched->thread, NULL, scheduler_loop, _Sched) != 0) {
+    perror("pthread_create");
+    pthread_mutex_lock(&_Sched->lock);
+    _Sched->running = false;
+    pthread_mutex_unlock(&_Sched->lock);
+    return ERR_FATAL;
+  }
+
+  return SUCCESS;
+}
+
+void scheduler_stop(Scheduler* _Sched)
+{
+  if (!_Sched)
+    return;
+
+  /* Only the caller that sets stop joins, a second pthread_join on the thread is undefined */
+  pthread_mutex_lock(&_Sched->lock);
+  if (!_Sched->running || _Sched->stop) {
+    pthread_mutex_unlock(&_Sched->lock);
+    return;
+  }
+  _Sched->stop = true;
+  pthread_mutex_unlock(&_Sched->lock);
+
+  reactor_wakeup(&_Sched->reactor);
+  pthread_join(_Sched->thread, NULL);
+
+  pthread_mutex_lock(&_Sched->lock);
+  _Sched->running    = false;
+  _Sched->loop_known = false;
+  pthread_mutex_unlock(&_Sched->lock);
+}
+
+void scheduler_destroy(Scheduler* _Sched)
+{
+  if (!_Sched)
+    return;
+
+  scheduler_teardown(_Sched);
+  free(_Sched);
+}
+
+static Scheduler_Task* scheduler_create_task_due(Scheduler* _Sched, void* _context,
+                                                 void (*_callback)(void* _context,
+                                                                   uint64_t _montime),
+                                                 uint64_t _due)
+{
+  if (!_Sched || !_Sched->initialized)
+    return NULL;
+
+  pthread_mutex_lock(&_Sched->lock);
+
+  if (_Sched->free_count == 0) {
+    pthread_mutex_unlock(&_Sched->lock);
+    return NULL;
+  }
+
+  int             slot = _Sched->free_slots[--_Sched->free_count];
+  Scheduler_Task* Task = &_Sched->tasks[slot];
+
+  Task->context  = _context;
+  Task->callback = _callback;
+  Task->next_due = _due;
+
+  Task->active_index                 = _Sched->active_count;
+  _Sched->active[Task->active_index] = Task;
+  _Sched->active_count++;
+
+  scheduler_heap_push(_Sched, Task);
+  if (_due != UINT64_MAX)
+    scheduler_notify_locked(_Sched);
+
+  pthread_mutex_unlock(&_Sched->lock);
+
+  return Task;
+}
+
+Scheduler_Task* scheduler_create_task_on(Scheduler* _Sched, void* _context,
+                                         void (*_callback)(void* _context, uint64_t _montime))
+{
+  return scheduler_create_task_due(_Sched, _context, _callback, 0); // Due on the next tick
+}
+
+Scheduler_Task* scheduler_create_task_parked_on(Scheduler* _Sched, void* _context,
+                                                void (*_callback)(void* _context,
+                                                                  uint64_t _montime))
+{
+  return scheduler_create_task_due(_Sched, _context, _callback, UINT64_MAX);
 }
 
 void scheduler_destroy_task(Scheduler_Task* _Task)
@@ -43,53 +395,273 @@ void scheduler_destroy_task(Scheduler_Task* _Task)
   if (_Task == NULL)
     return;
 
-  int i;
-  for (i = 0; i < SCHEDULER_MAX_TASKS; i++) {
-    if (&Global_Scheduler.tasks[i] == _Task) {
-      Global_Scheduler.tasks[i].context = NULL;
-      Global_Scheduler.tasks[i].callback = NULL;
-      break;
+  Scheduler* Sched = _Task->scheduler;
+  pthread_mutex_lock(&Sched->lock);
+
+  if (_Task->active_index < 0) {
+    pthread_mutex_unlock(&Sched->lock);
+    return;
+  }
+
+  if (_Task->heap_index >= 0)
+    scheduler_heap_remove(Sched, _Task);
+
+  /* Swap-remove from the dense active set */
+  int             last               = --Sched->active_count;
+  Scheduler_Task* Moved              = Sched->active[last];
+  Sched->active[_Task->active_index] = Moved;
+  Moved->active_index                = _Task->active_index;
+
+  _Task->context      = NULL;
+  _Task->callback     = NULL;
+  _Task->active_index = -1;
+
+  Sched->free_slots[Sched->free_count++] = (int)(_Task - Sched->tasks);
+
+  pthread_mutex_unlock(&Sched->lock);
+}
+
+void scheduler_task_set_due(Scheduler_Task* _Task, uint64_t _due)
+{
+  if (_Task == NULL)
+    return;
+
+  Scheduler* Sched = _Task->scheduler;
+  pthread_mutex_lock(&Sched->lock);
+
+  if (_Task->active_index < 0) {
+    pthread_mutex_unlock(&Sched->lock);
+    return;
+  }
+
+  uint64_t old    = _Task->next_due;
+  _Task->next_due = _due;
+
+  /* While the task is running it is outside the heap and gets re-queued afterwards */
+  if (_Task->heap_index >= 0) {
+    if (_due < old) {
+      scheduler_heap_sift_up(Sched, _Task->heap_index);
+      scheduler_notify_locked(Sched);
+    } else {
+      scheduler_heap_sift_down(Sched, _Task->heap_index);
     }
   }
+
+  pthread_mutex_unlock(&Sched->lock);
 }
 
-void scheduler_work(uint64_t _montime)
+int scheduler_task_watch_fd(Scheduler_Task* _Task, int _fd)
 {
+  if (_Task == NULL || _Task->active_index < 0)
+    return ERR_INVALID_ARG;
+
+  return reactor_register(&_Task->scheduler->reactor, _fd, _Task);
+}
+
+int scheduler_task_wait_fd(Scheduler_Task* _Task, int _fd, uint32_t _interest,
+                           uint64_t _timeout_at)
+{
+  if (_Task == NULL || _Task->active_index < 0)
+    return ERR_INVALID_ARG;
+
+  int res = reactor_arm(&_Task->scheduler->reactor, _fd, _Task, _interest);
+  if (res != SUCCESS)
+    return res;
+
+  scheduler_task_set_due(_Task, _timeout_at);
+  return SUCCESS;
+}
+
+void scheduler_task_unwatch_fd(Scheduler_Task* _Task, int _fd)
+{
+  if (_Task == NULL)
+    return;
+
+  reactor_unregister(&_Task->scheduler->reactor, _fd);
+}
+
+void scheduler_work_on(Scheduler* _Sched, uint64_t _montime)
+{
+  if (!_Sched || !_Sched->initialized)
+    return;
+
+  /* Pop everything that is due before running anything, so tasks re-queued
+   * by their callbacks wait for the next tick */
+  pthread_mutex_lock(&_Sched->lock);
+
+  int ready_count = 0;
+  while (_Sched->heap_count > 0 && _Sched->heap[0]->next_due <= _montime)
+    _Sched->ready[ready_count++] = scheduler_heap_pop(_Sched);
+
+  pthread_mutex_unlock(&_Sched->lock);
 
   int i;
-  for (i = 0; i < SCHEDULER_MAX_TASKS; i++) {
-    if (Global_Scheduler.tasks[i].callback != NULL) {
-      uint64_t start = SystemMonotonicMS();
-      Global_Scheduler.tasks[i].callback(Global_Scheduler.tasks[i].context, _montime);
-      uint64_t end = SystemMonotonicMS();
-
-      uint64_t elapsed = end - start;
-
-      if (elapsed < MIN_LOOP_MS) {
-        ms_sleep(MIN_LOOP_MS - elapsed);
-      }
-      /* TODO: dynamic MIN_LOOP_MS depending on amount of connections */
+  for (i = 0; i < ready_count; i++) {
+    Scheduler_Task* Task = _Sched->ready[i];
+
+    pthread_mutex_lock(&_Sched->lock);
+
+    /* Destroyed (or destroyed and re-created) by an earlier callback this tick */
+    if (Task->callback == NULL || Task->heap_index >= 0) {
+      pthread_mutex_unlock(&_Sched->lock);
+      continue;
     }
+
+    void (*callback)(void* _context, uint64_t _montime) = Task->callback;
+    void* context                                       = Task->context;
+
+    pthread_mutex_unlock(&_Sched->lock);
+
+    callback(context, _montime);
+
+    pthread_mutex_lock(&_Sched->lock);
+    if (Task->callback != NULL && Task->heap_index < 0)
+      scheduler_heap_push(_Sched, Task);
+    pthread_mutex_unlock(&_Sched->lock);
   }
 }
 
-int scheduler_get_task_count()
+uint64_t scheduler_next_due_on(Scheduler* _Sched)
+{
+  if (!_Sched || !_Sched->initialized)
+    return UINT64_MAX;
+
+  pthread_mutex_lock(&_Sched->lock);
+  uint64_t next = _Sched->heap_count == 0 ? UINT64_MAX : _Sched->heap[0]->next_due;
+  pthread_mutex_unlock(&_Sched->lock);
+
+  return next;
+}
+
+int scheduler_wait_on(Scheduler* _Sched, uint64_t _montime, int _max_wait_ms)
+{
+  if (!_Sched || !_Sched->initialized)
+    return ERR_INVALID_ARG;
+
+  int      timeout = _max_wait_ms;
+  uint64_t next    = scheduler_next_due_on(_Sched);
+
+  if (next != UINT64_MAX) {
+    uint64_t until = next > _montime ? next - _montime : 0;
+    if (timeout < 0 || until < (uint64_t)timeout)
+      timeout = (int)until;
+  }
+
+  /* Work is already due, don't pay for a syscall */
+  if (timeout == 0)
+    return 0;
+
+  return reactor_wait(&_Sched->reactor, timeout, scheduler_on_fd_ready, NULL);
+}
+
+void scheduler_wakeup_on(Scheduler* _Sched)
+{
+  if (!_Sched || !_Sched->initialized)
+    return;
+
+  reactor_wakeup(&_Sched->reactor);
+}
+
+int scheduler_run_once_on(Scheduler* _Sched, int _max_wait_ms)
+{
+  scheduler_work_on(_Sched, SystemMonotonicMS());
+
+  return scheduler_wait_on(_Sched, SystemMonotonicMS(), _max_wait_ms);
+}
+
+int scheduler_get_task_count_on(Scheduler* _Sched)
 {
-  int counter = 0;
+  if (!_Sched || !_Sched->initialized)
+    return 0;
+
+  pthread_mutex_lock(&_Sched->lock);
+  int count = _Sched->active_count;
+  pthread_mutex_unlock(&_Sched->lock);
+
+  return count;
+}
+
+/* ----------------------------------------------------------- */
+
+int scheduler_shards_start(int _count)
+{
+  if (_count <= 0) {
+    long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    _count    = cpus > 0 ? (int)cpus : 1;
+  }
+  if (_count > SCHEDULER_MAX_SHARDS)
+    _count = SCHEDULER_MAX_SHARDS;
+
+  pthread_mutex_lock(&g_shards_lock);
+
+  if (g_shard_count > 0) {
+    pthread_mutex_unlock(&g_shards_lock);
+    return ERR_BUSY;
+  }
+
   int i;
-  for (i = 0; i < SCHEDULER_MAX_TASKS; i++) {
-    if (Global_Scheduler.tasks[i].callback != NULL)
-      counter++;
+  for (i = 0; i < _count; i++) {
+    Scheduler* Shard = scheduler_create(SCHEDULER_MAX_TASKS);
+    if (!Shard || scheduler_run(Shard) != SUCCESS) {
+      scheduler_destroy(Shard);
+      break;
+    }
+    g_shards[g_shard_count++] = Shard;
+  }
+
+  int res = g_shard_count == _count ? SUCCESS : ERR_NO_MEMORY;
+  if (res != SUCCESS) {
+    while (g_shard_count > 0)
+      scheduler_destroy(g_shards[--g_shard_count]);
   }
 
-  return counter;
+  pthread_mutex_unlock(&g_shards_lock);
+  return res;
 }
 
-void scheduler_dispose()
+Scheduler* scheduler_shards_pick()
 {
+  pthread_mutex_lock(&g_shards_lock);
+
+  if (g_shard_count == 0) {
+    pthread_mutex_unlock(&g_shards_lock);
+    return NULL;
+  }
+
+  int        start = (int)(g_shard_next++ % (unsigned int)g_shard_count);
+  Scheduler* Best  = NULL;
+  int        best  = 0;
+
   int i;
-  for (i = 0; i < SCHEDULER_MAX_TASKS; i++) {
-    Global_Scheduler.tasks[i].context = NULL;
-    Global_Scheduler.tasks[i].callback = NULL;
+  for (i = 0; i < g_shard_count; i++) {
+    Scheduler* Shard = g_shards[(start + i) % g_shard_count];
+    int        load  = scheduler_get_task_count_on(Shard);
+    if (Best == NULL || load < best) {
+      Best = Shard;
+      best = load;
+    }
   }
+
+  pthread_mutex_unlock(&g_shards_lock);
+  return Best;
+}
+
+int scheduler_shards_count()
+{
+  pthread_mutex_lock(&g_shards_lock);
+  int count = g_shard_count;
+  pthread_mutex_unlock(&g_shards_lock);
+
+  return count;
+}
+
+void scheduler_shards_stop()
+{
+  pthread_mutex_lock(&g_shards_lock);
+
+  while (g_shard_count > 0)
+    scheduler_destroy(g_shards[--g_shard_count]);
+  g_shard_next = 0;
+
+  pthread_mutex_unlock(&g_shards_lock);
 }
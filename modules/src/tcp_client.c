@@ -1,7 +1,11 @@
 #include <maestromodules/tcp_client.h>
 #include <maestroutils/error.h>
 #include <poll.h>
+#include <pthread.h>
+#include <signal.h>
 #include <stdint.h>
+#include <sys/sendfile.h>
+#include <time.h>
 
 /*---------------------Internal functions------------------------------*/
 
@@ -315,6 +319,37 @@ int tcp_client_write_simple(TCP_Client* _Client, const uint8_t* _buf, int _len)
   return send(_Client->fd, _buf, _len, MSG_NOSIGNAL);
 }
 
+ssize_t tcp_client_writev(TCP_Client* _Client, const struct iovec* _iov, int _count)
+{
+  // sendmsg() instead of writev() for MSG_NOSIGNAL
+  struct msghdr msg = {0};
+  msg.msg_iov       = (struct iovec*)_iov;
+  msg.msg_iovlen    = (size_t)_count;
+
+  return sendmsg(_Client->fd, &msg, MSG_NOSIGNAL);
+}
+
+ssize_t tcp_client_sendfile(TCP_Client* _Client, int _fd, off_t* _offset, size_t _count)
+{
+  // sendfile() has no MSG_NOSIGNAL, keep a reset peer from raising SIGPIPE in the caller
+  sigset_t pipe_set, old_set;
+  sigemptyset(&pipe_set);
+  sigaddset(&pipe_set, SIGPIPE);
+  pthread_sigmask(SIG_BLOCK, &pipe_set, &old_set);
+
+  ssize_t res = sendfile(_Client->fd, _fd, _offset, _count);
+
+  if (res < 0 && errno == EPIPE) {
+    int             err  = errno;
+    struct timespec none = {0};
+    sigtimedwait(&pipe_set, NULL, &none); // Drop the SIGPIPE it left pending
+    errno = err;
+  }
+
+  pthread_sigmask(SIG_SETMASK, &old_set, NULL);
+  return res;
+}
+
 void tcp_client_disconnect(TCP_Client* _Client)
 {
   if (_Client->fd >= 0)
@@ -1,60 +1,830 @@
+#define _GNU_SOURCE // CPU affinity and thread names
 #include "maestromodules/thread_pool.h"
-#include "maestromodules/linked_list.h"
+#include "maestroutils/error.h"
 
+#include <ctype.h>
+#include <errno.h>
 #include <pthread.h>
+#include <sched.h>
+#include <stdatomic.h>
+#include <stdint.h>
 #include <stdlib.h>
 #include <stdio.h>
 #include <stdbool.h>
+#include <string.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#define TP_NAME_MAX        16 // Including the terminator, kernel limit
+#define TP_NAME_PREFIX_MAX 8  // Leaves room for "-<index>"
+#define TP_MAX_NUMA_NODES  1024
+#define TP_MPOL_PREFERRED  1  // <numaif.h> MPOL_PREFERRED, without depending on libnuma
 
 /* --------------------------- Internal --------------------------- */
 
-struct Thread_Pool 
+/* Shared FIFO of tasks stored by value, guarded by the pool mutex */
+typedef struct
+{
+  TP_Task* slots;
+  int      capacity;
+  int      head;  // Oldest task
+  int      count;
+
+} TP_Queue;
+
+/* Binary min-heap on TP_Task.deadline, same ownership rules as TP_Queue */
+typedef struct
+{
+  TP_Task* slots;
+  int      capacity;
+  int      count;
+
+} TP_Heap;
+
+/* Dispatch classes in the order workers serve them */
+enum {
+  TP_CLASS_DEADLINE = 0,
+  TP_CLASS_HIGH,
+  TP_CLASS_NORMAL,
+  TP_CLASS_LOW,
+  TP_CLASS_COUNT
+};
+
+/* Chase-Lev work-stealing deque with tasks stored by value in a fixed ring.
+ * Only the owning worker pushes and pops at the bottom, any thread may steal
+ * from the top. A thief can read a slot the owner is overwriting, but only
+ * after the top has moved on, so its CAS fails and the copy is discarded */
+typedef struct
+{
+  _Atomic int64_t top;
+  char            pad[64 - sizeof(int64_t)]; // Keep thieves and owner on separate cache lines
+  _Atomic int64_t bottom;
+
+  TP_Task* slots;
+  int64_t  mask;
+
+} TP_Deque;
+
+struct TP_Future
+{
+  pthread_mutex_t mutex;
+  pthread_cond_t  completed;
+
+  _Atomic int refs; // Caller + pool while queued or running
+  bool        done;
+  void*       result;
+};
+
+typedef struct
+{
+  Thread_Pool* pool;
+  TP_Deque     deque;
+  unsigned int seed; // Victim selection
+  int          index;
+
+} TP_Worker;
+
+struct Thread_Pool
 {
   pthread_mutex_t mutex;
   pthread_cond_t  task_added;
   pthread_cond_t  task_finished;
+  pthread_cond_t  space_available; // Queue was full (TP_BACKPRESSURE_BLOCK)
 
   pthread_t*      threads;
-  Linked_List*    queue;
+  TP_Backpressure backpressure;
+
+  /* Shared queue: deadline tasks earliest first, then one FIFO per priority */
+  TP_Heap         deadlines;
+  TP_Queue        queues[TP_CLASS_COUNT]; // Indexed by class, TP_CLASS_DEADLINE unused
+  int             queued;                 // Total over all classes
+  int             depth[TP_PRIORITY_COUNT];
+  int             skipped[TP_CLASS_COUNT]; // Dispatches a waiting class was passed over
+  int             starvation_limit;
+  _Atomic int     urgent; // Queued deadline or high priority tasks
+
+  /* Placement */
+  bool            numa_bind;
+  int             numa_node;
 
   int             max_threads;
   int             active_tasks;
 
   bool            stop; // for graceful shutdown
+
+  /* Work-stealing mode */
+  bool            work_stealing;
+  TP_Worker*      workers;
+  _Atomic int     pending;  // Queued anywhere and not yet taken
+  _Atomic int     inflight; // Added and not yet finished
+  _Atomic int     idle;     // Workers sleeping (or about to) on task_added
 };
 
+/* Worker running on this thread, NULL outside any pool */
+static _Thread_local TP_Worker*   tp_current_worker = NULL;
+static _Thread_local Thread_Pool* tp_current_pool   = NULL;
+static _Thread_local TP_Future*   tp_current_future = NULL; // Of the task running on this thread
+
+static void tp_future_retain(TP_Future* _Future)
+{
+  if (_Future)
+    atomic_fetch_add(&_Future->refs, 1);
+}
+
+static void tp_future_complete(TP_Future* _Future)
+{
+  pthread_mutex_lock(&_Future->mutex);
+  _Future->done = true;
+  pthread_cond_broadcast(&_Future->completed);
+  pthread_mutex_unlock(&_Future->mutex);
+}
+
+/* Runs a dequeued task on the current worker and completes its future */
+static void tp_execute(TP_Task* _Task)
+{
+  tp_current_future = _Task->future;
+
+  _Task->thread_func(_Task->thread_arg);
+  if (_Task->callback_func)
+    _Task->callback_func(_Task->callback_arg);
+
+  tp_current_future = NULL;
+
+  if (_Task->future) {
+    tp_future_complete(_Task->future);
+    tp_future_release(_Task->future);
+  }
+}
+
+static int tp_queue_init(TP_Queue* _Queue, int _capacity)
+{
+  _Queue->slots = calloc((size_t)_capacity, sizeof(TP_Task));
+  if (!_Queue->slots) {
+    perror("calloc");
+    return -10;
+  }
+
+  _Queue->capacity = _capacity;
+  _Queue->head     = 0;
+  _Queue->count    = 0;
+
+  return 0;
+}
+
+/* Doubles the ring and unwraps it so head starts at 0 */
+static int tp_queue_grow(TP_Queue* _Queue)
+{
+  int      capacity = _Queue->capacity * 2;
+  TP_Task* slots    = malloc((size_t)capacity * sizeof(TP_Task));
+  if (!slots) {
+    perror("malloc");
+    return -10;
+  }
+
+  int first = _Queue->capacity - _Queue->head;
+  if (first > _Queue->count)
+    first = _Queue->count;
+
+  memcpy(slots, _Queue->slots + _Queue->head, (size_t)first * sizeof(TP_Task));
+  memcpy(slots + first, _Queue->slots, (size_t)(_Queue->count - first) * sizeof(TP_Task));
+
+  free(_Queue->slots);
+  _Queue->slots    = slots;
+  _Queue->capacity = capacity;
+  _Queue->head     = 0;
+
+  return 0;
+}
+
+static void tp_queue_push(TP_Queue* _Queue, const TP_Task* _Task)
+{
+  _Queue->slots[(_Queue->head + _Queue->count) % _Queue->capacity] = *_Task;
+  _Queue->count++;
+}
+
+static void tp_queue_pop(TP_Queue* _Queue, TP_Task* _Out)
+{
+  *_Out        = _Queue->slots[_Queue->head];
+  _Queue->head = (_Queue->head + 1) % _Queue->capacity;
+  _Queue->count--;
+}
+
+static int tp_heap_init(TP_Heap* _Heap, int _capacity)
+{
+  _Heap->slots = calloc((size_t)_capacity, sizeof(TP_Task));
+  if (!_Heap->slots) {
+    perror("calloc");
+    return -10;
+  }
+
+  _Heap->capacity = _capacity;
+  _Heap->count    = 0;
+
+  return 0;
+}
+
+static int tp_heap_grow(TP_Heap* _Heap)
+{
+  int      capacity = _Heap->capacity * 2;
+  TP_Task* slots    = realloc(_Heap->slots, (size_t)capacity * sizeof(TP_Task));
+  if (!slots) {
+    perror("realloc");
+    return -10;
+  }
+
+  _Heap->slots    = slots;
+  _Heap->capacity = capacity;
+
+  return 0;
+}
+
+static void tp_heap_push(TP_Heap* _Heap, const TP_Task* _Task)
+{
+  int i = _Heap->count++;
+
+  while (i > 0) {
+    int parent = (i - 1) / 2;
+    if (_Heap->slots[parent].deadline <= _Task->deadline)
+      break;
+    _Heap->slots[i] = _Heap->slots[parent];
+    i               = parent;
+  }
+  _Heap->slots[i] = *_Task;
+}
+
+static void tp_heap_pop(TP_Heap* _Heap, TP_Task* _Out)
+{
+  *_Out = _Heap->slots[0];
+
+  TP_Task last = _Heap->slots[--_Heap->count];
+  int     i    = 0;
+
+  while (1) {
+    int child = i * 2 + 1;
+    if (child >= _Heap->count)
+      break;
+    if (child + 1 < _Heap->count &&
+        _Heap->slots[child + 1].deadline < _Heap->slots[child].deadline)
+      child++;
+    if (last.deadline <= _Heap->slots[child].deadline)
+      break;
+    _Heap->slots[i] = _Heap->slots[child];
+    i               = child;
+  }
+  _Heap->slots[i] = last;
+}
+
+/* Any deadline puts a task ahead of every priority */
+static int tp_task_class(const TP_Task* _Task)
+{
+  if (_Task->deadline != 0)
+    return TP_CLASS_DEADLINE;
+
+  switch (_Task->priority) {
+    case TP_PRIORITY_HIGH: return TP_CLASS_HIGH;
+    case TP_PRIORITY_LOW:  return TP_CLASS_LOW;
+    default:               return TP_CLASS_NORMAL;
+  }
+}
+
+/* Plain tasks may stay on a worker's LIFO deque, the rest need the shared queue's ordering */
+static bool tp_task_is_plain(const TP_Task* _Task)
+{
+  return tp_task_class(_Task) == TP_CLASS_NORMAL;
+}
+
+static int tp_class_count(Thread_Pool* _Pool, int _class)
+{
+  return _class == TP_CLASS_DEADLINE ? _Pool->deadlines.count : _Pool->queues[_class].count;
+}
+
+static int tp_class_free(Thread_Pool* _Pool, int _class)
+{
+  if (_class == TP_CLASS_DEADLINE)
+    return _Pool->deadlines.capacity - _Pool->deadlines.count;
+
+  return _Pool->queues[_class].capacity - _Pool->queues[_class].count;
+}
+
+/* Caller holds the mutex. Applies the backpressure policy when the task's class is full */
+static int tp_queue_add_locked(Thread_Pool* _Pool, const TP_Task* _Task)
+{
+  int cls = tp_task_class(_Task);
+
+  while (tp_class_free(_Pool, cls) == 0) {
+    TP_Backpressure policy = _Pool->backpressure;
+
+    /* A worker waiting for space in its own pool could wait forever */
+    if (policy == TP_BACKPRESSURE_BLOCK && tp_current_pool == _Pool)
+      policy = TP_BACKPRESSURE_GROW;
+
+    if (policy == TP_BACKPRESSURE_FAIL)
+      return ERR_BUSY;
+
+    if (policy == TP_BACKPRESSURE_GROW) {
+      int res = cls == TP_CLASS_DEADLINE ? tp_heap_grow(&_Pool->deadlines)
+                                         : tp_queue_grow(&_Pool->queues[cls]);
+      if (res != 0)
+        return -10;
+      break;
+    }
+
+    /* Make sure workers are awake to drain what is queued (batch adds signal last) */
+    pthread_cond_broadcast(&_Pool->task_added);
+    pthread_cond_wait(&_Pool->space_available, &_Pool->mutex);
+  }
+
+  if (cls == TP_CLASS_DEADLINE)
+    tp_heap_push(&_Pool->deadlines, _Task);
+  else
+    tp_queue_push(&_Pool->queues[cls], _Task);
+
+  _Pool->queued++;
+  _Pool->depth[_Task->priority]++;
+  if (cls <= TP_CLASS_HIGH)
+    atomic_fetch_add(&_Pool->urgent, 1);
+
+  return 0;
+}
+
+/* Highest class with work, unless a lower one has been passed over
+ * starvation_limit times, then the longest waiting of those goes first */
+static int tp_class_pick_locked(Thread_Pool* _Pool)
+{
+  int first = -1;
+  int aged  = -1;
+
+  for (int c = 0; c < TP_CLASS_COUNT; c++) {
+    if (tp_class_count(_Pool, c) == 0)
+      continue;
+
+    if (first < 0)
+      first = c;
+    else if (_Pool->skipped[c] >= _Pool->starvation_limit &&
+             (aged < 0 || _Pool->skipped[c] > _Pool->skipped[aged]))
+      aged = c;
+  }
+
+  int pick = aged >= 0 ? aged : first;
+
+  for (int c = first + 1; c < TP_CLASS_COUNT; c++) {
+    if (c != pick && tp_class_count(_Pool, c) > 0)
+      _Pool->skipped[c]++;
+  }
+  _Pool->skipped[pick] = 0;
+
+  return pick;
+}
+
+/* Caller holds the mutex and has checked queued > 0 */
+static void tp_queue_take_locked(Thread_Pool* _Pool, TP_Task* _Out)
+{
+  int  cls      = tp_class_pick_locked(_Pool);
+  bool was_full = tp_class_free(_Pool, cls) == 0;
+
+  if (cls == TP_CLASS_DEADLINE)
+    tp_heap_pop(&_Pool->deadlines, _Out);
+  else
+    tp_queue_pop(&_Pool->queues[cls], _Out);
+
+  _Pool->queued--;
+  _Pool->depth[_Out->priority]--;
+  if (cls <= TP_CLASS_HIGH)
+    atomic_fetch_sub(&_Pool->urgent, 1);
+
+  /* Blocked adders may be waiting on different classes */
+  if (was_full && _Pool->backpressure == TP_BACKPRESSURE_BLOCK)
+    pthread_cond_broadcast(&_Pool->space_available);
+}
+
+/* Frees whatever the shared queue classes hold */
+static void tp_queue_free_all(Thread_Pool* _Pool)
+{
+  free(_Pool->deadlines.slots);
+  _Pool->deadlines.slots = NULL;
+
+  for (int c = TP_CLASS_HIGH; c < TP_CLASS_COUNT; c++) {
+    free(_Pool->queues[c].slots);
+    _Pool->queues[c].slots = NULL;
+  }
+}
+
+/* Every class starts with _capacity slots */
+static int tp_queue_init_all(Thread_Pool* _Pool, int _capacity)
+{
+  if (tp_heap_init(&_Pool->deadlines, _capacity) != 0)
+    return -10;
+
+  for (int c = TP_CLASS_HIGH; c < TP_CLASS_COUNT; c++) {
+    if (tp_queue_init(&_Pool->queues[c], _capacity) != 0) {
+      tp_queue_free_all(_Pool);
+      return -10;
+    }
+  }
+
+  return 0;
+}
+
+/* Parses a kernel cpulist ("0-3,8,10-11") into _Set.
+ * Returns the number of CPUs or -1 when malformed */
+static int tp_parse_cpulist(const char* _list, cpu_set_t* _Set)
+{
+  const char* p     = _list;
+  int         count = 0;
+
+  CPU_ZERO(_Set);
+
+  while (*p) {
+    while (*p == ',' || isspace((unsigned char)*p))
+      p++;
+    if (*p == '\0')
+      break;
+
+    char* end;
+    long  first = strtol(p, &end, 10);
+    if (end == p || first < 0)
+      return -1;
+
+    long last = first;
+    p         = end;
+    if (*p == '-') {
+      last = strtol(p + 1, &end, 10);
+      if (end == p + 1 || last < first)
+        return -1;
+      p = end;
+    }
+
+    if (*p != '\0' && *p != ',' && !isspace((unsigned char)*p))
+      return -1;
+
+    for (long cpu = first; cpu <= last; cpu++) {
+      if (cpu >= CPU_SETSIZE)
+        return -1;
+      if (!CPU_ISSET(cpu, _Set)) {
+        CPU_SET(cpu, _Set);
+        count++;
+      }
+    }
+  }
+
+  return count;
+}
+
+/* CPUs belonging to a NUMA node, from sysfs. Returns the count or -1 */
+static int tp_numa_cpus(int _node, cpu_set_t* _Set)
+{
+  char path[64];
+  char list[1024];
+
+  snprintf(path, sizeof(path), "/sys/devices/system/node/node%d/cpulist", _node);
+
+  FILE* File = fopen(path, "r");
+  if (!File) {
+    perror("fopen");
+    return -1;
+  }
+
+  char* line = fgets(list, sizeof(list), File);
+  fclose(File);
+  if (!line)
+    return -1;
+
+  return tp_parse_cpulist(list, _Set);
+}
+
+/* Runs first thing on every worker thread. Memory policy is per thread,
+ * so it can't be set from tp_init_ex */
+static void tp_thread_setup(Thread_Pool* _Pool)
+{
+  if (!_Pool->numa_bind)
+    return;
+
+#ifdef SYS_set_mempolicy
+  unsigned long mask[TP_MAX_NUMA_NODES / (8 * sizeof(unsigned long))] = { 0 };
+  mask[_Pool->numa_node / (8 * sizeof(unsigned long))] |=
+    1UL << (_Pool->numa_node % (8 * sizeof(unsigned long)));
+
+  /* Preferred rather than bound, allocations fall back to other nodes when full */
+  if (syscall(SYS_set_mempolicy, TP_MPOL_PREFERRED, mask, TP_MAX_NUMA_NODES + 1) != 0)
+    perror("set_mempolicy");
+#endif
+}
+
+/* Builds the attributes for worker _index. Returns 0 or -1 */
+static int tp_thread_attr(const TP_Config* _Config, const cpu_set_t* _Node_Set, int _index,
+                          pthread_attr_t* _Attr)
+{
+  cpu_set_t        Set;
+  const cpu_set_t* Affinity = NULL;
+
+  if (pthread_attr_init(_Attr) != 0)
+    return -1;
+
+  if (_Config->stack_size > 0 && pthread_attr_setstacksize(_Attr, _Config->stack_size) != 0) {
+    printf("Thread pool: invalid stack size %zu\n", _Config->stack_size);
+    pthread_attr_destroy(_Attr);
+    return -1;
+  }
+
+  /* An explicit set wins over the node's CPUs */
+  if (_Config->cpu_set_count > 0) {
+    tp_parse_cpulist(_Config->cpu_sets[_index % _Config->cpu_set_count], &Set);
+    Affinity = &Set;
+  } else if (_Node_Set) {
+    Affinity = _Node_Set;
+  }
+
+  if (Affinity && pthread_attr_setaffinity_np(_Attr, sizeof(cpu_set_t), Affinity) != 0) {
+    printf("Thread pool: could not set affinity for worker %d\n", _index);
+    pthread_attr_destroy(_Attr);
+    return -1;
+  }
+
+  return 0;
+}
+
+/* Checks the placement options before anything is allocated */
+static int tp_config_placement(TP_Config* _Config, cpu_set_t* _Node_Set)
+{
+  cpu_set_t Set;
+
+  for (int i = 0; i < _Config->cpu_set_count; i++) {
+    if (!_Config->cpu_sets || !_Config->cpu_sets[i] ||
+        tp_parse_cpulist(_Config->cpu_sets[i], &Set) <= 0) {
+      printf("Thread pool: invalid cpu set %d\n", i);
+      return -1;
+    }
+  }
+
+  int node_cpus = 0;
+  if (_Config->numa_bind) {
+    if (_Config->numa_node < 0 || _Config->numa_node >= TP_MAX_NUMA_NODES) {
+      printf("Thread pool: invalid NUMA node %d\n", _Config->numa_node);
+      return -1;
+    }
+
+    node_cpus = tp_numa_cpus(_Config->numa_node, _Node_Set);
+    if (node_cpus <= 0) {
+      printf("Thread pool: NUMA node %d has no CPUs\n", _Config->numa_node);
+      return -1;
+    }
+  }
+
+  if (_Config->max_threads <= 0 && _Config->size_from_online_cpus) {
+    if (node_cpus > 0)
+      _Config->max_threads = node_cpus;
+    else
+      _Config->max_threads = (int)sysconf(_SC_NPROCESSORS_ONLN);
+  }
+
+  return 0;
+}
+
+static int tp_deque_init(TP_Deque* _Deque, int _capacity)
+{
+  int64_t cap = 1;
+  while (cap < _capacity)
+    cap <<= 1;
+
+  _Deque->slots = calloc((size_t)cap, sizeof(TP_Task));
+  if (!_Deque->slots) {
+    perror("calloc");
+    return -10;
+  }
+
+  _Deque->mask = cap - 1;
+  atomic_init(&_Deque->top, 0);
+  atomic_init(&_Deque->bottom, 0);
+
+  return 0;
+}
+
+/* Owner only. Returns -1 when full */
+static int tp_deque_push(TP_Deque* _Deque, const TP_Task* _Task)
+{
+  int64_t b = atomic_load_explicit(&_Deque->bottom, memory_order_relaxed);
+  int64_t t = atomic_load_explicit(&_Deque->top, memory_order_acquire);
+
+  if (b - t > _Deque->mask)
+    return -1;
+
+  _Deque->slots[b & _Deque->mask] = *_Task;
+  atomic_thread_fence(memory_order_release);
+  atomic_store_explicit(&_Deque->bottom, b + 1, memory_order_relaxed);
+
+  return 0;
+}
+
+/* Owner only. Slots a push is sure to get, thieves can only make it more */
+static int tp_deque_room(TP_Deque* _Deque)
+{
+  int64_t b = atomic_load_explicit(&_Deque->bottom, memory_order_relaxed);
+  int64_t t = atomic_load_explicit(&_Deque->top, memory_order_acquire);
+
+  return (int)(_Deque->mask + 1 - (b - t));
+}
+
+/* Owner only, LIFO end. Returns false when empty */
+static bool tp_deque_pop(TP_Deque* _Deque, TP_Task* _Out)
+{
+  int64_t b = atomic_load_explicit(&_Deque->bottom, memory_order_relaxed) - 1;
+  atomic_store_explicit(&_Deque->bottom, b, memory_order_relaxed);
+  atomic_thread_fence(memory_order_seq_cst);
+  int64_t t = atomic_load_explicit(&_Deque->top, memory_order_relaxed);
+
+  if (t > b) {
+    atomic_store_explicit(&_Deque->bottom, b + 1, memory_order_relaxed);
+    return false;
+  }
+
+  *_Out = _Deque->slots[b & _Deque->mask];
+  if (t < b)
+    return true;
+
+  /* Last task, race the thieves for it */
+  bool won = atomic_compare_exchange_strong_explicit(&_Deque->top, &t, t + 1,
+                                                     memory_order_seq_cst, memory_order_relaxed);
+  atomic_store_explicit(&_Deque->bottom, b + 1, memory_order_relaxed);
+  return won;
+}
+
+/* Any thread, FIFO end. Returns false when empty or when another thief won */
+static bool tp_deque_steal(TP_Deque* _Deque, TP_Task* _Out)
+{
+  int64_t t = atomic_load_explicit(&_Deque->top, memory_order_acquire);
+  atomic_thread_fence(memory_order_seq_cst);
+  int64_t b = atomic_load_explicit(&_Deque->bottom, memory_order_acquire);
+
+  if (t >= b)
+    return false;
+
+  *_Out = _Deque->slots[t & _Deque->mask];
+  return atomic_compare_exchange_strong_explicit(&_Deque->top, &t, t + 1, memory_order_seq_cst,
+                                                 memory_order_relaxed);
+}
+
+/* Wakes one sleeping worker, only takes the mutex when someone is idle */
+static void tp_notify_one(Thread_Pool* _Pool)
+{
+  if (atomic_load(&_Pool->idle) == 0)
+    return;
+
+  pthread_mutex_lock(&_Pool->mutex);
+  pthread_cond_signal(&_Pool->task_added);
+  pthread_mutex_unlock(&_Pool->mutex);
+}
+
+static void tp_run_task(Thread_Pool* _Pool, TP_Task* _Task)
+{
+  tp_execute(_Task);
+
+  /* Last one out wakes tp_wait */
+  if (atomic_fetch_sub(&_Pool->inflight, 1) == 1) {
+    pthread_mutex_lock(&_Pool->mutex);
+    pthread_cond_broadcast(&_Pool->task_finished);
+    pthread_mutex_unlock(&_Pool->mutex);
+  }
+}
+
+static bool tp_take_shared(Thread_Pool* _Pool, TP_Task* _Out)
+{
+  bool found = false;
+
+  pthread_mutex_lock(&_Pool->mutex);
+  if (_Pool->queued > 0) {
+    tp_queue_take_locked(_Pool, _Out);
+    found = true;
+  }
+  pthread_mutex_unlock(&_Pool->mutex);
+
+  return found;
+}
+
+/* Own deque first, then the shared queue, then the other workers.
+ * Queued deadline and high priority tasks go ahead of the own deque */
+static bool tp_find_task(TP_Worker* _Worker, TP_Task* _Out)
+{
+  Thread_Pool* Pool = _Worker->pool;
+
+  if (atomic_load(&Pool->urgent) > 0 && tp_take_shared(Pool, _Out))
+    return true;
+
+  if (tp_deque_pop(&_Worker->deque, _Out))
+    return true;
+
+  if (tp_take_shared(Pool, _Out))
+    return true;
+
+  _Worker->seed = _Worker->seed * 1103515245u + 12345u;
+  int start     = (int)(_Worker->seed % (unsigned int)Pool->max_threads);
+
+  for (int i = 0; i < Pool->max_threads; i++) {
+    TP_Worker* Victim = &Pool->workers[(start + i) % Pool->max_threads];
+    if (Victim != _Worker && tp_deque_steal(&Victim->deque, _Out))
+      return true;
+  }
+
+  return false;
+}
+
+static void* tp_steal_worker(void* _worker_ptr)
+{
+  TP_Worker*   Worker = (TP_Worker*)_worker_ptr;
+  Thread_Pool* Pool   = Worker->pool;
+  TP_Task      Task;
+
+  tp_current_worker = Worker;
+  tp_current_pool   = Pool;
+  tp_thread_setup(Pool);
+
+  while (1) {
+    if (tp_find_task(Worker, &Task)) {
+      atomic_fetch_sub(&Pool->pending, 1);
+      tp_run_task(Pool, &Task);
+      continue;
+    }
+
+    /* Nothing found. Announce idle before re-checking pending, submitters
+     * bump pending before checking idle, so one of us always sees the other */
+    pthread_mutex_lock(&Pool->mutex);
+    atomic_fetch_add(&Pool->idle, 1);
+    while (atomic_load(&Pool->pending) == 0 && Pool->stop == false)
+      pthread_cond_wait(&Pool->task_added, &Pool->mutex);
+    atomic_fetch_sub(&Pool->idle, 1);
+
+    /* Shutdown once everything queued has been taken */
+    if (atomic_load(&Pool->pending) == 0 && Pool->stop == true) {
+      pthread_mutex_unlock(&Pool->mutex);
+      break;
+    }
+    pthread_mutex_unlock(&Pool->mutex);
+  }
+
+  tp_current_worker = NULL;
+  tp_current_pool   = NULL;
+  return NULL;
+}
+
+static int tp_steal_task_add(Thread_Pool* _Pool, TP_Task* _Task)
+{
+  TP_Worker* Worker = tp_current_worker;
+
+  atomic_fetch_add(&_Pool->inflight, 1);
+  tp_future_retain(_Task->future);
+
+  /* Spawned from one of our workers, keep it local */
+  if (Worker && Worker->pool == _Pool && tp_task_is_plain(_Task) &&
+      tp_deque_push(&Worker->deque, _Task) == 0) {
+    atomic_fetch_add(&_Pool->pending, 1);
+    tp_notify_one(_Pool);
+    return 0;
+  }
+
+  pthread_mutex_lock(&_Pool->mutex);
+  int res = tp_queue_add_locked(_Pool, _Task);
+  if (res != 0) {
+    pthread_mutex_unlock(&_Pool->mutex);
+    atomic_fetch_sub(&_Pool->inflight, 1);
+    tp_future_release(_Task->future);
+    return res;
+  }
+  atomic_fetch_add(&_Pool->pending, 1);
+  pthread_cond_signal(&_Pool->task_added);
+  pthread_mutex_unlock(&_Pool->mutex);
+
+  return 0;
+}
+
 static void* tp_worker(void* _pool_ptr)
 {
   Thread_Pool* Pool = (Thread_Pool*)_pool_ptr;
+  TP_Task      Task;
+
+  tp_current_pool = Pool;
+  tp_thread_setup(Pool);
 
   while (1) {
     pthread_mutex_lock(&Pool->mutex);
 
     /* Unblocking mutex with cond_wait until there is a task in queue */
-    while (Pool->queue->count == 0 && Pool->stop == false)
+    while (Pool->queued == 0 && Pool->stop == false)
       pthread_cond_wait(&Pool->task_added, &Pool->mutex);
-    
+
     /* Shutdown on stop=true */
-    if (Pool->queue->count == 0 && Pool->stop == true) {
+    if (Pool->queued == 0 && Pool->stop == true) {
       pthread_mutex_unlock(&Pool->mutex);
       break;
     }
 
-    /* Fetch task from first queue item and remove item from queue */
-    TP_Task* Task = Pool->queue->head->item;
-    if (Task) linked_list_item_remove(Pool->queue, Pool->queue->head);
+    /* Copy out the most urgent task, its slot is free for new tasks right away */
+    tp_queue_take_locked(Pool, &Task);
 
     Pool->active_tasks++;
 
     /* Unlock mutex and run task */
     pthread_mutex_unlock(&Pool->mutex);
-    if (Task) {
 
-      Task->thread_func(Task->thread_arg);
-      if (Task->callback_func)
-        Task->callback_func(Task->callback_arg);
-      free(Task);
-    }
+    tp_execute(&Task);
 
     /* Decrement active tasks and signal finish */
     pthread_mutex_lock(&Pool->mutex);
@@ -63,15 +833,44 @@ static void* tp_worker(void* _pool_ptr)
     pthread_mutex_unlock(&Pool->mutex);
 
   }
+
+  tp_current_pool = NULL;
   return NULL;
 }
 
+static void tp_free_workers(Thread_Pool* _Pool)
+{
+  if (!_Pool->workers)
+    return;
+
+  for (int i = 0; i < _Pool->max_threads; i++)
+    free(_Pool->workers[i].deque.slots);
+  free(_Pool->workers);
+  _Pool->workers = NULL;
+}
+
 /* ---------------------------------------------------------------- */
 
 Thread_Pool* tp_init(int _max_threads)
+{
+  TP_Config Config = { .max_threads = _max_threads };
+  return tp_init_ex(&Config);
+}
+
+Thread_Pool* tp_init_ex(const TP_Config* _Config)
 {
   int i;
-  if (_max_threads <= 0) _max_threads = 2; // minimum max threads
+  TP_Config Config = { 0 };
+  cpu_set_t Node_Set;
+  if (_Config) Config = *_Config;
+
+  if (tp_config_placement(&Config, &Node_Set) != 0)
+    return NULL;
+
+  if (Config.max_threads <= 0) Config.max_threads = 2; // minimum max threads
+  if (Config.deque_capacity <= 0) Config.deque_capacity = TP_DEFAULT_DEQUE_CAPACITY;
+  if (Config.queue_capacity <= 0) Config.queue_capacity = TP_DEFAULT_QUEUE_CAPACITY;
+  if (Config.starvation_limit <= 0) Config.starvation_limit = TP_DEFAULT_STARVATION_LIMIT;
 
   /* Allocate pool */
   Thread_Pool* Pool = calloc(1, sizeof(Thread_Pool));
@@ -81,7 +880,12 @@ Thread_Pool* tp_init(int _max_threads)
   }
 
   /* Allocate threads */
-  Pool->max_threads = _max_threads;
+  Pool->max_threads = Config.max_threads;
+  Pool->work_stealing = Config.work_stealing;
+  Pool->backpressure = Config.backpressure;
+  Pool->starvation_limit = Config.starvation_limit;
+  Pool->numa_bind = Config.numa_bind;
+  Pool->numa_node = Config.numa_node;
   Pool->threads = calloc(1, Pool->max_threads * (sizeof(pthread_t)));
   if (!Pool->threads) {
     perror("calloc");
@@ -89,36 +893,96 @@ Thread_Pool* tp_init(int _max_threads)
     return NULL;
   }
 
+  /* Allocate per-worker deques */
+  if (Pool->work_stealing) {
+    Pool->workers = calloc(Pool->max_threads, sizeof(TP_Worker));
+    if (!Pool->workers) {
+      perror("calloc");
+      free(Pool->threads);
+      free(Pool);
+      return NULL;
+    }
+
+    for (i = 0; i < Pool->max_threads; i++) {
+      Pool->workers[i].pool  = Pool;
+      Pool->workers[i].index = i;
+      Pool->workers[i].seed  = (unsigned int)i * 2654435761u + 1;
+      if (tp_deque_init(&Pool->workers[i].deque, Config.deque_capacity) != 0) {
+        tp_free_workers(Pool);
+        free(Pool->threads);
+        free(Pool);
+        return NULL;
+      }
+    }
+  }
+
   /* Initialize mutex and condition */
   pthread_mutex_init(&Pool->mutex, NULL);
   pthread_cond_init(&Pool->task_added, NULL);
   pthread_cond_init(&Pool->task_finished, NULL);
+  pthread_cond_init(&Pool->space_available, NULL);
+
+  atomic_init(&Pool->pending, 0);
+  atomic_init(&Pool->inflight, 0);
+  atomic_init(&Pool->idle, 0);
+  atomic_init(&Pool->urgent, 0);
 
-  /* Initialize queue */
-  Pool->queue = linked_list_create();
-  if (!Pool->queue) {
-    perror("linked_list_create");
+  /* Initialize queues */
+  if (tp_queue_init_all(Pool, Config.queue_capacity) != 0) {
+    tp_free_workers(Pool);
     free(Pool->threads);
     free(Pool);
     return NULL;
   }
 
+  Pool->active_tasks = 0;
+  Pool->stop = false;
+
+  const char* prefix = Config.name_prefix ? Config.name_prefix : "tp";
+
   /* Create threads */
-  for (i = 0; i < _max_threads; i++)
+  for (i = 0; i < Pool->max_threads; i++)
   {
-    if (pthread_create(&Pool->threads[i], NULL, tp_worker, Pool)) {
-      perror("pthread_create");
+    pthread_attr_t Attr;
+    int            res = tp_thread_attr(&Config, Config.numa_bind ? &Node_Set : NULL, i, &Attr);
+
+    if (res == 0) {
+      res = Pool->work_stealing
+              ? pthread_create(&Pool->threads[i], &Attr, tp_steal_worker, &Pool->workers[i])
+              : pthread_create(&Pool->threads[i], &Attr, tp_worker, Pool);
+      pthread_attr_destroy(&Attr);
+
+      if (res) {
+        errno = res; // pthread_create returns the error instead of setting errno
+        perror("pthread_create");
+      }
+    }
+
+    if (res == 0) {
+      /* Names are cosmetic, a failure here is not worth tearing the pool down */
+      char name[32];
+      snprintf(name, sizeof(name), "%.*s-%d", TP_NAME_PREFIX_MAX, prefix, i);
+      name[TP_NAME_MAX - 1] = '\0';
+      pthread_setname_np(Pool->threads[i], name);
+    }
+
+    if (res) {
+      /* Let the threads that did start exit before tearing down */
+      pthread_mutex_lock(&Pool->mutex);
+      Pool->stop = true;
+      pthread_cond_broadcast(&Pool->task_added);
+      pthread_mutex_unlock(&Pool->mutex);
+
       for (int y = 0; y < i; y++)
         pthread_join(Pool->threads[y], NULL);
+      tp_queue_free_all(Pool);
+      tp_free_workers(Pool);
       free(Pool->threads);
       free(Pool);
       return NULL;
     }
   }
 
-  Pool->active_tasks = 0;
-  Pool->stop = false;
-
   return Pool;
 }
 
@@ -127,41 +991,419 @@ int tp_task_add(Thread_Pool* _Pool, TP_Task* _Task)
   if (!_Pool || !_Task || !_Task->thread_func)
     return -1;
 
-  /* Make persistent copy of task */
-  TP_Task* Task = malloc(sizeof(TP_Task));
-  if (!Task) {
-    perror("malloc");
-    return -10;
-  }
-  Task->callback_func = _Task->callback_func;
-  Task->callback_arg = _Task->callback_arg;
-  Task->thread_func = _Task->thread_func;
-  Task->thread_arg = _Task->thread_arg;
+  if ((unsigned int)_Task->priority >= TP_PRIORITY_COUNT)
+    return -1;
+
+  if (_Pool->work_stealing)
+    return tp_steal_task_add(_Pool, _Task);
 
-  /* Lock mutex and add task to queue */
+  /* Lock mutex and copy task into the queue */
+  tp_future_retain(_Task->future);
   pthread_mutex_lock(&_Pool->mutex);
-  if (linked_list_item_add(_Pool->queue, NULL, Task) != 0) {
-    perror("linked_list_item_add");
+  int res = tp_queue_add_locked(_Pool, _Task);
+  if (res != 0) {
     pthread_mutex_unlock(&_Pool->mutex);
-    free(Task);
-    return -101;
+    tp_future_release(_Task->future);
+    return res;
   }
 
   /* Signal for a thread worker to run task and unlock mutex */
   pthread_cond_signal(&_Pool->task_added);
   pthread_mutex_unlock(&_Pool->mutex);
-  
+
+  return 0;
+}
+
+int tp_task_add_batch(Thread_Pool* _Pool, TP_Task* _Tasks, int _count)
+{
+  if (!_Pool || (!_Tasks && _count > 0) || _count < 0)
+    return -1;
+
+  for (int i = 0; i < _count; i++) {
+    if (!_Tasks[i].thread_func)
+      return -1;
+    if ((unsigned int)_Tasks[i].priority >= TP_PRIORITY_COUNT)
+      return -1;
+  }
+
+  if (_count == 0)
+    return 0;
+
+  int        added  = 0;
+  int        local  = 0;
+  int        res    = 0;
+  TP_Worker* Worker = tp_current_worker;
+
+  if (_Pool->work_stealing) {
+    atomic_fetch_add(&_Pool->inflight, _count);
+
+    /* From inside a worker the leading plain tasks go to our own deque,
+     * as many as it has room for, the rest to the shared queue */
+    if (Worker && Worker->pool == _Pool) {
+      int room = tp_deque_room(&Worker->deque);
+      while (local < _count && local < room && tp_task_is_plain(&_Tasks[local]))
+        local++;
+    }
+  }
+
+  if (local < _count) {
+    pthread_mutex_lock(&_Pool->mutex);
+
+    /* All or nothing when failing fast, checked before anything is queued */
+    if (_Pool->backpressure == TP_BACKPRESSURE_FAIL) {
+      int needed[TP_CLASS_COUNT] = { 0 };
+      for (int i = local; i < _count; i++)
+        needed[tp_task_class(&_Tasks[i])]++;
+
+      for (int c = 0; c < TP_CLASS_COUNT; c++) {
+        if (needed[c] > tp_class_free(_Pool, c))
+          res = ERR_BUSY;
+      }
+    }
+  }
+
+  if (res == 0 && local > 0) {
+    while (added < local) {
+      tp_future_retain(_Tasks[added].future);
+      if (tp_deque_push(&Worker->deque, &_Tasks[added]) != 0) {
+        tp_future_release(_Tasks[added].future);
+        res = ERR_INTERNAL; // Room was counted above, only the owner pushes
+        break;
+      }
+      added++;
+    }
+    atomic_fetch_add(&_Pool->pending, added);
+  }
+
+  if (local < _count) {
+    while (res == 0 && added < _count) {
+      tp_future_retain(_Tasks[added].future);
+      res = tp_queue_add_locked(_Pool, &_Tasks[added]);
+      if (res != 0) {
+        tp_future_release(_Tasks[added].future);
+        break;
+      }
+      if (_Pool->work_stealing)
+        atomic_fetch_add(&_Pool->pending, 1);
+      added++;
+    }
+
+    /* One wakeup for the whole batch */
+    pthread_cond_broadcast(&_Pool->task_added);
+    pthread_mutex_unlock(&_Pool->mutex);
+  } else if (_Pool->work_stealing && atomic_load(&_Pool->idle) > 0) {
+    pthread_mutex_lock(&_Pool->mutex);
+    pthread_cond_broadcast(&_Pool->task_added);
+    pthread_mutex_unlock(&_Pool->mutex);
+  }
+
+  if (_Pool->work_stealing && added < _count)
+    atomic_fetch_sub(&_Pool->inflight, _count - added);
+
+  return res;
+}
+
+TP_Future* tp_future_create()
+{
+  TP_Future* Future = calloc(1, sizeof(TP_Future));
+  if (!Future) {
+    perror("calloc");
+    return NULL;
+  }
+
+  pthread_mutex_init(&Future->mutex, NULL);
+  pthread_cond_init(&Future->completed, NULL);
+  atomic_init(&Future->refs, 1);
+
+  return Future;
+}
+
+bool tp_future_poll(TP_Future* _Future)
+{
+  if (!_Future)
+    return false;
+
+  pthread_mutex_lock(&_Future->mutex);
+  bool done = _Future->done;
+  pthread_mutex_unlock(&_Future->mutex);
+
+  return done;
+}
+
+int tp_future_wait(TP_Future* _Future, void** _result_out)
+{
+  if (!_Future)
+    return -1;
+
+  pthread_mutex_lock(&_Future->mutex);
+  while (_Future->done == false)
+    pthread_cond_wait(&_Future->completed, &_Future->mutex);
+
+  if (_result_out)
+    *_result_out = _Future->result;
+  pthread_mutex_unlock(&_Future->mutex);
+
   return 0;
 }
 
+void tp_future_release(TP_Future* _Future)
+{
+  if (!_Future)
+    return;
+
+  if (atomic_fetch_sub(&_Future->refs, 1) != 1)
+    return;
+
+  pthread_mutex_destroy(&_Future->mutex);
+  pthread_cond_destroy(&_Future->completed);
+  free(_Future);
+}
+
+void tp_task_set_result(void* _result)
+{
+  TP_Future* Future = tp_current_future;
+  if (!Future)
+    return;
+
+  pthread_mutex_lock(&Future->mutex);
+  Future->result = _result;
+  pthread_mutex_unlock(&Future->mutex);
+}
+
+/* ----------------------- Parallel loops ------------------------ */
+
+/* Shared by the caller and its helper tasks. Refcounted because helpers can
+ * be dequeued after the caller has already returned */
+typedef struct
+{
+  _Atomic long next; // First unclaimed index
+  long         end;
+  long         grain;
+  int          participants;
+
+  tp_range_fn   body;
+  tp_reduce_fn  reduce;
+  tp_combine_fn combine;
+  void*         context;
+
+  void*       result;
+  void*       identity; // Copy of *result on entry, seeds every partial
+  size_t      size;
+
+  pthread_mutex_t mutex;
+  pthread_cond_t  finished;
+  long            done; // Indices processed (and combined)
+  long            total;
+  _Atomic int     refs;
+
+} TP_Parallel;
+
+static void tp_parallel_release(TP_Parallel* _Par)
+{
+  if (atomic_fetch_sub(&_Par->refs, 1) != 1)
+    return;
+
+  pthread_mutex_destroy(&_Par->mutex);
+  pthread_cond_destroy(&_Par->finished);
+  free(_Par->identity);
+  free(_Par);
+}
+
+/* Guided chunking: big chunks while there is a lot left, never below grain */
+static bool tp_parallel_claim(TP_Parallel* _Par, long* _begin, long* _end)
+{
+  long cur = atomic_load(&_Par->next);
+
+  while (cur < _Par->end) {
+    long remaining = _Par->end - cur;
+    long chunk     = remaining / (2 * _Par->participants);
+    if (chunk < _Par->grain)
+      chunk = _Par->grain;
+    if (chunk > remaining)
+      chunk = remaining;
+
+    if (atomic_compare_exchange_weak(&_Par->next, &cur, cur + chunk)) {
+      *_begin = cur;
+      *_end   = cur + chunk;
+      return true;
+    }
+  }
+
+  return false;
+}
+
+/* _partial is NULL for plain loops */
+static void tp_parallel_participate(TP_Parallel* _Par, void* _partial)
+{
+  long count = 0;
+  long begin, end;
+
+  if (_partial)
+    memcpy(_partial, _Par->identity, _Par->size);
+
+  while (tp_parallel_claim(_Par, &begin, &end)) {
+    if (_Par->reduce)
+      _Par->reduce(begin, end, _partial, _Par->context);
+    else
+      _Par->body(begin, end, _Par->context);
+    count += end - begin;
+  }
+
+  pthread_mutex_lock(&_Par->mutex);
+  if (_partial && count > 0)
+    _Par->combine(_Par->result, _partial, _Par->context);
+  _Par->done += count;
+  if (_Par->done == _Par->total)
+    pthread_cond_broadcast(&_Par->finished);
+  pthread_mutex_unlock(&_Par->mutex);
+}
+
+static void tp_parallel_helper(void* _arg)
+{
+  TP_Parallel* Par     = (TP_Parallel*)_arg;
+  void*        partial = NULL;
+
+  /* Without a partial this helper sits out, the caller always takes part */
+  if (Par->reduce)
+    partial = malloc(Par->size);
+  if (!Par->reduce || partial)
+    tp_parallel_participate(Par, partial);
+
+  free(partial);
+  tp_parallel_release(Par);
+}
+
+static int tp_parallel_run(Thread_Pool* _Pool, TP_Parallel* _Par, void* _partial)
+{
+  long chunks  = (_Par->total + _Par->grain - 1) / _Par->grain;
+  int  helpers = _Pool->max_threads;
+  if (chunks - 1 < helpers)
+    helpers = (int)(chunks - 1);
+
+  _Par->participants = helpers + 1;
+
+  /* Helpers that can't be queued are simply missing, the caller covers for them */
+  for (int i = 0; i < helpers; i++) {
+    TP_Task Task = { .thread_func = tp_parallel_helper, .thread_arg = _Par };
+    atomic_fetch_add(&_Par->refs, 1);
+    if (tp_task_add(_Pool, &Task) != 0) {
+      atomic_fetch_sub(&_Par->refs, 1);
+      break;
+    }
+  }
+
+  tp_parallel_participate(_Par, _partial);
+
+  pthread_mutex_lock(&_Par->mutex);
+  while (_Par->done < _Par->total)
+    pthread_cond_wait(&_Par->finished, &_Par->mutex);
+  pthread_mutex_unlock(&_Par->mutex);
+
+  return 0;
+}
+
+static TP_Parallel* tp_parallel_create(long _begin, long _end, long _grain, void* _context)
+{
+  TP_Parallel* Par = calloc(1, sizeof(TP_Parallel));
+  if (!Par) {
+    perror("calloc");
+    return NULL;
+  }
+
+  atomic_init(&Par->next, _begin);
+  atomic_init(&Par->refs, 1);
+  Par->end     = _end;
+  Par->total   = _end - _begin;
+  Par->grain   = _grain > 0 ? _grain : 1;
+  Par->context = _context;
+
+  pthread_mutex_init(&Par->mutex, NULL);
+  pthread_cond_init(&Par->finished, NULL);
+
+  return Par;
+}
+
+int tp_parallel_for(Thread_Pool* _Pool, long _begin, long _end, long _grain, tp_range_fn _fn,
+                    void* _context)
+{
+  if (!_Pool || !_fn)
+    return -1;
+
+  if (_end <= _begin)
+    return 0;
+
+  TP_Parallel* Par = tp_parallel_create(_begin, _end, _grain, _context);
+  if (!Par)
+    return -10;
+
+  Par->body = _fn;
+
+  int res = tp_parallel_run(_Pool, Par, NULL);
+  tp_parallel_release(Par);
+
+  return res;
+}
+
+int tp_parallel_reduce(Thread_Pool* _Pool, long _begin, long _end, long _grain, void* _result,
+                       size_t _size, tp_reduce_fn _fn, tp_combine_fn _combine, void* _context)
+{
+  if (!_Pool || !_result || _size == 0 || !_fn || !_combine)
+    return -1;
+
+  if (_end <= _begin)
+    return 0;
+
+  TP_Parallel* Par = tp_parallel_create(_begin, _end, _grain, _context);
+  if (!Par)
+    return -10;
+
+  void* partial  = malloc(_size);
+  Par->identity = malloc(_size);
+  if (!partial || !Par->identity) {
+    perror("malloc");
+    free(partial);
+    tp_parallel_release(Par);
+    return -10;
+  }
+  memcpy(Par->identity, _result, _size);
+
+  Par->reduce  = _fn;
+  Par->combine = _combine;
+  Par->result  = _result;
+  Par->size    = _size;
+
+  int res = tp_parallel_run(_Pool, Par, partial);
+  tp_parallel_release(Par);
+  free(partial);
+
+  return res;
+}
+
+int tp_get_queue_depth(Thread_Pool* _Pool, TP_Priority _priority)
+{
+  if (!_Pool || (unsigned int)_priority >= TP_PRIORITY_COUNT)
+    return -1;
+
+  pthread_mutex_lock(&_Pool->mutex);
+  int depth = _Pool->depth[_priority];
+  pthread_mutex_unlock(&_Pool->mutex);
+
+  return depth;
+}
+
 void tp_wait(Thread_Pool* _Pool)
 {
-  if (!_Pool) 
+  if (!_Pool)
     return;
 
   pthread_mutex_lock(&_Pool->mutex);
-  while (_Pool->active_tasks > 0 || _Pool->queue->count > 0)
-    pthread_cond_wait(&_Pool->task_finished, &_Pool->mutex);
+  if (_Pool->work_stealing) {
+    while (atomic_load(&_Pool->inflight) > 0)
+      pthread_cond_wait(&_Pool->task_finished, &_Pool->mutex);
+  } else {
+    while (_Pool->active_tasks > 0 || _Pool->queued > 0)
+      pthread_cond_wait(&_Pool->task_finished, &_Pool->mutex);
+  }
 
   pthread_mutex_unlock(&_Pool->mutex);
 }
@@ -181,20 +1423,18 @@ void tp_dispose(Thread_Pool* _Pool)
   for (int i = 0; i < _Pool->max_threads; i++)
     pthread_join(_Pool->threads[i], NULL);
   free(_Pool->threads);
+  tp_free_workers(_Pool);
 
-  /* Dispose of queue LL */
+  /* Dispose of queue, workers drained it before exiting */
   pthread_mutex_lock(&_Pool->mutex);
-  linked_list_foreach(_Pool->queue, node) {
-    if (node->item != NULL)
-      free(node->item); // free tasks if any still alloc'd
-  }
-  linked_list_destroy(&_Pool->queue);
+  tp_queue_free_all(_Pool);
 
   /* Unlock and destroy primitives */
   pthread_mutex_unlock(&_Pool->mutex);
   pthread_mutex_destroy(&_Pool->mutex);
   pthread_cond_destroy(&_Pool->task_added);
   pthread_cond_destroy(&_Pool->task_finished);
+  pthread_cond_destroy(&_Pool->space_available);
 
   free(_Pool);
 }
@@ -1,16 +1,24 @@
 #include <maestromodules/tls_client.h>
 #include <maestromodules/tls_global_ca.h>
+#include <maestromodules/tls_verify_cache.h>
 #include <maestroutils/error.h>
+#include <maestroutils/time_utils.h>
 #include <mbedtls/net_sockets.h>
 #include <mbedtls/ssl.h>
 #include <mbedtls/entropy.h>
 #include <mbedtls/ctr_drbg.h>
 #include <mbedtls/error.h>
 #include <mbedtls/x509.h>
+#include <psa/crypto.h>
+#include <strings.h>
 #include <string.h>
 #include <errno.h>
+#include <stdio.h>
 #include <stdlib.h>
 
+#if defined(MBEDTLS_X509_CRT_PARSE_C) && !defined(MBEDTLS_SSL_KEEP_PEER_CERTIFICATE)
+#error "MBEDTLS_SSL_KEEP_PEER_CERTIFICATE is required, the verify cache checks the peer chain"
+#endif
 
 /**********************************BIO********************************************************/
 
@@ -58,65 +66,416 @@ static int tls_bio_recv(void* ctx, unsigned char* buf, size_t len)
 }
 
 
+/*********************************SESSIONS***************************************************/
+
+/* Offers the session cached for the host, the server decides if it resumes */
+static void tls_client_offer_session(TLS_Client* _tls)
+{
+  mbedtls_ssl_session session;
+  mbedtls_ssl_session_init(&session);
+
+  if (tls_session_cache_load(_tls->session_host, &session) == SUCCESS &&
+      mbedtls_ssl_set_session(&_tls->ssl, &session) == 0) {
+    _tls->session_offered = true;
+  }
+
+  mbedtls_ssl_session_free(&session);
+}
+
+static void tls_client_save_session(TLS_Client* _tls)
+{
+  if (_tls->session_host[0] == '\0') {
+    return;
+  }
+
+  mbedtls_ssl_session session;
+  mbedtls_ssl_session_init(&session);
+
+  if (mbedtls_ssl_get_session(&_tls->ssl, &session) == 0) {
+    tls_session_cache_store(_tls->session_host, &session);
+  }
+
+  mbedtls_ssl_session_free(&session);
+}
+
 /********************************************************************************************/
 
 
-int tls_client_init(TLS_Client* _tls, const char* _host, const TLS_BIO* _bio)
+/*********************************VERIFY*****************************************************/
+
+/* SHA-256 of the leaf and of the hashes of every certificate in the chain */
+static int tls_client_fingerprint(const mbedtls_x509_crt* _Chain, uint8_t* _leaf, uint8_t* _chain)
 {
-  if (!_tls || !_bio || !_bio->send || !_bio->recv) {
+  uint8_t hashes[TLS_CLIENT_MAX_CHAIN * TLS_VERIFY_CACHE_HASH_LEN];
+  size_t  count = 0;
+  size_t  len   = 0;
+
+  for (const mbedtls_x509_crt* Crt = _Chain; Crt && Crt->raw.p; Crt = Crt->next) {
+    if (count == TLS_CLIENT_MAX_CHAIN) {
+      return ERR_INVALID_ARG;
+    }
+    if (psa_hash_compute(PSA_ALG_SHA_256, Crt->raw.p, Crt->raw.len,
+                         hashes + count * TLS_VERIFY_CACHE_HASH_LEN, TLS_VERIFY_CACHE_HASH_LEN,
+                         &len) != PSA_SUCCESS) {
+      return ERR_INTERNAL;
+    }
+    count++;
+  }
+
+  if (count == 0) {
     return ERR_INVALID_ARG;
   }
 
-  memset(_tls, 0, sizeof(TLS_Client));
-  _tls->bio = *_bio;
+  memcpy(_leaf, hashes, TLS_VERIFY_CACHE_HASH_LEN);
+  return psa_hash_compute(PSA_ALG_SHA_256, hashes, count * TLS_VERIFY_CACHE_HASH_LEN, _chain,
+                          TLS_VERIFY_CACHE_HASH_LEN, &len) == PSA_SUCCESS
+             ? SUCCESS
+             : ERR_INTERNAL;
+}
 
-  mbedtls_ssl_init(&_tls->ssl);
-  mbedtls_ssl_config_init(&_tls->conf);
-  mbedtls_entropy_init(&_tls->entropy);
-  mbedtls_ctr_drbg_init(&_tls->ctr_drbg);
+/* DNS name match with a wildcard standing in for exactly one leftmost label */
+static bool tls_client_name_matches(const unsigned char* _name, size_t _len, const char* _host)
+{
+  size_t host_len = strlen(_host);
+
+  if (_len >= 2 && _name[0] == '*' && _name[1] == '.') {
+    const char* dot = strchr(_host, '.');
+    if (!dot || dot == _host) {
+      return false;
+    }
+    _name += 1;
+    _len -= 1;
+    host_len -= (size_t)(dot - _host);
+    _host = dot;
+  }
 
-  const char* pers = "maestro_tls_client";
+  return host_len == _len && strncasecmp((const char*)_name, _host, _len) == 0;
+}
 
-  int res = mbedtls_ctr_drbg_seed(&_tls->ctr_drbg, mbedtls_entropy_func, &_tls->entropy,
-                                  (const unsigned char*)pers, strlen(pers));
+/* Only the DNS names in subjectAltName. A leaf without a matching one goes through full
+ * verification instead, which also knows the CN fallback and IP addresses */
+static bool tls_client_hostname_matches(const mbedtls_x509_crt* _Leaf, const char* _host)
+{
+  for (const mbedtls_x509_sequence* San = &_Leaf->subject_alt_names; San; San = San->next) {
+    if (San->buf.tag == (MBEDTLS_ASN1_CONTEXT_SPECIFIC | MBEDTLS_X509_SAN_DNS_NAME) &&
+        tls_client_name_matches(San->buf.p, San->buf.len, _host)) {
+      return true;
+    }
+  }
+  return false;
+}
+
+/* Earliest notAfter in the chain */
+static time_t tls_client_chain_expiry(const mbedtls_x509_crt* _Chain)
+{
+  time_t expiry = 0;
+
+  for (const mbedtls_x509_crt* Crt = _Chain; Crt && Crt->raw.p; Crt = Crt->next) {
+    struct tm tm = {0};
+    tm.tm_year   = Crt->valid_to.year - 1900;
+    tm.tm_mon    = Crt->valid_to.mon - 1;
+    tm.tm_mday   = Crt->valid_to.day;
+    tm.tm_hour   = Crt->valid_to.hour;
+    tm.tm_min    = Crt->valid_to.min;
+    tm.tm_sec    = Crt->valid_to.sec;
+
+    time_t not_after = timegm(&tm);
+    if (expiry == 0 || not_after < expiry) {
+      expiry = not_after;
+    }
+  }
+  return expiry;
+}
+
+/* Verifies the peer chain of a connection set up with conf_deferred. A chain in the verify
+ * cache only needs the hostname check, any other goes through mbedtls and is cached when it
+ * passes */
+static int tls_client_verify_peer(TLS_Client* _tls)
+{
+  const mbedtls_x509_crt* Peer = mbedtls_ssl_get_peer_cert(&_tls->ssl);
+  if (!Peer) {
+    // Only a resumed session was authenticated before (TLS 1.3 resumes on the ticket's PSK and
+    // gets no chain). Anything else went through conf_deferred without any check
+    if (_tls->session_offered && mbedtls_ssl_session_reused(&_tls->ssl) == 1) {
+      return SUCCESS;
+    }
+    printf("TLS peer sent no certificate\n");
+    return ERR_IO;
+  }
+
+  uint8_t leaf[TLS_VERIFY_CACHE_HASH_LEN];
+  uint8_t chain[TLS_VERIFY_CACHE_HASH_LEN];
+  bool    cacheable = tls_client_fingerprint(Peer, leaf, chain) == SUCCESS;
+  time_t  now       = time(NULL);
+
+  if (cacheable && tls_verify_cache_lookup(leaf, chain, now) &&
+      tls_client_hostname_matches(Peer, _tls->session_host)) {
+    return SUCCESS;
+  }
+
+  uint32_t flags = 0;
+#if defined(MBEDTLS_X509_TRUSTED_CERTIFICATE_CALLBACK)
+  int res = mbedtls_x509_crt_verify_with_ca_cb((mbedtls_x509_crt*)Peer, global_tls_ca_cb, NULL,
+                                               &mbedtls_x509_crt_profile_default,
+                                               _tls->session_host, &flags, NULL, NULL);
+#else
+  int res = mbedtls_x509_crt_verify((mbedtls_x509_crt*)Peer, global_tls_ca_get(), NULL,
+                                    _tls->session_host, &flags, NULL, NULL);
+#endif
 
   if (res != 0) {
-    printf("mbedtls_ctr_drbg_seed failed, error: %d\n", res);
+    char vrfy[1024];
+    mbedtls_x509_crt_verify_info(vrfy, sizeof(vrfy), "  ! ", flags);
+    printf("TLS certificate verification failed for %s:\n%s", _tls->session_host, vrfy);
     return ERR_IO;
   }
 
-  res = mbedtls_ssl_config_defaults(&_tls->conf, MBEDTLS_SSL_IS_CLIENT,
-                                    MBEDTLS_SSL_TRANSPORT_STREAM, MBEDTLS_SSL_PRESET_DEFAULT);
+  if (cacheable) {
+    time_t expires = now + (time_t)(tls_verify_cache_ttl_ms() / 1000);
+    time_t expiry  = tls_client_chain_expiry(Peer);
+    tls_verify_cache_store(leaf, chain, expiry < expires ? expiry : expires);
+  }
+
+  return SUCCESS;
+}
+
+/********************************************************************************************/
+
+
+/*********************************CONTEXT****************************************************/
+
+static struct
+{
+  pthread_mutex_t lock;
+  TLS_Context     context;
+  bool            initialized;
+
+} TLS_Default = {.lock = PTHREAD_MUTEX_INITIALIZER};
+
+/* Connections on different threads draw from the same DRBG */
+static int tls_context_random(void* _ctx, unsigned char* _buf, size_t _len)
+{
+  TLS_Context* Context = (TLS_Context*)_ctx;
+
+  pthread_mutex_lock(&Context->drbg_lock);
+  int res = mbedtls_ctr_drbg_random(&Context->ctr_drbg, _buf, _len);
+  pthread_mutex_unlock(&Context->drbg_lock);
+
+  return res;
+}
+
+static int tls_context_setup_conf(TLS_Context* _Context, mbedtls_ssl_config* _conf, int _authmode)
+{
+  int res = mbedtls_ssl_config_defaults(_conf, MBEDTLS_SSL_IS_CLIENT, MBEDTLS_SSL_TRANSPORT_STREAM,
+                                        MBEDTLS_SSL_PRESET_DEFAULT);
 
   if (res != 0) {
     printf("mbedtls_ssl_config_defaults failed, error: %d\n", res);
     return ERR_IO;
   }
 
-  mbedtls_ssl_conf_authmode(&_tls->conf, MBEDTLS_SSL_VERIFY_REQUIRED);
-  mbedtls_ssl_conf_rng(&_tls->conf, mbedtls_ctr_drbg_random, &_tls->ctr_drbg);
+  mbedtls_ssl_conf_authmode(_conf, _authmode);
+  mbedtls_ssl_conf_rng(_conf, tls_context_random, _Context);
+
+#if defined(MBEDTLS_SSL_PROTO_TLS1_3) && defined(MBEDTLS_SSL_SESSION_TICKETS)
+  // TLS 1.3 tickets arrive after the handshake, have reads report them so they get cached
+  mbedtls_ssl_conf_tls13_enable_signal_new_session_tickets(
+      _conf, MBEDTLS_SSL_TLS1_3_SIGNAL_NEW_SESSION_TICKETS_ENABLED);
+#endif
 
   /*SET GLOBAL CA*/
+#if defined(MBEDTLS_X509_TRUSTED_CERTIFICATE_CALLBACK)
+  // Roots are looked up by issuer name during verification, none are parsed here
+  if (!global_tls_ca_ready()) {
+    printf("Failed to set global CA\n");
+    return ERR_IO;
+  }
+
+  mbedtls_ssl_conf_ca_cb(_conf, global_tls_ca_cb, NULL);
+#else
   mbedtls_x509_crt* ca = global_tls_ca_get();
   if (!ca) {
     printf("Failed to set global CA\n");
     return ERR_IO;
   }
 
-  mbedtls_ssl_conf_ca_chain(&_tls->conf, ca, NULL);
+  mbedtls_ssl_conf_ca_chain(_conf, ca, NULL);
+#endif
+
+  return SUCCESS;
+}
+
+int tls_context_init(TLS_Context* _Context)
+{
+  if (!_Context) {
+    return ERR_INVALID_ARG;
+  }
+
+  memset(_Context, 0, sizeof(TLS_Context));
+  _Context->record_size = TLS_CLIENT_RECORD_SIZE;
+
+  mbedtls_ssl_config_init(&_Context->conf);
+  mbedtls_ssl_config_init(&_Context->conf_deferred);
+  mbedtls_entropy_init(&_Context->entropy);
+  mbedtls_ctr_drbg_init(&_Context->ctr_drbg);
+  pthread_mutex_init(&_Context->drbg_lock, NULL);
+
+  const char* pers = "maestro_tls_client";
+
+  int res = mbedtls_ctr_drbg_seed(&_Context->ctr_drbg, mbedtls_entropy_func, &_Context->entropy,
+                                  (const unsigned char*)pers, strlen(pers));
+
+  if (res != 0) {
+    printf("mbedtls_ctr_drbg_seed failed, error: %d\n", res);
+    tls_context_dispose(_Context);
+    return ERR_IO;
+  }
+
+#if defined(MBEDTLS_PSA_CRYPTO_C)
+  // TLS 1.3 and the verify cache fingerprints hash through PSA
+  if (psa_crypto_init() != PSA_SUCCESS) {
+    printf("psa_crypto_init failed\n");
+    tls_context_dispose(_Context);
+    return ERR_IO;
+  }
+#endif
+
+  // conf_deferred leaves the chain to tls_client_verify_peer, see tls_verify_cache.h
+  if (tls_context_setup_conf(_Context, &_Context->conf, MBEDTLS_SSL_VERIFY_REQUIRED) != SUCCESS ||
+      tls_context_setup_conf(_Context, &_Context->conf_deferred, MBEDTLS_SSL_VERIFY_NONE) !=
+          SUCCESS) {
+    tls_context_dispose(_Context);
+    return ERR_IO;
+  }
+
+  return SUCCESS;
+}
+
+int tls_context_set_record_size(TLS_Context* _Context, size_t _size)
+{
+  if (!_Context || _size > TLS_CLIENT_RECORD_SIZE) {
+    return ERR_INVALID_ARG;
+  }
+
+  _Context->record_size = _size > 0 ? _size : TLS_CLIENT_RECORD_SIZE;
+
+#if defined(MBEDTLS_SSL_MAX_FRAGMENT_LENGTH)
+  // Smallest fragment length the extension offers that still fits a whole record
+  unsigned char mfl = MBEDTLS_SSL_MAX_FRAG_LEN_NONE;
+  if (_Context->record_size <= 512) {
+    mfl = MBEDTLS_SSL_MAX_FRAG_LEN_512;
+  } else if (_Context->record_size <= 1024) {
+    mfl = MBEDTLS_SSL_MAX_FRAG_LEN_1024;
+  } else if (_Context->record_size <= 2048) {
+    mfl = MBEDTLS_SSL_MAX_FRAG_LEN_2048;
+  } else if (_Context->record_size <= 4096) {
+    mfl = MBEDTLS_SSL_MAX_FRAG_LEN_4096;
+  }
+
+  if (mbedtls_ssl_conf_max_frag_len(&_Context->conf, mfl) != 0 ||
+      mbedtls_ssl_conf_max_frag_len(&_Context->conf_deferred, mfl) != 0) {
+    printf("mbedtls_ssl_conf_max_frag_len failed\n");
+    return ERR_INVALID_ARG;
+  }
+#endif
+
+  return SUCCESS;
+}
+
+void tls_context_dispose(TLS_Context* _Context)
+{
+  if (!_Context) {
+    return;
+  }
+
+  mbedtls_ssl_config_free(&_Context->conf);
+  mbedtls_ssl_config_free(&_Context->conf_deferred);
+  mbedtls_ctr_drbg_free(&_Context->ctr_drbg);
+  mbedtls_entropy_free(&_Context->entropy);
+  pthread_mutex_destroy(&_Context->drbg_lock);
+
+  memset(_Context, 0, sizeof(TLS_Context));
+}
+
+TLS_Context* tls_context_default()
+{
+  pthread_mutex_lock(&TLS_Default.lock);
+
+  // A failed attempt isn't remembered, the global CA may just not be loaded yet
+  if (!TLS_Default.initialized && tls_context_init(&TLS_Default.context) == SUCCESS) {
+    TLS_Default.initialized = true;
+  }
+  TLS_Context* Context = TLS_Default.initialized ? &TLS_Default.context : NULL;
+
+  pthread_mutex_unlock(&TLS_Default.lock);
+
+  return Context;
+}
+
+void tls_context_default_dispose()
+{
+  pthread_mutex_lock(&TLS_Default.lock);
+
+  if (TLS_Default.initialized) {
+    tls_context_dispose(&TLS_Default.context);
+    TLS_Default.initialized = false;
+  }
+
+  pthread_mutex_unlock(&TLS_Default.lock);
+}
+
+/********************************************************************************************/
+
+
+int tls_client_init(TLS_Client* _tls, const char* _host, const TLS_BIO* _bio)
+{
+  TLS_Context* Context = tls_context_default();
+  if (!Context) {
+    return ERR_IO;
+  }
+
+  return tls_client_init_context(_tls, Context, _host, _bio);
+}
+
+int tls_client_init_context(TLS_Client* _tls, const TLS_Context* _Context, const char* _host,
+                            const TLS_BIO* _bio)
+{
+  if (!_tls || !_Context || !_bio || !_bio->send || !_bio->recv) {
+    return ERR_INVALID_ARG;
+  }
+
+  memset(_tls, 0, sizeof(TLS_Client));
+  _tls->bio     = *_bio;
+  _tls->context = _Context;
+
+  if (_host && strlen(_host) < sizeof(_tls->session_host)) {
+    snprintf(_tls->session_host, sizeof(_tls->session_host), "%s", _host);
+    _tls->verify_deferred = tls_verify_cache_enabled();
+  }
+
+  mbedtls_ssl_init(&_tls->ssl);
 
-  res = mbedtls_ssl_setup(&_tls->ssl, &_tls->conf);
+  int res = mbedtls_ssl_setup(&_tls->ssl,
+                              _tls->verify_deferred ? &_Context->conf_deferred : &_Context->conf);
   if (res != 0) {
     printf("mbedtls_ssl_setup failed, error: %d\n", res);
+    mbedtls_ssl_free(&_tls->ssl);
     return ERR_IO;
   }
 
   res = mbedtls_ssl_set_hostname(&_tls->ssl, _host);
   if (res != 0) {
     printf("mbedtls_ssl_set_hostname failed, error: %d\n", res);
+    mbedtls_ssl_free(&_tls->ssl);
     return ERR_IO;
   }
 
+  /*RESUME*/
+
+  if (_tls->session_host[0] != '\0') {
+    tls_client_offer_session(_tls);
+  }
+
   /*SET BIO*/
 
   mbedtls_ssl_set_bio(&_tls->ssl, _tls, tls_bio_send, tls_bio_recv, NULL);
@@ -136,16 +495,37 @@ int tls_client_handshake_step(TLS_Client* _tls)
     return SUCCESS;
   }
 
+  // A ticket is only cached once the chain it came with has been verified
   int res = mbedtls_ssl_handshake(&_tls->ssl);
+  while (res == MBEDTLS_ERR_SSL_RECEIVED_NEW_SESSION_TICKET) {
+    _tls->ticket_pending = true;
+    res                  = mbedtls_ssl_handshake(&_tls->ssl);
+  }
 
   if (res == 0) {
+    if (_tls->verify_deferred && tls_client_verify_peer(_tls) != SUCCESS) {
+      if (_tls->session_offered) {
+        tls_session_cache_remove(_tls->session_host);
+      }
+      return ERR_IO;
+    }
+
     _tls->handshake_done = 1;
+
+    // A TLS 1.2 session is complete now, TLS 1.3 waits for the server's ticket
+#if defined(MBEDTLS_SSL_PROTO_TLS1_3)
+    if (_tls->ticket_pending ||
+        mbedtls_ssl_get_version_number(&_tls->ssl) == MBEDTLS_SSL_VERSION_TLS1_2)
+#endif
+      tls_client_save_session(_tls);
+
     return SUCCESS;
   }
 
   // Set errno so http doesn't have to be adjusted for tls
   if (res == MBEDTLS_ERR_SSL_WANT_READ || res == MBEDTLS_ERR_SSL_WANT_WRITE) {
-    errno = EAGAIN;
+    _tls->want_write = (res == MBEDTLS_ERR_SSL_WANT_WRITE);
+    errno            = EAGAIN;
     return ERR_IN_PROGRESS;
   }
 
@@ -164,6 +544,11 @@ int tls_client_handshake_step(TLS_Client* _tls)
     mbedtls_x509_crt_verify_info(vrfy, sizeof(vrfy), "  ! ", flags);
   }
 
+  // Don't offer the same session again if that is what broke the handshake
+  if (_tls->session_offered) {
+    tls_session_cache_remove(_tls->session_host);
+  }
+
   char errbuf[256];
   mbedtls_strerror(res, errbuf, sizeof(errbuf));
   printf("TLS handshake error: -0x%04X (%s)\n", -res, errbuf);
@@ -171,16 +556,37 @@ int tls_client_handshake_step(TLS_Client* _tls)
   return ERR_IO;
 }
 
+/* One mbedtls_ssl_read, with tickets that arrive in between cached and skipped */
+static int tls_client_read_record(TLS_Client* _tls, uint8_t* _buf, size_t _len)
+{
+  int res = mbedtls_ssl_read(&_tls->ssl, _buf, _len);
+  while (res == MBEDTLS_ERR_SSL_RECEIVED_NEW_SESSION_TICKET) {
+    tls_client_save_session(_tls);
+    res = mbedtls_ssl_read(&_tls->ssl, _buf, _len);
+  }
+  return res;
+}
+
 int tls_client_read(TLS_Client* _tls, uint8_t* _buf, size_t _len)
 {
   if (!_tls || !_buf) {
     return ERR_INVALID_ARG;
   }
 
-  int res = mbedtls_ssl_read(&_tls->ssl, _buf, _len);
+  int res = tls_client_read_record(_tls, _buf, _len);
 
   if (res > 0) {
-    return res;
+    // mbedtls hands out one record per call, drain the rest it already has before returning
+    size_t total = (size_t)res;
+    while (total < _len &&
+           (mbedtls_ssl_get_bytes_avail(&_tls->ssl) > 0 || mbedtls_ssl_check_pending(&_tls->ssl))) {
+      res = tls_client_read_record(_tls, _buf + total, _len - total);
+      if (res <= 0) {
+        break; // Reported by the next call, the bytes read so far go out first
+      }
+      total += (size_t)res;
+    }
+    return (int)total;
   }
 
   if (res == 0) {
@@ -188,7 +594,8 @@ int tls_client_read(TLS_Client* _tls, uint8_t* _buf, size_t _len)
   }
 
   if (res == MBEDTLS_ERR_SSL_WANT_READ || res == MBEDTLS_ERR_SSL_WANT_WRITE) {
-    errno = EAGAIN;
+    _tls->want_write = (res == MBEDTLS_ERR_SSL_WANT_WRITE);
+    errno            = EAGAIN;
     return -1;
   }
 
@@ -205,25 +612,107 @@ int tls_client_read(TLS_Client* _tls, uint8_t* _buf, size_t _len)
   return -1;
 }
 
+/* Sends the head of out_buf as one record. After WANT_* mbedtls has the record encrypted and
+ * only needs the same length again to finish it, out_sending remembers that length */
+static int tls_client_send_record(TLS_Client* _tls)
+{
+  size_t len = _tls->out_sending;
+  if (len == 0) {
+    len = _tls->out_len < _tls->out_cap ? _tls->out_len : _tls->out_cap;
+  }
+
+  int res = mbedtls_ssl_write(&_tls->ssl, _tls->out_buf, len);
+
+  if (res == MBEDTLS_ERR_SSL_WANT_READ || res == MBEDTLS_ERR_SSL_WANT_WRITE) {
+    _tls->out_sending = len;
+    _tls->want_write  = (res == MBEDTLS_ERR_SSL_WANT_WRITE);
+    errno             = EAGAIN;
+    return -1;
+  }
+
+  if (res <= 0) {
+    char errbuf[256];
+    mbedtls_strerror(res, errbuf, sizeof(errbuf));
+    printf("mbedtls_ssl_write error: %d (-0x%04X) %s\n", res, (unsigned)-res, errbuf);
+    errno = EIO;
+    return -1;
+  }
+
+  _tls->out_sending = 0;
+  _tls->out_len -= (size_t)res;
+  if (_tls->out_len > 0) {
+    memmove(_tls->out_buf, _tls->out_buf + res, _tls->out_len);
+  }
+
+  return SUCCESS;
+}
+
+/* Record size is only known once the handshake has settled max_fragment_length */
+static int tls_client_out_alloc(TLS_Client* _tls)
+{
+  size_t cap = _tls->context->record_size;
+  int    max = mbedtls_ssl_get_max_out_record_payload(&_tls->ssl);
+  if (max > 0 && (size_t)max < cap) {
+    cap = (size_t)max;
+  }
+
+  _tls->out_buf = (uint8_t*)malloc(cap);
+  if (!_tls->out_buf) {
+    errno = ENOMEM;
+    return ERR_NO_MEMORY;
+  }
+
+  _tls->out_cap = cap;
+  _tls->out_len = 0;
+
+  return SUCCESS;
+}
+
 int tls_client_write(TLS_Client* _tls, const uint8_t* _buf, size_t _len)
 {
   if (!_tls || !_buf) {
     return ERR_INVALID_ARG;
   }
 
-  int res = mbedtls_ssl_write(&_tls->ssl, _buf, _len);
+  if (!_tls->out_buf && tls_client_out_alloc(_tls) != SUCCESS) {
+    return -1;
+  }
 
-  if (res >= 0) {
-    return res;
+  size_t taken = 0;
+
+  while (taken < _len) {
+    if (_tls->out_len == _tls->out_cap && tls_client_send_record(_tls) != SUCCESS) {
+      if (taken > 0 && errno == EAGAIN) {
+        break;
+      }
+      return -1;
+    }
+
+    size_t n = _tls->out_cap - _tls->out_len;
+    if (n > _len - taken) {
+      n = _len - taken;
+    }
+    memcpy(_tls->out_buf + _tls->out_len, _buf + taken, n);
+    _tls->out_len += n;
+    taken += n;
   }
 
-  if (res == MBEDTLS_ERR_SSL_WANT_READ || res == MBEDTLS_ERR_SSL_WANT_WRITE) {
-    errno = EAGAIN;
-    return -1;
+  return (int)taken;
+}
+
+int tls_client_flush(TLS_Client* _tls)
+{
+  if (!_tls) {
+    return ERR_INVALID_ARG;
   }
 
-  errno = EIO;
-  return -1;
+  while (_tls->out_len > 0) {
+    if (tls_client_send_record(_tls) != SUCCESS) {
+      return -1;
+    }
+  }
+
+  return SUCCESS;
 }
 
 void tls_client_dispose(TLS_Client* _tls)
@@ -235,9 +724,8 @@ void tls_client_dispose(TLS_Client* _tls)
   mbedtls_ssl_close_notify(&_tls->ssl);
 
   mbedtls_ssl_free(&_tls->ssl);
-  mbedtls_ssl_config_free(&_tls->conf);
-  mbedtls_ctr_drbg_free(&_tls->ctr_drbg);
-  mbedtls_entropy_free(&_tls->entropy);
+
+  free(_tls->out_buf);
 
   memset(_tls, 0, sizeof(TLS_Client));
 }
@@ -1,55 +1,133 @@
-#include <maestromodules/tls_ca_bundle.h>
+#include <maestromodules/tls_ca_index.h>
 #include <maestromodules/tls_global_ca.h>
+#include <mbedtls/platform.h>
+#include <pthread.h>
 #include <stdio.h>
 #include <string.h>
 
 static mbedtls_x509_crt g_ca;
 static int              g_initialized = 0;
-//
-// static int x509_chain_count(const mbedtls_x509_crt* crt)
-// {
-//   int n = 0;
-//   for (const mbedtls_x509_crt* p = crt; p != NULL; p = p->next) {
-//     n++;
-//   }
-//   return n;
-// }
+static int              g_parsed      = 0; // g_ca holds the whole bundle
+static pthread_mutex_t  g_lock        = PTHREAD_MUTEX_INITIALIZER;
 
+static int global_tls_ca_compare(const TLS_CA_Entry* _Entry, const unsigned char* _name,
+                                 size_t _len)
+{
+  if (_Entry->subject_len != _len) {
+    return _Entry->subject_len < _len ? -1 : 1;
+  }
+  return memcmp(tls_ca_der + _Entry->subject, _name, _len);
+}
+
+/* First index entry whose subject is _name, tls_ca_index_count when there is none */
+static size_t global_tls_ca_find(const unsigned char* _name, size_t _len)
+{
+  size_t lo = 0;
+  size_t hi = tls_ca_index_count;
+
+  while (lo < hi) {
+    size_t mid = lo + (hi - lo) / 2;
+    if (global_tls_ca_compare(&tls_ca_index[mid], _name, _len) < 0) {
+      lo = mid + 1;
+    } else {
+      hi = mid;
+    }
+  }
+
+  if (lo < tls_ca_index_count && global_tls_ca_compare(&tls_ca_index[lo], _name, _len) == 0) {
+    return lo;
+  }
+  return tls_ca_index_count;
+}
 
+/* Nothing is parsed up front, the roots are DER in static storage */
 int global_tls_ca_init(void)
 {
-  if (g_initialized)
-    return 0;
+  pthread_mutex_lock(&g_lock);
+  g_initialized = tls_ca_index_count > 0;
+  pthread_mutex_unlock(&g_lock);
 
-  mbedtls_x509_crt_init(&g_ca);
+  return g_initialized ? 0 : -1;
+}
 
+int global_tls_ca_ready(void)
+{
+  pthread_mutex_lock(&g_lock);
+  int ready = g_initialized;
+  pthread_mutex_unlock(&g_lock);
 
-  int ret = mbedtls_x509_crt_parse(&g_ca, (const unsigned char*)g_ca_bundle_pem,
-                                   strlen((const char*)g_ca_bundle_pem) + 1);
+  return ready;
+}
 
+int global_tls_ca_cb(void* _ctx, mbedtls_x509_crt const* _child, mbedtls_x509_crt** _candidates)
+{
+  (void)_ctx;
+  *_candidates = NULL;
 
-  if (ret != 0) {
-    mbedtls_x509_crt_free(&g_ca);
-    return ret;
+  size_t first = global_tls_ca_find(_child->issuer_raw.p, _child->issuer_raw.len);
+  if (first == tls_ca_index_count) {
+    return 0; // Not ours, verification reports it as not trusted
   }
 
-  g_initialized = 1;
+  // mbedtls frees what we hand back, so it gets its own chain over the static DER
+  mbedtls_x509_crt* chain = mbedtls_calloc(1, sizeof(mbedtls_x509_crt));
+  if (!chain) {
+    return MBEDTLS_ERR_X509_ALLOC_FAILED;
+  }
+  mbedtls_x509_crt_init(chain);
+
+  for (size_t i = first; i < tls_ca_index_count; i++) {
+    const TLS_CA_Entry* Entry = &tls_ca_index[i];
+    if (global_tls_ca_compare(Entry, _child->issuer_raw.p, _child->issuer_raw.len) != 0) {
+      break;
+    }
+
+    int ret = mbedtls_x509_crt_parse_der_nocopy(chain, tls_ca_der + Entry->der, Entry->der_len);
+    if (ret != 0) {
+      printf("Failed to parse CA %zu, error: %d\n", i, ret);
+    }
+  }
+
+  if (chain->raw.p == NULL) {
+    mbedtls_x509_crt_free(chain);
+    mbedtls_free(chain);
+    return 0;
+  }
+
+  *_candidates = chain;
   return 0;
 }
 
 mbedtls_x509_crt* global_tls_ca_get(void)
 {
-  if (!g_initialized)
-    return NULL;
+  pthread_mutex_lock(&g_lock);
 
-  return &g_ca;
+  if (g_initialized && !g_parsed) {
+    mbedtls_x509_crt_init(&g_ca);
+
+    for (size_t i = 0; i < tls_ca_index_count; i++) {
+      const TLS_CA_Entry* Entry = &tls_ca_index[i];
+      mbedtls_x509_crt_parse_der_nocopy(&g_ca, tls_ca_der + Entry->der, Entry->der_len);
+    }
+    g_parsed = 1;
+  }
+
+  mbedtls_x509_crt* ca = g_initialized ? &g_ca : NULL;
+
+  pthread_mutex_unlock(&g_lock);
+
+  return ca;
 }
 
 void global_tls_ca_dispose(void)
 {
-  if (!g_initialized)
-    return;
+  pthread_mutex_lock(&g_lock);
 
-  mbedtls_x509_crt_free(&g_ca);
+  if (g_parsed) {
+    mbedtls_x509_crt_free(&g_ca);
+    g_parsed = 0;
+  }
   g_initialized = 0;
+
+  pthread_mutex_unlock(&g_lock);
 }
@@ -0,0 +1,184 @@
+#define _POSIX_C_SOURCE 200809L
+#include <maestromodules/tls_session_cache.h>
+#include <maestroutils/time_utils.h>
+
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+
+typedef struct
+{
+  char     host[TLS_SESSION_CACHE_HOST_MAX];
+  uint8_t* data; // mbedtls_ssl_session_save output, NULL = free slot
+  size_t   len;
+  uint64_t saved_at; // Monotonic ms
+  uint64_t used_at;
+
+} Session_Entry;
+
+static struct
+{
+  pthread_mutex_t lock;
+  Session_Entry   entries[TLS_SESSION_CACHE_MAX];
+  int             count;
+
+} Session_Cache = {.lock = PTHREAD_MUTEX_INITIALIZER};
+
+static void tls_session_cache_free_entry(Session_Entry* _Entry)
+{
+  free(_Entry->data);
+  memset(_Entry, 0, sizeof(Session_Entry));
+  Session_Cache.count--;
+}
+
+/* Caller holds the lock */
+static Session_Entry* tls_session_cache_find(const char* _host)
+{
+  for (int i = 0; i < TLS_SESSION_CACHE_MAX; i++) {
+    Session_Entry* Entry = &Session_Cache.entries[i];
+    if (Entry->data && strcasecmp(Entry->host, _host) == 0) {
+      return Entry;
+    }
+  }
+  return NULL;
+}
+
+/* Caller holds the lock. A free slot, otherwise the least recently used one emptied */
+static Session_Entry* tls_session_cache_slot()
+{
+  Session_Entry* Oldest = &Session_Cache.entries[0];
+
+  for (int i = 0; i < TLS_SESSION_CACHE_MAX; i++) {
+    Session_Entry* Entry = &Session_Cache.entries[i];
+    if (!Entry->data) {
+      return Entry;
+    }
+    if (Entry->used_at < Oldest->used_at) {
+      Oldest = Entry;
+    }
+  }
+
+  tls_session_cache_free_entry(Oldest);
+  return Oldest;
+}
+
+int tls_session_cache_store(const char* _host, const mbedtls_ssl_session* _Session)
+{
+  if (!_host || !_Session || strlen(_host) >= TLS_SESSION_CACHE_HOST_MAX) {
+    return ERR_INVALID_ARG;
+  }
+
+  // Serialize outside the lock, the first call only reports the size
+  size_t len = 0;
+  mbedtls_ssl_session_save(_Session, NULL, 0, &len);
+  if (len == 0) {
+    return ERR_INTERNAL;
+  }
+
+  uint8_t* data = malloc(len);
+  if (!data) {
+    perror("malloc");
+    return ERR_NO_MEMORY;
+  }
+
+  int res = mbedtls_ssl_session_save(_Session, data, len, &len);
+  if (res != 0) {
+    printf("mbedtls_ssl_session_save failed, error: %d\n", res);
+    free(data);
+    return ERR_INTERNAL;
+  }
+
+  uint64_t now = SystemMonotonicMS();
+
+  pthread_mutex_lock(&Session_Cache.lock);
+
+  Session_Entry* Entry = tls_session_cache_find(_host);
+  if (Entry) {
+    free(Entry->data);
+  } else {
+    Entry = tls_session_cache_slot();
+    snprintf(Entry->host, sizeof(Entry->host), "%s", _host);
+    Session_Cache.count++;
+  }
+
+  Entry->data     = data;
+  Entry->len      = len;
+  Entry->saved_at = now;
+  Entry->used_at  = now;
+
+  pthread_mutex_unlock(&Session_Cache.lock);
+
+  return SUCCESS;
+}
+
+int tls_session_cache_load(const char* _host, mbedtls_ssl_session* _Session)
+{
+  if (!_host || !_Session) {
+    return ERR_INVALID_ARG;
+  }
+
+  uint64_t now = SystemMonotonicMS();
+  int      res = ERR_NOT_FOUND;
+
+  pthread_mutex_lock(&Session_Cache.lock);
+
+  Session_Entry* Entry = tls_session_cache_find(_host);
+  if (Entry && now - Entry->saved_at >= TLS_SESSION_CACHE_TTL_MS) {
+    tls_session_cache_free_entry(Entry);
+    Entry = NULL;
+  }
+
+  if (Entry) {
+    Entry->used_at = now;
+    res            = mbedtls_ssl_session_load(_Session, Entry->data, Entry->len) == 0
+                         ? SUCCESS
+                         : ERR_NOT_FOUND;
+    if (res != SUCCESS) {
+      tls_session_cache_free_entry(Entry); // Saved by a different mbedtls build
+    }
+  }
+
+  pthread_mutex_unlock(&Session_Cache.lock);
+
+  return res;
+}
+
+void tls_session_cache_remove(const char* _host)
+{
+  if (!_host) {
+    return;
+  }
+
+  pthread_mutex_lock(&Session_Cache.lock);
+
+  Session_Entry* Entry = tls_session_cache_find(_host);
+  if (Entry) {
+    tls_session_cache_free_entry(Entry);
+  }
+
+  pthread_mutex_unlock(&Session_Cache.lock);
+}
+
+int tls_session_cache_count()
+{
+  pthread_mutex_lock(&Session_Cache.lock);
+  int count = Session_Cache.count;
+  pthread_mutex_unlock(&Session_Cache.lock);
+
+  return count;
+}
+
+void tls_session_cache_dispose()
+{
+  pthread_mutex_lock(&Session_Cache.lock);
+
+  for (int i = 0; i < TLS_SESSION_CACHE_MAX; i++) {
+    if (Session_Cache.entries[i].data) {
+      tls_session_cache_free_entry(&Session_Cache.entries[i]);
+    }
+  }
+
+  pthread_mutex_unlock(&Session_Cache.lock);
+}
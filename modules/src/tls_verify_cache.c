@@ -0,0 +1,148 @@
+#include <maestromodules/tls_verify_cache.h>
+
+#include <pthread.h>
+#include <string.h>
+
+typedef struct
+{
+  uint8_t leaf[TLS_VERIFY_CACHE_HASH_LEN];
+  uint8_t chain[TLS_VERIFY_CACHE_HASH_LEN];
+  time_t  expires; // 0 = free slot
+
+} Verify_Entry;
+
+static struct
+{
+  pthread_mutex_t lock;
+  Verify_Entry    entries[TLS_VERIFY_CACHE_MAX];
+  int             count;
+  uint64_t        ttl_ms;
+  bool            enabled;
+
+} Verify_Cache = {.lock = PTHREAD_MUTEX_INITIALIZER};
+
+/* Caller holds the lock */
+static Verify_Entry* tls_verify_cache_find(const uint8_t* _leaf, const uint8_t* _chain)
+{
+  for (int i = 0; i < TLS_VERIFY_CACHE_MAX; i++) {
+    Verify_Entry* Entry = &Verify_Cache.entries[i];
+    if (Entry->expires && memcmp(Entry->leaf, _leaf, TLS_VERIFY_CACHE_HASH_LEN) == 0 &&
+        memcmp(Entry->chain, _chain, TLS_VERIFY_CACHE_HASH_LEN) == 0) {
+      return Entry;
+    }
+  }
+  return NULL;
+}
+
+int tls_verify_cache_init(const TLS_Verify_Cache_Config* _Config)
+{
+  TLS_Verify_Cache_Config Config = {0};
+  if (_Config) {
+    Config = *_Config;
+  }
+
+  pthread_mutex_lock(&Verify_Cache.lock);
+  Verify_Cache.ttl_ms  = Config.ttl_ms > 0 ? Config.ttl_ms : TLS_VERIFY_CACHE_TTL_MS;
+  Verify_Cache.enabled = true;
+  pthread_mutex_unlock(&Verify_Cache.lock);
+
+  return SUCCESS;
+}
+
+bool tls_verify_cache_enabled()
+{
+  pthread_mutex_lock(&Verify_Cache.lock);
+  bool enabled = Verify_Cache.enabled;
+  pthread_mutex_unlock(&Verify_Cache.lock);
+
+  return enabled;
+}
+
+uint64_t tls_verify_cache_ttl_ms()
+{
+  pthread_mutex_lock(&Verify_Cache.lock);
+  uint64_t ttl_ms = Verify_Cache.ttl_ms;
+  pthread_mutex_unlock(&Verify_Cache.lock);
+
+  return ttl_ms;
+}
+
+bool tls_verify_cache_lookup(const uint8_t _leaf[TLS_VERIFY_CACHE_HASH_LEN],
+                             const uint8_t _chain[TLS_VERIFY_CACHE_HASH_LEN], time_t _now)
+{
+  if (!_leaf || !_chain) {
+    return false;
+  }
+
+  bool hit = false;
+
+  pthread_mutex_lock(&Verify_Cache.lock);
+
+  Verify_Entry* Entry = Verify_Cache.enabled ? tls_verify_cache_find(_leaf, _chain) : NULL;
+  if (Entry && _now >= Entry->expires) {
+    memset(Entry, 0, sizeof(Verify_Entry));
+    Verify_Cache.count--;
+  } else if (Entry) {
+    hit = true;
+  }
+
+  pthread_mutex_unlock(&Verify_Cache.lock);
+
+  return hit;
+}
+
+int tls_verify_cache_store(const uint8_t _leaf[TLS_VERIFY_CACHE_HASH_LEN],
+                           const uint8_t _chain[TLS_VERIFY_CACHE_HASH_LEN], time_t _expires)
+{
+  if (!_leaf || !_chain || _expires <= 0) {
+    return ERR_INVALID_ARG;
+  }
+
+  pthread_mutex_lock(&Verify_Cache.lock);
+
+  if (!Verify_Cache.enabled) {
+    pthread_mutex_unlock(&Verify_Cache.lock);
+    return SUCCESS;
+  }
+
+  Verify_Entry* Entry = tls_verify_cache_find(_leaf, _chain);
+  if (!Entry) {
+    // A free slot, otherwise the entry that would have expired first
+    Entry = &Verify_Cache.entries[0];
+    for (int i = 0; i < TLS_VERIFY_CACHE_MAX && Entry->expires; i++) {
+      if (Verify_Cache.entries[i].expires < Entry->expires) {
+        Entry = &Verify_Cache.entries[i];
+      }
+    }
+    if (!Entry->expires) {
+      Verify_Cache.count++;
+    }
+
+    memcpy(Entry->leaf, _leaf, TLS_VERIFY_CACHE_HASH_LEN);
+    memcpy(Entry->chain, _chain, TLS_VERIFY_CACHE_HASH_LEN);
+  }
+
+  Entry->expires = _expires;
+
+  pthread_mutex_unlock(&Verify_Cache.lock);
+
+  return SUCCESS;
+}
+
+int tls_verify_cache_count()
+{
+  pthread_mutex_lock(&Verify_Cache.lock);
+  int count = Verify_Cache.count;
+  pthread_mutex_unlock(&Verify_Cache.lock);
+
+  return count;
+}
+
+void tls_verify_cache_dispose()
+{
+  pthread_mutex_lock(&Verify_Cache.lock);
+  memset(Verify_Cache.entries, 0, sizeof(Verify_Cache.entries));
+  Verify_Cache.count   = 0;
+  Verify_Cache.enabled = false;
+  pthread_mutex_unlock(&Verify_Cache.lock);
+}
@@ -9,6 +9,12 @@
 
 /*************************** TLS TEST STUFF *********************/
 
+/* Which socket direction TLS is blocked on, mbedtls may need to write while reading */
+static TransportWant transport_tls_want(Transport* _Transport)
+{
+  return _Transport->tls.want_write ? TRANSPORT_WANT_WRITE : TRANSPORT_WANT_READ;
+}
+
 static int transport_bio_send(void* ctx, const unsigned char* buf, size_t len)
 {
   TCP_Client* tcp = (TCP_Client*)ctx;
@@ -99,6 +105,12 @@ int transport_init(Transport* t, const char* host, const char* port, const char*
       t->tls_initiated = false;
     }
   }
+
+  // Connect completes when the socket turns writable
+  if (res == ERR_IN_PROGRESS) {
+    t->want = TRANSPORT_WANT_WRITE;
+  }
+
   // Non-blocking returns tcp status
   return res;
 }
@@ -111,8 +123,14 @@ int transport_read(Transport* _Transport, uint8_t* buf, size_t len)
     return ERR_INVALID_ARG;
   }
 
+  _Transport->want = TRANSPORT_WANT_NONE;
+
   if (!_Transport->use_tls) {
-    return tcp_client_read_simple(&_Transport->tcp, buf, len);
+    int res = tcp_client_read_simple(&_Transport->tcp, buf, len);
+    if (res < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+      _Transport->want = TRANSPORT_WANT_READ;
+    }
+    return res;
   }
 
   int res = tls_client_read(&_Transport->tls, buf, len);
@@ -122,31 +140,148 @@ int transport_read(Transport* _Transport, uint8_t* buf, size_t len)
   }
 
   if (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR) {
-
+    _Transport->want = transport_tls_want(_Transport);
     return -1;
   }
   return ERR_IO;
 }
 
+int transport_read_buffer(Transport* _Transport, Byte_Buffer* _Buffer, size_t _want)
+{
+  if (!_Transport || !_Buffer || _want == 0) {
+    return ERR_INVALID_ARG;
+  }
+
+  if (byte_buffer_writable(_Buffer) < _want) {
+    int res = byte_buffer_reserve(_Buffer, _want);
+    if (res != SUCCESS) {
+      errno = ENOMEM; // Callers check errno for EAGAIN on every negative return
+      return res;
+    }
+  }
+
+  int res = transport_read(_Transport, byte_buffer_write_ptr(_Buffer), _want);
+  if (res > 0) {
+    byte_buffer_commit(_Buffer, (size_t)res);
+  }
+
+  return res;
+}
+
 int transport_write(Transport* _Transport, const uint8_t* buf, size_t len)
 {
   if (_Transport == NULL) {
     return ERR_INVALID_ARG;
   }
 
+  _Transport->want = TRANSPORT_WANT_NONE;
+
   if (_Transport->use_tls == true) {
-    return tls_client_write(&_Transport->tls, buf, len);
+    int res = tls_client_write(&_Transport->tls, buf, len);
+    if (res < 0 && errno == EAGAIN) {
+      _Transport->want = transport_tls_want(_Transport);
+    }
+    return res;
   }
 
 
   if (_Transport->use_tls == false) {
-    return tcp_client_write_simple(&_Transport->tcp, buf, len);
+    int res = tcp_client_write_simple(&_Transport->tcp, buf, len);
+    if (res < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+      _Transport->want = TRANSPORT_WANT_WRITE;
+    }
+    return res;
   }
 
   // If we are here something went wrong
   return ERR_IO;
 }
 
+/* tls_client gathers the buffers into records itself, stop at the first one it can't take */
+static ssize_t transport_tls_writev(Transport* _Transport, const struct iovec* _iov, int _count)
+{
+  ssize_t total = 0;
+
+  for (int i = 0; i < _count; i++) {
+    if (_iov[i].iov_len == 0) {
+      continue;
+    }
+
+    int res = tls_client_write(&_Transport->tls, (const uint8_t*)_iov[i].iov_base, _iov[i].iov_len);
+    if (res < 0) {
+      if (errno == EAGAIN) {
+        _Transport->want = transport_tls_want(_Transport);
+      }
+      return total > 0 ? total : res;
+    }
+
+    total += res;
+    if ((size_t)res < _iov[i].iov_len) {
+      break;
+    }
+  }
+
+  return total;
+}
+
+ssize_t transport_writev(Transport* _Transport, const struct iovec* _iov, int _count)
+{
+  if (_Transport == NULL || (_iov == NULL && _count > 0) || _count < 0) {
+    return ERR_INVALID_ARG;
+  }
+
+  _Transport->want = TRANSPORT_WANT_NONE;
+
+  if (_Transport->use_tls) {
+    return transport_tls_writev(_Transport, _iov, _count);
+  }
+
+  ssize_t res = tcp_client_writev(&_Transport->tcp, _iov, _count);
+  if (res < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+    _Transport->want = TRANSPORT_WANT_WRITE;
+  }
+  return res;
+}
+
+int transport_flush(Transport* _Transport)
+{
+  if (_Transport == NULL) {
+    return ERR_INVALID_ARG;
+  }
+
+  _Transport->want = TRANSPORT_WANT_NONE;
+
+  if (!_Transport->use_tls) {
+    return SUCCESS;
+  }
+
+  if (tls_client_flush(&_Transport->tls) == SUCCESS) {
+    return SUCCESS;
+  }
+
+  if (errno == EAGAIN) {
+    _Transport->want = transport_tls_want(_Transport);
+    return ERR_IN_PROGRESS;
+  }
+
+  return ERR_IO;
+}
+
+ssize_t transport_sendfile(Transport* _Transport, int _fd, off_t* _offset, size_t _count)
+{
+  if (_Transport == NULL || _Transport->use_tls || _fd < 0 || !_offset) {
+    return ERR_INVALID_ARG;
+  }
+
+  _Transport->want = TRANSPORT_WANT_NONE;
+
+  ssize_t res = tcp_client_sendfile(&_Transport->tcp, _fd, _offset, _count);
+  if (res < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+    _Transport->want = TRANSPORT_WANT_WRITE;
+  }
+  return res;
+}
+
 int transport_finish_connect(Transport* t)
 {
 
@@ -154,6 +289,8 @@ int transport_finish_connect(Transport* t)
     return ERR_INVALID_ARG;
   }
 
+  t->want = TRANSPORT_WANT_NONE;
+
   if (!t->use_tls) {
     if (t->use_blocking) {
       return SUCCESS;
@@ -187,6 +324,7 @@ int transport_finish_connect(Transport* t)
   }
 
   if (hs == ERR_IN_PROGRESS) {
+    t->want = transport_tls_want(t);
     return ERR_IN_PROGRESS;
   }
 
@@ -194,6 +332,14 @@ int transport_finish_connect(Transport* t)
   return ERR_IO;
 }
 
+int transport_get_fd(Transport* _Transport)
+{
+  if (!_Transport) {
+    return -1;
+  }
+
+  return _Transport->tcp.fd;
+}
 
 void transport_dispose(Transport* _Transport)
 {
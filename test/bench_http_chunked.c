@@ -0,0 +1,109 @@
+/* From root:
+ * gcc -O2 -Imodules/include -Iutils/include test/bench_http_chunked.c modules/src/http_chunked.c utils/src/byte_buffer.c -o chunked_bench
+ *
+ * Decodes a 10k-chunk response the way HTTP_Client does: fed in recv()-sized
+ * pieces and collected into a Byte_Buffer. "whole" feeds the response at once,
+ * "16k" in HTTP_CLIENT_READ_CHUNK sized pieces, "1460" in TCP segment sized ones */
+
+#define _POSIX_C_SOURCE 200809L
+#include "maestromodules/http_chunked.h"
+#include "maestroutils/byte_buffer.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#define CHUNKS    10000
+#define MAX_CHUNK 4096
+#define ROUNDS    50
+
+static double now_ms(void)
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1000.0 + ts.tv_nsec / 1e6;
+}
+
+static int collect(void* _context, const uint8_t* _data, size_t _len)
+{
+  return byte_buffer_append((Byte_Buffer*)_context, _data, _len);
+}
+
+static size_t build_response(uint8_t** _out, size_t* _body_len)
+{
+  size_t cap = (size_t)CHUNKS * (MAX_CHUNK + 32) + 64;
+  uint8_t* buf = malloc(cap);
+  if (!buf)
+    exit(1);
+
+  size_t o = 0, body = 0;
+  srand(42);
+  for (int i = 0; i < CHUNKS; i++) {
+    size_t n = 1 + (size_t)rand() % MAX_CHUNK;
+    o += (size_t)sprintf((char*)buf + o, i % 16 ? "%zx\r\n" : "%zx;name=value\r\n", n);
+    memset(buf + o, 'a' + i % 26, n);
+    o += n;
+    buf[o++] = '\r';
+    buf[o++] = '\n';
+    body += n;
+  }
+  o += (size_t)sprintf((char*)buf + o, "0\r\nX-Trailer: 1\r\n\r\n");
+
+  *_out      = buf;
+  *_body_len = body;
+  return o;
+}
+
+static void run(const char* _name, const uint8_t* _resp, size_t _resp_len, size_t _body_len,
+                size_t _piece)
+{
+  Byte_Buffer body = {0};
+  double      best = 1e30;
+
+  for (int r = 0; r < ROUNDS; r++) {
+    HTTP_Chunked Decoder;
+    http_chunked_init(&Decoder);
+    byte_buffer_clear(&body);
+
+    double t0  = now_ms();
+    size_t pos = 0;
+    while (pos < _resp_len && !http_chunked_done(&Decoder)) {
+      size_t len      = _resp_len - pos < _piece ? _resp_len - pos : _piece;
+      size_t consumed = 0;
+      if (http_chunked_feed(&Decoder, _resp + pos, len, &consumed, collect, &body) != SUCCESS) {
+        printf("%s: decode failed\n", _name);
+        exit(1);
+      }
+      pos += consumed;
+    }
+    double ms = now_ms() - t0;
+
+    if (!http_chunked_done(&Decoder) || byte_buffer_readable(&body) != _body_len) {
+      printf("%s: wrong body\n", _name);
+      exit(1);
+    }
+    if (ms < best)
+      best = ms;
+  }
+
+  printf("%-6s %8.3f ms  %8.1f MB/s  %6.1f ns/chunk\n", _name, best,
+         (double)_resp_len / (best / 1000.0) / 1e6, best * 1e6 / CHUNKS);
+  byte_buffer_dispose(&body);
+}
+
+int main(void)
+{
+  uint8_t* resp     = NULL;
+  size_t   body_len = 0;
+  size_t   resp_len = build_response(&resp, &body_len);
+
+  printf("%d chunks, %zu bytes on the wire, %zu body bytes, best of %d\n", CHUNKS, resp_len,
+         body_len, ROUNDS);
+
+  run("whole", resp, resp_len, body_len, resp_len);
+  run("16k", resp, resp_len, body_len, 16384);
+  run("1460", resp, resp_len, body_len, 1460);
+
+  free(resp);
+  return 0;
+}
@@ -0,0 +1,202 @@
+/* From root:
+ * gcc -O2 -Imodules/include -Iutils/include test/bench_http_scan.c modules/src/http_scan.c modules/src/http_headers.c -o scan_bench
+ *
+ * Runs the header scanning kernels over a CDN-style response header block.
+ * "bytes" is the byte-at-a-time code the parser used before, the other rows
+ * are the kernels at each level the CPU supports. "lines" finds every CRLF
+ * in the block, "end" the blank line, "token" checks every header name,
+ * "lower" lowercases them and "table" is a full http_header_table_parse */
+
+#define _POSIX_C_SOURCE 200809L
+#include "maestromodules/http_headers.h"
+#include "maestromodules/http_scan.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#define ROUNDS 200000
+
+static const char Headers[] =
+    "HTTP/1.1 200 OK\r\n"
+    "Date: Tue, 14 Oct 2025 09:21:07 GMT\r\n"
+    "Content-Type: application/json; charset=utf-8\r\n"
+    "Content-Length: 48213\r\n"
+    "Connection: keep-alive\r\n"
+    "Cache-Control: public, max-age=300, stale-while-revalidate=60\r\n"
+    "ETag: W/\"bc4d-18f3a1c2e7b\"\r\n"
+    "Last-Modified: Tue, 14 Oct 2025 09:15:42 GMT\r\n"
+    "Vary: Accept-Encoding, Origin\r\n"
+    "Access-Control-Allow-Origin: *\r\n"
+    "Strict-Transport-Security: max-age=31536000; includeSubDomains; preload\r\n"
+    "X-Content-Type-Options: nosniff\r\n"
+    "X-Frame-Options: SAMEORIGIN\r\n"
+    "Age: 112\r\n"
+    "X-Cache: Hit from cloudfront\r\n"
+    "Via: 1.1 5f3c2a8e1b7d4c9a.cloudfront.net (CloudFront)\r\n"
+    "X-Amz-Cf-Pop: ARN56-P1\r\n"
+    "X-Amz-Cf-Id: q8Yv3nH1x2F0kLzR7pWcJ4dT9uE6bS5aM1oV8gN2rC3iK7hX0yQ==\r\n"
+    "Server-Timing: cdn-cache; desc=HIT, edge; dur=1, origin; dur=0\r\n"
+    "Alt-Svc: h3=\":443\"; ma=86400\r\n"
+    "\r\n";
+
+static volatile size_t Sink;
+
+static double now_ms(void)
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1000.0 + ts.tv_nsec / 1e6;
+}
+
+/* The parser's loops before the kernels */
+static size_t bytes_crlf(const uint8_t* _buf, size_t _len)
+{
+  for (size_t i = 0; i + 1 < _len; i++) {
+    if (_buf[i] == '\r' && _buf[i + 1] == '\n') {
+      return i;
+    }
+  }
+  return _len;
+}
+
+static size_t bytes_headers_end(const uint8_t* _buf, size_t _len)
+{
+  for (size_t i = 0; i + 3 < _len; i++) {
+    if (_buf[i] == '\r' && _buf[i + 1] == '\n' && _buf[i + 2] == '\r' && _buf[i + 3] == '\n') {
+      return i;
+    }
+  }
+  return _len;
+}
+
+static size_t bytes_token(const uint8_t* _buf, size_t _len)
+{
+  size_t i = 0;
+  while (i < _len && _buf[i] > 0x20 && _buf[i] < 0x7F && !strchr("\"(),/:;<=>?@[\\]{}", _buf[i])) {
+    i++;
+  }
+  return i;
+}
+
+static void bytes_lower(uint8_t* _dst, const uint8_t* _src, size_t _len)
+{
+  for (size_t i = 0; i < _len; i++) {
+    _dst[i] = (_src[i] >= 'A' && _src[i] <= 'Z') ? (uint8_t)(_src[i] | 0x20) : _src[i];
+  }
+}
+
+typedef struct
+{
+  size_t (*crlf)(const uint8_t*, size_t);
+  size_t (*headers_end)(const uint8_t*, size_t);
+  size_t (*token)(const uint8_t*, size_t);
+  void (*lower)(uint8_t*, const uint8_t*, size_t);
+
+} Kernels;
+
+static size_t Names[32];
+static size_t Name_Lens[32];
+static int    Name_Count;
+
+static void find_names(const uint8_t* _buf, size_t _len)
+{
+  size_t pos = bytes_crlf(_buf, _len) + 2; // Past the status line
+  while (pos < _len) {
+    size_t end = pos + bytes_crlf(_buf + pos, _len - pos);
+    if (end == pos) {
+      break;
+    }
+    const uint8_t* colon = memchr(_buf + pos, ':', end - pos);
+    Names[Name_Count]     = pos;
+    Name_Lens[Name_Count] = (size_t)(colon - _buf) - pos;
+    Name_Count++;
+    pos = end + 2;
+  }
+}
+
+static void run(const char* _name, const Kernels* _K, const uint8_t* _buf, size_t _len)
+{
+  double  best[5] = {1e30, 1e30, 1e30, 1e30, 1e30};
+  uint8_t lower[64];
+
+  for (int pass = 0; pass < 5; pass++) {
+    double t0 = now_ms();
+    for (int r = 0; r < ROUNDS; r++) {
+      size_t acc = 0;
+      switch (pass) {
+      case 0:
+        for (size_t pos = 0; pos < _len;) {
+          size_t line = _K->crlf(_buf + pos, _len - pos);
+          acc += line;
+          pos += line + 2;
+        }
+        break;
+      case 1:
+        acc = _K->headers_end(_buf, _len);
+        break;
+      case 2:
+        for (int i = 0; i < Name_Count; i++) {
+          acc += _K->token(_buf + Names[i], Name_Lens[i]);
+        }
+        break;
+      case 3:
+        for (int i = 0; i < Name_Count; i++) {
+          _K->lower(lower, _buf + Names[i], Name_Lens[i]);
+          acc += lower[0];
+        }
+        break;
+      default: {
+        HTTP_Header_Table Table = {0};
+        http_header_table_parse(&Table, (const char*)_buf + Names[0], _len - Names[0]);
+        acc = (size_t)Table.count;
+        http_header_table_clear(&Table);
+        break;
+      }
+      }
+      Sink = acc;
+    }
+    double ms = now_ms() - t0;
+    if (ms < best[pass])
+      best[pass] = ms;
+  }
+
+  printf("%-7s", _name);
+  for (int i = 0; i < 5; i++) {
+    printf(" %8.1f", best[i] * 1e6 / ROUNDS);
+  }
+  printf("\n");
+}
+
+int main(void)
+{
+  const uint8_t* buf = (const uint8_t*)Headers;
+  size_t         len = sizeof(Headers) - 1;
+  find_names(buf, len);
+
+  if (bytes_headers_end(buf, len) != http_scan_headers_end(buf, len)) {
+    printf("kernels disagree\n");
+    return 1;
+  }
+
+  printf("%zu byte header block, %d headers, ns per block, %d rounds\n", len, Name_Count, ROUNDS);
+  printf("%-7s %8s %8s %8s %8s %8s\n", "", "lines", "end", "token", "lower", "table");
+
+  // The table row for "bytes" runs at the scalar level, the closest there is to the old parser
+  http_scan_set_level(HTTP_SCAN_LEVEL_SCALAR);
+  Kernels bytes = {bytes_crlf, bytes_headers_end, bytes_token, bytes_lower};
+  run("bytes", &bytes, buf, len);
+
+  static const char* const level_names[] = {"scalar", "sse2", "avx2"};
+  Kernels                  scan = {http_scan_crlf, http_scan_headers_end, http_scan_token,
+                                   http_scan_lower};
+  for (int level = HTTP_SCAN_LEVEL_SCALAR; level <= HTTP_SCAN_LEVEL_AVX2; level++) {
+    if (http_scan_set_level((HTTP_Scan_Level)level) != (HTTP_Scan_Level)level) {
+      printf("%-7s not supported\n", level_names[level]);
+      continue;
+    }
+    run(level_names[level], &scan, buf, len);
+  }
+
+  return 0;
+}
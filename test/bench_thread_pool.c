@@ -0,0 +1,97 @@
+/* From root:
+ * gcc -O2 -Imodules/include -Iutils/include test/bench_thread_pool.c modules/src/thread_pool.c -lpthread -o tp_bench
+ *
+ * Compares the shared queue with work stealing at 1-64 threads.
+ * "flat" adds every task from the main thread, "spawn" adds a few root tasks
+ * that each add their children from inside the pool */
+
+#define _POSIX_C_SOURCE 200809L
+#include "maestromodules/thread_pool.h"
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#define TASKS      200000
+#define ROOTS      64
+#define WORK_ITERS 200
+
+static Thread_Pool* Bench_Pool;
+static _Atomic long Bench_Done;
+
+static double now_ms(void)
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1000.0 + ts.tv_nsec / 1e6;
+}
+
+static void small_work(void* _arg)
+{
+  (void)_arg;
+  volatile long acc = 0;
+  for (int i = 0; i < WORK_ITERS; i++)
+    acc += i * i;
+  atomic_fetch_add(&Bench_Done, 1);
+}
+
+static void spawn_root(void* _arg)
+{
+  (void)_arg;
+  for (int i = 0; i < TASKS / ROOTS; i++) {
+    TP_Task Task = { .thread_func = small_work, NULL, NULL, NULL };
+    tp_task_add(Bench_Pool, &Task);
+  }
+}
+
+static double run(int _threads, bool _stealing, bool _spawn)
+{
+  TP_Config Config = { .max_threads = _threads, .work_stealing = _stealing };
+  Bench_Pool = tp_init_ex(&Config);
+  if (!Bench_Pool) {
+    perror("tp_init_ex");
+    exit(1);
+  }
+  atomic_store(&Bench_Done, 0);
+
+  double start = now_ms();
+
+  if (_spawn) {
+    for (int i = 0; i < ROOTS; i++) {
+      TP_Task Task = { .thread_func = spawn_root, NULL, NULL, NULL };
+      tp_task_add(Bench_Pool, &Task);
+    }
+  } else {
+    for (int i = 0; i < TASKS; i++) {
+      TP_Task Task = { .thread_func = small_work, NULL, NULL, NULL };
+      tp_task_add(Bench_Pool, &Task);
+    }
+  }
+
+  /* Children are added before their root finishes, so tp_wait covers them */
+  tp_wait(Bench_Pool);
+
+  if (atomic_load(&Bench_Done) != (_spawn ? (TASKS / ROOTS) * ROOTS : TASKS))
+    fprintf(stderr, "lost tasks: %ld\n", atomic_load(&Bench_Done));
+
+  double elapsed = now_ms() - start;
+  tp_dispose(Bench_Pool);
+
+  return elapsed;
+}
+
+int main()
+{
+  int threads[] = { 1, 2, 4, 8, 16, 32, 64 };
+
+  printf("%8s %12s %12s %12s %12s\n", "threads", "flat/queue", "flat/steal", "spawn/queue",
+         "spawn/steal");
+
+  for (size_t i = 0; i < sizeof(threads) / sizeof(threads[0]); i++) {
+    int n = threads[i];
+    printf("%8d %10.1fms %10.1fms %10.1fms %10.1fms\n", n, run(n, false, false),
+           run(n, true, false), run(n, false, true), run(n, true, true));
+  }
+
+  return 0;
+}
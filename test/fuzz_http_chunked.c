@@ -0,0 +1,167 @@
+/* From root, with libFuzzer:
+ * clang -g -O1 -fsanitize=fuzzer,address -DHTTP_CHUNKED_LIBFUZZER -Imodules/include -Iutils/include test/fuzz_http_chunked.c modules/src/http_chunked.c -o chunked_fuzz
+ *
+ * Or standalone (random valid and mutated bodies):
+ * gcc -g -O1 -fsanitize=address,undefined -Imodules/include -Iutils/include test/fuzz_http_chunked.c modules/src/http_chunked.c -o chunked_fuzz
+ *
+ * Every input is decoded in one feed and again split into small pieces the way
+ * recv() may deliver it. Both runs must agree on the result, the bytes used
+ * and the decoded body */
+
+#include "maestromodules/http_chunked.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+typedef struct
+{
+  uint8_t* data;
+  size_t   len;
+  size_t   cap;
+
+} Fuzz_Out;
+
+static int fuzz_collect(void* _context, const uint8_t* _data, size_t _len)
+{
+  Fuzz_Out* Out = _context;
+  if (Out->len + _len > Out->cap) {
+    size_t cap = Out->cap ? Out->cap : 256;
+    while (cap < Out->len + _len)
+      cap *= 2;
+    Out->data = realloc(Out->data, cap);
+    if (!Out->data)
+      abort();
+    Out->cap = cap;
+  }
+  memcpy(Out->data + Out->len, _data, _len);
+  Out->len += _len;
+  return 0;
+}
+
+/* Feeds _data in pieces whose sizes come from _split, like a caller that keeps the unused rest */
+static int fuzz_decode(const uint8_t* _data, size_t _size, const uint8_t* _split, size_t _split_len,
+                       HTTP_Chunked* _Decoder, Fuzz_Out* _Out, size_t* _used)
+{
+  size_t avail = 0;
+  size_t pos   = 0;
+  size_t s     = 0;
+  int    res   = SUCCESS;
+
+  http_chunked_init(_Decoder);
+
+  while (avail < _size || pos < avail) {
+    if (avail < _size) {
+      size_t piece = _split_len ? 1 + (size_t)(_split[s++ % _split_len] % 13) : _size;
+      avail        = avail + piece > _size ? _size : avail + piece;
+    }
+
+    size_t consumed = 0;
+    res = http_chunked_feed(_Decoder, _data + pos, avail - pos, &consumed, fuzz_collect, _Out);
+    if (consumed > avail - pos)
+      abort();
+    pos += consumed;
+
+    if (res != SUCCESS || http_chunked_done(_Decoder))
+      break;
+    if (avail == _size && consumed == 0)
+      break;
+  }
+
+  *_used = pos;
+  return res;
+}
+
+int LLVMFuzzerTestOneInput(const uint8_t* _data, size_t _size)
+{
+  HTTP_Chunked Whole, Split;
+  Fuzz_Out     out_whole = {0}, out_split = {0};
+  size_t       used_whole = 0, used_split = 0;
+
+  int res_whole = fuzz_decode(_data, _size, NULL, 0, &Whole, &out_whole, &used_whole);
+  int res_split = fuzz_decode(_data, _size, _data, _size, &Split, &out_split, &used_split);
+
+  if (res_whole != res_split || Whole.state != Split.state)
+    abort();
+  if (out_whole.len != out_split.len || Whole.body_len != out_whole.len)
+    abort();
+  if (out_whole.len && memcmp(out_whole.data, out_split.data, out_whole.len) != 0)
+    abort();
+  // Where a done or broken body stops must not depend on how it was split
+  if ((res_whole != SUCCESS || http_chunked_done(&Whole)) && used_whole != used_split)
+    abort();
+
+  free(out_whole.data);
+  free(out_split.data);
+  return 0;
+}
+
+#ifndef HTTP_CHUNKED_LIBFUZZER
+
+#define FUZZ_ROUNDS 20000
+
+/* Random valid encoding of _body, with extensions, odd hex case and trailers */
+static size_t fuzz_encode(const uint8_t* _body, size_t _len, uint8_t* _out)
+{
+  size_t o = 0, i = 0;
+  while (i < _len) {
+    size_t n = 1 + (size_t)rand() % 300;
+    if (n > _len - i)
+      n = _len - i;
+    o += (size_t)sprintf((char*)_out + o, rand() % 2 ? "%zx" : "%zX", n);
+    if (rand() % 4 == 0)
+      o += (size_t)sprintf((char*)_out + o, ";ext=%d", rand());
+    o += (size_t)sprintf((char*)_out + o, "\r\n");
+    memcpy(_out + o, _body + i, n);
+    o += n;
+    i += n;
+    o += (size_t)sprintf((char*)_out + o, "\r\n");
+  }
+  o += (size_t)sprintf((char*)_out + o, "0\r\n");
+  if (rand() % 2)
+    o += (size_t)sprintf((char*)_out + o, "X-Checksum: %d\r\n", rand());
+  o += (size_t)sprintf((char*)_out + o, "\r\n");
+  return o;
+}
+
+int main(void)
+{
+  static uint8_t body[4096], enc[16384];
+  srand(1234);
+
+  int broken = 0;
+  for (int round = 0; round < FUZZ_ROUNDS; round++) {
+    size_t len = (size_t)rand() % sizeof(body);
+    for (size_t i = 0; i < len; i++)
+      body[i] = (uint8_t)rand();
+
+    size_t enc_len = fuzz_encode(body, len, enc);
+
+    // Valid input must decode back to the body and stop at the final CRLF
+    HTTP_Chunked Decoder;
+    Fuzz_Out     out  = {0};
+    size_t       used = 0;
+    if (fuzz_decode(enc, enc_len, enc, enc_len, &Decoder, &out, &used) != SUCCESS ||
+        !http_chunked_done(&Decoder) || used != enc_len || out.len != len ||
+        (len && memcmp(out.data, body, len) != 0)) {
+      printf("round %d: valid body decoded wrong\n", round);
+      return 1;
+    }
+    free(out.data);
+
+    // Then flip a few bytes and only check the invariants
+    int flips = 1 + rand() % 4;
+    for (int f = 0; f < flips; f++)
+      enc[(size_t)rand() % enc_len] = (uint8_t)rand();
+
+    LLVMFuzzerTestOneInput(enc, enc_len);
+    memset(&out, 0, sizeof(out));
+    if (fuzz_decode(enc, enc_len, NULL, 0, &Decoder, &out, &used) != SUCCESS)
+      broken++;
+    free(out.data);
+  }
+
+  printf("%d rounds ok, %d mutated inputs rejected\n", FUZZ_ROUNDS, broken);
+  return 0;
+}
+
+#endif
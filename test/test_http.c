@@ -25,6 +25,33 @@ int tcp_write_simple_stub(TCP_Client* client, const uint8_t* buf, int len, int n
   return len;
 }
 
+/**
+ * Gathered write stub, keeps what was sent and whether the caller's body went out in place.
+ */
+static uint8_t        sent_bytes[8192 + 1]; // NUL after the last byte for strstr
+static size_t         sent_len;
+static const uint8_t* sent_body_ptr;
+
+ssize_t tcp_writev_stub(TCP_Client* client, const struct iovec* iov, int count, int num_calls)
+{
+  (void)client;
+  (void)num_calls;
+  ssize_t total = 0;
+  for (int i = 0; i < count; i++) {
+    if (i > 0 && !sent_body_ptr) {
+      sent_body_ptr = iov[i].iov_base;
+    }
+    size_t len = iov[i].iov_len;
+    if (sent_len + len > sizeof(sent_bytes) - 1) {
+      len = sizeof(sent_bytes) - 1 - sent_len;
+    }
+    memcpy(sent_bytes + sent_len, iov[i].iov_base, len);
+    sent_len += len;
+    total += (ssize_t)iov[i].iov_len;
+  }
+  return total;
+}
+
 /**
  * Dynamic memory allocation stub for TCP data.
  */
@@ -72,6 +99,22 @@ int tcp_read_fragmented_body_stub(TCP_Client* client, uint8_t* buf, int buf_len,
   return 0;
 }
 
+/**
+ * Lower case header names with extra whitespace around the values.
+ */
+int tcp_read_lowercase_headers_stub(TCP_Client* client, uint8_t* buf, int buf_len, int num_calls)
+{
+  (void)client;
+  (void)buf_len;
+  const char* parts[] = {"HTTP/1.1 200 OK\r\nx-custom: 1\r\ncontent-length:   6  \r\n\r\n",
+                         "LOWER!"};
+  if (num_calls < 2) {
+    memcpy(buf, parts[num_calls], strlen(parts[num_calls]));
+    return (int)strlen(parts[num_calls]);
+  }
+  return 0;
+}
+
 /**
  * Refined non-blocking stub.
  * Delivers headers and body in separate calls and uses EAGAIN to test retry logic.
@@ -135,6 +178,9 @@ void setUp(void)
   GlobalVerifyOrder = 0;
   GlobalOrderError  = NULL;
   errno             = 0;
+  sent_len          = 0;
+  sent_body_ptr     = NULL;
+  memset(sent_bytes, 0, sizeof(sent_bytes));
   Mocktcp_client_Init();
 }
 
@@ -162,6 +208,7 @@ void test_http_get_chunked_success(void)
 {
   http_data out = {0};
   tcp_client_write_simple_StubWithCallback(tcp_write_simple_stub);
+  tcp_client_writev_StubWithCallback(tcp_writev_stub);
   tcp_client_read_simple_StubWithCallback(tcp_read_valid_chunked_stub);
   tcp_client_realloc_data_StubWithCallback(tcp_realloc_stub);
 
@@ -183,6 +230,7 @@ void test_http_get_fragmented_content_length(void)
 {
   http_data out = {0};
   tcp_client_write_simple_StubWithCallback(tcp_write_simple_stub);
+  tcp_client_writev_StubWithCallback(tcp_writev_stub);
   tcp_client_read_simple_StubWithCallback(tcp_read_fragmented_body_stub);
   tcp_client_realloc_data_StubWithCallback(tcp_realloc_stub);
 
@@ -200,10 +248,33 @@ void test_http_get_fragmented_content_length(void)
     free(out.addr);
 }
 
+void test_http_get_header_names_ignore_case(void)
+{
+  http_data out = {0};
+  tcp_client_write_simple_StubWithCallback(tcp_write_simple_stub);
+  tcp_client_writev_StubWithCallback(tcp_writev_stub);
+  tcp_client_read_simple_StubWithCallback(tcp_read_lowercase_headers_stub);
+  tcp_client_realloc_data_StubWithCallback(tcp_realloc_stub);
+
+  tcp_client_blocking_init_IgnoreAndReturn(0);
+  tcp_client_dispose_Expect(NULL);
+  tcp_client_dispose_IgnoreArg__Client();
+
+  int result = http_blocking_get("http://lowercase.com", &out, 1000);
+
+  TEST_ASSERT_EQUAL_INT(0, result);
+  TEST_ASSERT_EQUAL_INT(6, out.size);
+  TEST_ASSERT_EQUAL_MEMORY("LOWER!", out.addr, 6);
+
+  if (out.addr)
+    free(out.addr);
+}
+
 void test_http_get_non_blocking_retries(void)
 {
   http_data out = {0};
   tcp_client_write_simple_StubWithCallback(tcp_write_simple_stub);
+  tcp_client_writev_StubWithCallback(tcp_writev_stub);
   tcp_client_read_simple_StubWithCallback(tcp_read_non_blocking_retry_stub);
   tcp_client_realloc_data_StubWithCallback(tcp_realloc_stub);
 
@@ -225,6 +296,7 @@ void test_http_get_resilience_mid_payload(void)
 {
   http_data out = {0};
   tcp_client_write_simple_StubWithCallback(tcp_write_simple_stub);
+  tcp_client_writev_StubWithCallback(tcp_writev_stub);
   tcp_client_read_simple_StubWithCallback(tcp_read_unstable_chunks_stub);
   tcp_client_realloc_data_StubWithCallback(tcp_realloc_stub);
 
@@ -251,6 +323,7 @@ void test_http_post_large_data(void)
   http_data in = {.addr = large_payload, .size = (ssize_t)large_size};
 
   tcp_client_write_simple_StubWithCallback(tcp_write_simple_stub);
+  tcp_client_writev_StubWithCallback(tcp_writev_stub);
   tcp_client_read_simple_StubWithCallback(tcp_read_valid_chunked_stub);
   tcp_client_realloc_data_StubWithCallback(tcp_realloc_stub);
 
@@ -267,6 +340,33 @@ void test_http_post_large_data(void)
     free(out.addr);
 }
 
+void test_http_post_sends_body_in_place(void)
+{
+  http_data out       = {0};
+  uint8_t   payload[] = "0123456789";
+  http_data in        = {.addr = payload, .size = 10};
+
+  tcp_client_write_simple_StubWithCallback(tcp_write_simple_stub);
+  tcp_client_writev_StubWithCallback(tcp_writev_stub);
+  tcp_client_read_simple_StubWithCallback(tcp_read_fragmented_body_stub);
+  tcp_client_realloc_data_StubWithCallback(tcp_realloc_stub);
+
+  tcp_client_blocking_init_IgnoreAndReturn(0);
+  tcp_client_dispose_Expect(NULL);
+  tcp_client_dispose_IgnoreArg__Client();
+
+  int result = http_blocking_post("http://post-in-place.com/upload", &in, &out, 2000);
+
+  TEST_ASSERT_EQUAL_INT(0, result);
+  TEST_ASSERT_EQUAL_PTR(payload, sent_body_ptr);
+  TEST_ASSERT_NOT_NULL(strstr((char*)sent_bytes, "Content-Length: 10\r\n"));
+  TEST_ASSERT_TRUE(sent_len > 10);
+  TEST_ASSERT_EQUAL_MEMORY("\r\n\r\n0123456789", sent_bytes + sent_len - 14, 14);
+
+  if (out.addr)
+    free(out.addr);
+}
+
 /* --- MAIN --- */
 
 int main(void)
@@ -275,8 +375,10 @@ int main(void)
   RUN_TEST(test_http_blocking_get_should_fail_if_tcp_connect_fails);
   RUN_TEST(test_http_get_chunked_success);
   RUN_TEST(test_http_get_fragmented_content_length);
+  RUN_TEST(test_http_get_header_names_ignore_case);
   RUN_TEST(test_http_get_non_blocking_retries);
   RUN_TEST(test_http_get_resilience_mid_payload);
   RUN_TEST(test_http_post_large_data);
+  RUN_TEST(test_http_post_sends_body_in_place);
   return UNITY_END();
 }
@@ -1,7 +1,9 @@
 /* From root: 
- * gcc -Imodules/include modules/tests/test_thread_pool.c modules/src/thread_pool.c modules/src/linked_list.c -o tp_test */
+ * gcc -Imodules/include -Iutils/include test/test_thread_pool.c modules/src/thread_pool.c modules/src/linked_list.c -lpthread -o tp_test */
 
 #include "maestromodules/thread_pool.h"
+#include "maestroutils/error.h"
+#include <stdatomic.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <time.h>
@@ -16,8 +18,74 @@ void thread_func(void* _arg)
   usleep(50000);
 }
 
+static atomic_int batch_runs;
+static int        batch_result;
+
+typedef struct {
+  Thread_Pool* pool;
+  int          high;
+
+} Batch_Arg;
+
+static void batch_count(void* _arg)
+{
+  (void)_arg;
+  atomic_fetch_add(&batch_runs, 1);
+}
+
+/* From inside a worker: 7 plain tasks fit the deque, high HIGH tasks go to the shared queue */
+static void batch_from_worker(void* _arg)
+{
+  Batch_Arg* Arg = _arg;
+  TP_Task    Tasks[9];
+  for (int i = 0; i < 7 + Arg->high; i++)
+    Tasks[i] = (TP_Task){ .thread_func = batch_count,
+                          .priority    = i < 7 ? TP_PRIORITY_NORMAL : TP_PRIORITY_HIGH };
+
+  batch_result = tp_task_add_batch(Arg->pool, Tasks, 7 + Arg->high);
+}
+
+/* TP_BACKPRESSURE_FAIL batches are all or nothing, also the part bound for the worker's deque */
+static int test_batch_fail_queues_nothing()
+{
+  TP_Config    Config = { .max_threads    = 2,
+                          .work_stealing  = true,
+                          .queue_capacity = 1,
+                          .backpressure   = TP_BACKPRESSURE_FAIL };
+  Thread_Pool* Pool   = tp_init_ex(&Config);
+  if (!Pool) {
+    perror("tp_init_ex");
+    return 1;
+  }
+
+  int failed      = 0;
+  int highs[]     = { 2, 1 };
+  int want_res[]  = { ERR_BUSY, 0 };
+  int want_runs[] = { 0, 8 };
+
+  for (int i = 0; i < 2; i++) {
+    atomic_store(&batch_runs, 0);
+    Batch_Arg Arg   = { .pool = Pool, .high = highs[i] };
+    TP_Task   Outer = { .thread_func = batch_from_worker, .thread_arg = &Arg };
+    tp_task_add(Pool, &Outer);
+    tp_wait(Pool);
+
+    if (batch_result != want_res[i] || atomic_load(&batch_runs) != want_runs[i]) {
+      printf("batch with %d HIGH: returned %d ran %d, want %d ran %d\n", highs[i], batch_result,
+             atomic_load(&batch_runs), want_res[i], want_runs[i]);
+      failed = 1;
+    }
+  }
+
+  tp_dispose(Pool);
+  return failed;
+}
+
 int main()
 {
+  if (test_batch_fail_queues_nothing() != 0)
+    return 1;
+
   Thread_Pool* Pool = tp_init(MAX_THREADS);
   if (!Pool)
   {
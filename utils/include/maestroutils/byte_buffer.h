@@ -0,0 +1,76 @@
+#ifndef __BYTE_BUFFER_H__
+#define __BYTE_BUFFER_H__
+
+/* Growable byte buffer with separate read and write cursors.
+ *
+ *   data          read_pos          write_pos          capacity
+ *    |  consumed  |    readable     |     writable      |
+ *
+ * Producers write straight into the free tail (byte_buffer_reserve +
+ * byte_buffer_commit), consumers advance read_pos instead of shifting bytes.
+ * Consumed space is reclaimed lazily, only when that moves no more bytes than
+ * were consumed, so every byte is copied O(1) times on average. The readable
+ * region is always followed by a NUL byte.
+ *
+ * A zeroed Byte_Buffer is a valid empty buffer. */
+
+#include <stddef.h>
+#include <stdint.h>
+
+typedef struct
+{
+  uint8_t* data;
+  size_t   capacity;
+  size_t   read_pos;  // First unconsumed byte
+  size_t   write_pos; // End of the readable region
+
+} Byte_Buffer;
+
+#ifndef BYTE_BUFFER_MIN_CAPACITY
+#define BYTE_BUFFER_MIN_CAPACITY 1024
+#endif
+
+static inline uint8_t* byte_buffer_read_ptr(const Byte_Buffer* _Buffer)
+{
+  return _Buffer->data ? _Buffer->data + _Buffer->read_pos : NULL;
+}
+
+static inline size_t byte_buffer_readable(const Byte_Buffer* _Buffer)
+{
+  return _Buffer->write_pos - _Buffer->read_pos;
+}
+
+static inline uint8_t* byte_buffer_write_ptr(const Byte_Buffer* _Buffer)
+{
+  return _Buffer->data + _Buffer->write_pos;
+}
+
+/* Free bytes after write_pos, excluding the one kept for the NUL */
+static inline size_t byte_buffer_writable(const Byte_Buffer* _Buffer)
+{
+  return _Buffer->capacity ? _Buffer->capacity - _Buffer->write_pos - 1 : 0;
+}
+
+/* Makes room for at least _min_free bytes after write_pos, compacting or doubling.
+ * Returns SUCCESS or ERR_NO_MEMORY */
+int byte_buffer_reserve(Byte_Buffer* _Buffer, size_t _min_free);
+
+/* Marks _len bytes written at byte_buffer_write_ptr as readable */
+void byte_buffer_commit(Byte_Buffer* _Buffer, size_t _len);
+
+/* Drops _len bytes from the front of the readable region */
+void byte_buffer_consume(Byte_Buffer* _Buffer, size_t _len);
+
+/* Copies _len bytes in. Returns SUCCESS or ERR_NO_MEMORY */
+int byte_buffer_append(Byte_Buffer* _Buffer, const void* _data, size_t _len);
+
+/* Hands the readable bytes over as a NUL-terminated malloc'd block, *_len_out gets the length.
+ * The buffer is left empty. NULL on allocation failure */
+uint8_t* byte_buffer_detach(Byte_Buffer* _Buffer, size_t* _len_out);
+
+/* Empties the buffer but keeps its memory */
+void byte_buffer_clear(Byte_Buffer* _Buffer);
+
+void byte_buffer_dispose(Byte_Buffer* _Buffer);
+
+#endif
@@ -40,6 +40,7 @@ typedef enum
   ERR_CONNECTION_FAIL = -24, /**< Failed to establish a connection */
   ERR_BUSY = -25,
   ERR_IN_PROGRESS = -26, /*Connection in progress*/
+  ERR_ABORTED = -27,     /**< Stopped on request of a user callback */
 
   /* ------------------------------------------------------------
    * Parse / Protocol Errors     (-30 to -39)
@@ -9,3 +9,8 @@ const char* json_get_string(cJSON* _Root, const char* _Name);
 void json_set_int(cJSON* _Json, const char* _key, int _val);
 void json_set_double(cJSON* _Json, const char* _key, double _val);
 void json_set_string(cJSON* _Json, const char* _key, const char* _val);
+
+/* cJSON arrays are linked lists. Copies the item pointers of _Array into a
+ * malloc'd array (caller frees) so the items can be indexed, e.g. split into
+ * ranges with tp_parallel_for. Returns item count or -1 on error */
+int json_array_items(cJSON* _Array, cJSON*** _items_out);
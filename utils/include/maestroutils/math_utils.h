@@ -1,5 +1,46 @@
 #include <stdio.h>
 
+/* Plain sums over a (sub)array. Callers splitting work across threads, e.g. a
+ * tp_parallel_reduce body, sum their chunk with these and divide once at the end */
+static inline long long math_sum_int(const int* _inputs, const int _count)
+{
+  if (!_inputs || _count <= 0)
+    return 0;
+
+  int       i;
+  long long counter = 0;
+  for (i = 0; i < _count; i++)
+    counter += _inputs[i];
+
+  return counter;
+}
+
+static inline double math_sum_double(const double* _inputs, const int _count)
+{
+  if (!_inputs || _count <= 0)
+    return 0.0;
+
+  int    i;
+  double counter = 0.0;
+  for (i = 0; i < _count; i++)
+    counter += _inputs[i];
+
+  return counter;
+}
+
+static inline double math_sum_float(const float* _inputs, const int _count)
+{
+  if (!_inputs || _count <= 0)
+    return 0.0;
+
+  int    i;
+  double counter = 0.0;
+  for (i = 0; i < _count; i++)
+    counter += _inputs[i];
+
+  return counter;
+}
+
 static inline int math_get_avg_int(const int* _inputs, const int _count)
 {
   if (!_inputs || _count <= 0)
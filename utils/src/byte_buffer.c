@@ -0,0 +1,148 @@
+#include <maestroutils/byte_buffer.h>
+#include <maestroutils/error.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+int byte_buffer_reserve(Byte_Buffer* _Buffer, size_t _min_free)
+{
+  if (!_Buffer) {
+    return ERR_INVALID_ARG;
+  }
+
+  if (_Buffer->capacity && byte_buffer_writable(_Buffer) >= _min_free) {
+    return SUCCESS;
+  }
+
+  size_t readable = byte_buffer_readable(_Buffer);
+  size_t needed   = readable + _min_free + 1; // + NUL
+
+  /* Sliding the data down is cheap when it moves fewer bytes than were consumed */
+  if (_Buffer->capacity >= needed && _Buffer->read_pos >= readable) {
+    memmove(_Buffer->data, _Buffer->data + _Buffer->read_pos, readable);
+    _Buffer->read_pos       = 0;
+    _Buffer->write_pos      = readable;
+    _Buffer->data[readable] = '\0';
+    return SUCCESS;
+  }
+
+  size_t capacity = _Buffer->capacity ? _Buffer->capacity : BYTE_BUFFER_MIN_CAPACITY;
+  while (capacity < needed) {
+    capacity *= 2;
+  }
+
+  /* Fresh block so only the readable bytes are copied, not the consumed prefix */
+  uint8_t* data = malloc(capacity);
+  if (!data) {
+    perror("malloc");
+    return ERR_NO_MEMORY;
+  }
+
+  if (readable) {
+    memcpy(data, _Buffer->data + _Buffer->read_pos, readable);
+  }
+  data[readable] = '\0';
+
+  free(_Buffer->data);
+  _Buffer->data      = data;
+  _Buffer->capacity  = capacity;
+  _Buffer->read_pos  = 0;
+  _Buffer->write_pos = readable;
+
+  return SUCCESS;
+}
+
+void byte_buffer_commit(Byte_Buffer* _Buffer, size_t _len)
+{
+  if (!_Buffer || !_Buffer->data || _len > byte_buffer_writable(_Buffer)) {
+    return;
+  }
+
+  _Buffer->write_pos += _len;
+  _Buffer->data[_Buffer->write_pos] = '\0';
+}
+
+void byte_buffer_consume(Byte_Buffer* _Buffer, size_t _len)
+{
+  if (!_Buffer) {
+    return;
+  }
+
+  size_t readable = byte_buffer_readable(_Buffer);
+  if (_len >= readable) {
+    byte_buffer_clear(_Buffer);
+    return;
+  }
+
+  _Buffer->read_pos += _len;
+}
+
+int byte_buffer_append(Byte_Buffer* _Buffer, const void* _data, size_t _len)
+{
+  if (!_Buffer || (!_data && _len > 0)) {
+    return ERR_INVALID_ARG;
+  }
+
+  int res = byte_buffer_reserve(_Buffer, _len);
+  if (res != SUCCESS) {
+    return res;
+  }
+
+  if (_len) {
+    memcpy(byte_buffer_write_ptr(_Buffer), _data, _len);
+  }
+  byte_buffer_commit(_Buffer, _len);
+
+  return SUCCESS;
+}
+
+uint8_t* byte_buffer_detach(Byte_Buffer* _Buffer, size_t* _len_out)
+{
+  if (!_Buffer) {
+    return NULL;
+  }
+
+  size_t readable = byte_buffer_readable(_Buffer);
+
+  /* Make sure there is a block to hand over, even for an empty body */
+  if (!_Buffer->data && byte_buffer_reserve(_Buffer, 0) != SUCCESS) {
+    return NULL;
+  }
+
+  if (_Buffer->read_pos > 0) {
+    memmove(_Buffer->data, _Buffer->data + _Buffer->read_pos, readable);
+    _Buffer->data[readable] = '\0';
+  }
+
+  uint8_t* data = _Buffer->data;
+  if (_len_out) {
+    *_len_out = readable;
+  }
+
+  memset(_Buffer, 0, sizeof(Byte_Buffer));
+  return data;
+}
+
+void byte_buffer_clear(Byte_Buffer* _Buffer)
+{
+  if (!_Buffer) {
+    return;
+  }
+
+  _Buffer->read_pos  = 0;
+  _Buffer->write_pos = 0;
+  if (_Buffer->data) {
+    _Buffer->data[0] = '\0';
+  }
+}
+
+void byte_buffer_dispose(Byte_Buffer* _Buffer)
+{
+  if (!_Buffer) {
+    return;
+  }
+
+  free(_Buffer->data);
+  memset(_Buffer, 0, sizeof(Byte_Buffer));
+}
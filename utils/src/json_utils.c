@@ -1,4 +1,5 @@
 #include <maestroutils/json_utils.h>
+#include <stdlib.h>
 
 double json_get_double(cJSON* _Root, const char* _Name)
 {
@@ -53,3 +54,29 @@ void json_set_string(cJSON* _Json, const char* _key, const char* _val)
   else
     cJSON_AddStringToObject(_Json, _key, _val);
 }
+
+int json_array_items(cJSON* _Array, cJSON*** _items_out)
+{
+  if (!cJSON_IsArray(_Array) || _items_out == NULL)
+    return -1;
+
+  *_items_out = NULL;
+
+  int count = cJSON_GetArraySize(_Array);
+  if (count == 0)
+    return 0;
+
+  cJSON** items = malloc((size_t)count * sizeof(cJSON*));
+  if (!items)
+    return -1;
+
+  int    i    = 0;
+  cJSON* item = NULL;
+  cJSON_ArrayForEach(item, _Array)
+  {
+    items[i++] = item;
+  }
+
+  *_items_out = items;
+  return count;
+}
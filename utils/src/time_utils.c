@@ -33,8 +33,8 @@ time_t timegm(struct tm* _tm)
     days += 1;
   /* Add current day */
   days += day;
-  /* Convert to seconds */
-  return (time_t)((((days * 24 + _tm->tm_hour) * 60 + _tm->tm_min) * 60) + _tm->tm_sec);
+  /* Convert to seconds, in time_t so dates past 2038 don't overflow int */
+  return (((time_t)days * 24 + _tm->tm_hour) * 60 + _tm->tm_min) * 60 + _tm->tm_sec;
 }
 #endif /* timegm */
 